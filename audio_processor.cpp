@@ -1,15 +1,42 @@
 #include <alsa/asoundlib.h>
 #include <iostream>
 #include <thread>
+#include <future>
 #include <mutex>
 #include <condition_variable>
 #include <vector>
 #include <atomic>
 #include <memory>
 #include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cerrno>
 #include <cstring>
 #include <algorithm>
-#include <chrono>
+#include <array>
+#include <cmath>
+#include <iomanip>
+#include <limits>
+#include <fstream>
+#include <sstream>
+#include <string>
+#include <type_traits>
+#include <typeinfo>
+#include <fcntl.h>
+#include <semaphore.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#if defined(__x86_64__) || defined(__i386__)
+#include <x86intrin.h>
+#endif
+#if defined(__aarch64__)
+#include <arm_neon.h>
+#elif defined(__ARM_FEATURE_DSP)
+#include <arm_acle.h>
+#endif
 
 class DelayLine
 {
@@ -127,6 +154,17 @@ public:
         return true;
     }
 
+    // Drops up to length samples from the read side without copying them
+    size_t discard(size_t length)
+    {
+        std::lock_guard<std::mutex> lock(mutex);
+        length = std::min(length, size.load());
+        tail = (tail + length) % capacity;
+        size.fetch_sub(length);
+        notFull.notify_one();
+        return length;
+    }
+
     size_t availableForWrite() const
     {
         return capacity - size.load();
@@ -152,6 +190,23 @@ private:
     snd_pcm_t *handle;
     std::string deviceName;
     snd_pcm_stream_t streamType;
+    unsigned int rate = 0;
+    snd_pcm_uframes_t bufferFrames = 0;
+    size_t frameBytes = 0;
+
+    // Null backend: while the hardware is gone, read() returns silence and
+    // write() discards, both paced at the configured rate
+    bool nullBackend = false;
+    std::chrono::steady_clock::time_point nullDeadline;
+
+    // Monotonic time (ns) at which the frame after the last one transferred
+    // passes the hardware: recorded, for capture; due to play, for playback
+    int64_t nextFrameTime = 0;
+    bool hasFrameTime = false;
+
+    // Where open() and configure() report
+    std::ostream *logOut = &std::cout;
+    std::ostream *logErr = &std::cerr;
 
 public:
     ALSADevice() : handle(nullptr), deviceName(""), streamType(SND_PCM_STREAM_PLAYBACK) {}
@@ -161,6 +216,14 @@ public:
         close();
     }
 
+    // Redirects what open() and configure() print, e.g. to a buffer while
+    // several devices open at once
+    void setLog(std::ostream &output, std::ostream &errors)
+    {
+        logOut = &output;
+        logErr = &errors;
+    }
+
     bool open(const std::string &device, snd_pcm_stream_t stream)
     {
         deviceName = device;
@@ -169,7 +232,7 @@ public:
         int err = snd_pcm_open(&handle, device.c_str(), stream, 0);
         if (err < 0)
         {
-            std::cerr << "Error opening PCM device " << device << ": "
+            *logErr << "Error opening PCM device " << device << ": "
                       << snd_strerror(err) << std::endl;
             return false;
         }
@@ -191,7 +254,7 @@ public:
         int err = snd_pcm_hw_params_any(handle, hwParams);
         if (err < 0)
         {
-            std::cerr << "Error getting hw params: " << snd_strerror(err) << std::endl;
+            *logErr << "Error getting hw params: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -199,7 +262,7 @@ public:
         err = snd_pcm_hw_params_set_access(handle, hwParams, SND_PCM_ACCESS_RW_INTERLEAVED);
         if (err < 0)
         {
-            std::cerr << "Error setting access: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting access: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -207,7 +270,7 @@ public:
         err = snd_pcm_hw_params_set_format(handle, hwParams, format);
         if (err < 0)
         {
-            std::cerr << "Error setting format: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting format: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -216,13 +279,13 @@ public:
         err = snd_pcm_hw_params_set_rate_near(handle, hwParams, &actualRate, 0);
         if (err < 0)
         {
-            std::cerr << "Error setting rate: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting rate: " << snd_strerror(err) << std::endl;
             return false;
         }
 
         if (actualRate != sampleRate)
         {
-            std::cout << "Requested rate " << sampleRate << " Hz, got "
+            *logOut << "Requested rate " << sampleRate << " Hz, got "
                       << actualRate << " Hz" << std::endl;
         }
 
@@ -230,7 +293,7 @@ public:
         err = snd_pcm_hw_params_set_channels(handle, hwParams, channels);
         if (err < 0)
         {
-            std::cerr << "Error setting channels: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting channels: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -239,7 +302,7 @@ public:
         err = snd_pcm_hw_params_set_buffer_size_near(handle, hwParams, &actualBufferSize);
         if (err < 0)
         {
-            std::cerr << "Error setting buffer size: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting buffer size: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -248,7 +311,7 @@ public:
         err = snd_pcm_hw_params_set_period_size_near(handle, hwParams, &actualPeriodSize, 0);
         if (err < 0)
         {
-            std::cerr << "Error setting period size: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting period size: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -256,7 +319,7 @@ public:
         err = snd_pcm_hw_params(handle, hwParams);
         if (err < 0)
         {
-            std::cerr << "Error setting hw params: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting hw params: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -267,7 +330,7 @@ public:
         err = snd_pcm_sw_params_current(handle, swParams);
         if (err < 0)
         {
-            std::cerr << "Error getting sw params: " << snd_strerror(err) << std::endl;
+            *logErr << "Error getting sw params: " << snd_strerror(err) << std::endl;
             return false;
         }
 
@@ -283,41 +346,70 @@ public:
 
         if (err < 0)
         {
-            std::cerr << "Error setting start threshold: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting start threshold: " << snd_strerror(err) << std::endl;
             return false;
         }
 
+        // Monotonic status timestamps, for measuring frames lost to an xrun
+        if (snd_pcm_sw_params_set_tstamp_mode(handle, swParams, SND_PCM_TSTAMP_ENABLE) < 0 ||
+            snd_pcm_sw_params_set_tstamp_type(handle, swParams, SND_PCM_TSTAMP_TYPE_MONOTONIC) < 0)
+        {
+            *logErr << "Warning: monotonic timestamps unavailable on " << deviceName << std::endl;
+        }
+
         // Apply software parameters
         err = snd_pcm_sw_params(handle, swParams);
         if (err < 0)
         {
-            std::cerr << "Error setting sw params: " << snd_strerror(err) << std::endl;
+            *logErr << "Error setting sw params: " << snd_strerror(err) << std::endl;
             return false;
         }
 
-        std::cout << "Device " << deviceName << " configured successfully:" << std::endl;
-        std::cout << "  Sample rate: " << actualRate << " Hz" << std::endl;
-        std::cout << "  Channels: " << channels << std::endl;
-        std::cout << "  Buffer size: " << actualBufferSize << " frames" << std::endl;
-        std::cout << "  Period size: " << actualPeriodSize << " frames" << std::endl;
-
+        *logOut << "Device " << deviceName << " configured successfully:" << std::endl;
+        *logOut << "  Sample rate: " << actualRate << " Hz" << std::endl;
+        *logOut << "  Channels: " << channels << std::endl;
+        *logOut << "  Buffer size: " << actualBufferSize << " frames" << std::endl;
+        *logOut << "  Period size: " << actualPeriodSize << " frames" << std::endl;
+
+        rate = actualRate;
+        bufferFrames = actualBufferSize;
+        frameBytes = channels * static_cast<size_t>(snd_pcm_format_physical_width(format)) / 8;
+        hasFrameTime = false;
+        nullBackend = false;
         return true;
     }
 
     snd_pcm_sframes_t read(void *buffer, snd_pcm_uframes_t frames)
     {
         if (!handle)
-            return -1;
+        {
+            if (!nullBackend)
+                return -1;
+            std::memset(buffer, 0, frames * frameBytes);
+            return waitNullFrames(frames);
+        }
         return snd_pcm_readi(handle, buffer, frames);
     }
 
     snd_pcm_sframes_t write(const void *buffer, snd_pcm_uframes_t frames)
     {
         if (!handle)
-            return -1;
+            return nullBackend ? waitNullFrames(frames) : -1;
         return snd_pcm_writei(handle, buffer, frames);
     }
 
+    // Closes the hardware and keeps the stream going on the null backend
+    void detach()
+    {
+        close();
+        nullBackend = rate > 0;
+        nullDeadline = std::chrono::steady_clock::now();
+        hasFrameTime = false;
+    }
+
+    bool isDetached() const { return nullBackend && !handle; }
+    const std::string &getName() const { return deviceName; }
+
     bool prepare()
     {
         if (!handle)
@@ -366,29 +458,256 @@ public:
         }
     }
 
+    // Frames between the application pointer and the hardware: for playback,
+    // frames queued but not yet heard; for capture, frames captured but not yet read
+    snd_pcm_sframes_t getDelay() const
+    {
+        if (!handle)
+            return 0;
+        snd_pcm_sframes_t delay = 0;
+        if (snd_pcm_delay(handle, &delay) < 0)
+            return 0;
+        return delay;
+    }
+
     snd_pcm_state_t getState() const
     {
         return handle ? snd_pcm_state(handle) : SND_PCM_STATE_DISCONNECTED;
     }
 
-    bool recover(int err)
+private:
+    snd_pcm_sframes_t waitNullFrames(snd_pcm_uframes_t frames)
+    {
+        nullDeadline += std::chrono::nanoseconds(static_cast<int64_t>(frames) * 1000000000 / rate);
+        const auto now = std::chrono::steady_clock::now();
+        if (nullDeadline < now)
+            nullDeadline = now; // Don't race to catch up after a stall
+        std::this_thread::sleep_until(nullDeadline);
+        return static_cast<snd_pcm_sframes_t>(frames);
+    }
+
+public:
+    // Starts, stops and prepares this stream together with other from now on
+    bool link(ALSADevice &other)
     {
-        if (!handle)
+        if (!handle || !other.handle)
+            return false;
+        int err = snd_pcm_link(handle, other.handle);
+        if (err < 0)
+        {
+            std::cerr << "Error linking " << deviceName << " with " << other.deviceName
+                      << ": " << snd_strerror(err) << std::endl;
             return false;
+        }
+        return true;
+    }
+
+    static int64_t monotonicNow()
+    {
+        timespec now;
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        return static_cast<int64_t>(now.tv_sec) * 1000000000 + now.tv_nsec;
+    }
+
+    // Samples the stream position after a successful read or write
+    void markTransfer()
+    {
+        snd_pcm_uframes_t avail = 0;
+        snd_htimestamp_t stamp;
+        if (!handle || rate == 0 || snd_pcm_htimestamp(handle, &avail, &stamp) < 0)
+            return;
+
+        const int64_t stampNs = static_cast<int64_t>(stamp.tv_sec) * 1000000000 + stamp.tv_nsec;
+        if (stampNs == 0)
+            return; // Timestamps disabled
+        // Capture: avail frames were recorded before the stamp and not read.
+        // Playback: the queued frames (buffer minus avail) play after it.
+        const int64_t frames = (streamType == SND_PCM_STREAM_CAPTURE)
+                                   ? -static_cast<int64_t>(avail)
+                                   : static_cast<int64_t>(bufferFrames) - static_cast<int64_t>(avail);
+        nextFrameTime = stampNs + frames * 1000000000 / rate;
+        hasFrameTime = true;
+    }
+
+    // How far behind schedule the next frame is at time now, in frames: for
+    // capture, the frames that were never read; for playback, the output that
+    // fell due while stopped (negative when restarting early)
+    snd_pcm_sframes_t getFramesLate(int64_t now) const
+    {
+        if (!hasFrameTime)
+            return 0;
+        return static_cast<snd_pcm_sframes_t>((now - nextFrameTime) * rate / 1000000000);
+    }
+
+    // Stops starting, stopping and preparing together with linked streams
+    void unlink()
+    {
+        if (handle)
+            snd_pcm_unlink(handle);
+    }
+
+    // Non-blocking writes return -EAGAIN instead of waiting for room
+    bool setNonBlocking(bool nonBlocking)
+    {
+        return handle && snd_pcm_nonblock(handle, nonBlocking ? 1 : 0) == 0;
+    }
+
+    // Waits up to timeoutMs for room (playback) or data (capture); false only
+    // when the hardware pointer made no progress in that time
+    bool waitReady(int timeoutMs)
+    {
+        return !handle || snd_pcm_wait(handle, timeoutMs) != 0;
+    }
+
+    // Exchanges streams with other, so a standby can take over this role
+    void swap(ALSADevice &other)
+    {
+        std::swap(handle, other.handle);
+        std::swap(deviceName, other.deviceName);
+        std::swap(streamType, other.streamType);
+        std::swap(rate, other.rate);
+        std::swap(bufferFrames, other.bufferFrames);
+        std::swap(frameBytes, other.frameBytes);
+        std::swap(nullBackend, other.nullBackend);
+        std::swap(nullDeadline, other.nullDeadline);
+        std::swap(nextFrameTime, other.nextFrameTime);
+        std::swap(hasFrameTime, other.hasFrameTime);
+    }
+
+    snd_pcm_t *getHandle() const { return handle; }
+};
+
+// Binary effect state for warm restarts: raw values in host order and
+// count-prefixed arrays. A snapshot is only read back by the build that
+// wrote it, which AudioProcessor checks with a header.
+class EffectStateWriter
+{
+private:
+    std::vector<uint8_t> &m_out;
+
+public:
+    explicit EffectStateWriter(std::vector<uint8_t> &out) : m_out(out) {}
+
+    template <typename T>
+    void write(const T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "state is stored as raw bytes");
+        const auto *bytes = reinterpret_cast<const uint8_t *>(&value);
+        m_out.insert(m_out.end(), bytes, bytes + sizeof(T));
+    }
+
+    template <typename T>
+    void writeArray(const T *values, size_t count)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "state is stored as raw bytes");
+        write<uint64_t>(count);
+        const auto *bytes = reinterpret_cast<const uint8_t *>(values);
+        m_out.insert(m_out.end(), bytes, bytes + count * sizeof(T));
+    }
+
+    template <typename T>
+    void writeArray(const std::vector<T> &values) { writeArray(values.data(), values.size()); }
+
+    // A length-prefixed record, so readers can skip one they cannot restore
+    size_t beginRecord()
+    {
+        write<uint64_t>(0);
+        return m_out.size();
+    }
+    void endRecord(size_t start)
+    {
+        const uint64_t length = m_out.size() - start;
+        std::memcpy(m_out.data() + start - sizeof(length), &length, sizeof(length));
+    }
+};
+
+// Reads what EffectStateWriter wrote, straight out of a mapped snapshot.
+// Any read past the end or array of the wrong length fails, and every
+// later read then fails too.
+class EffectStateReader
+{
+private:
+    const uint8_t *m_data;
+    size_t m_size;
+    size_t m_position = 0;
+    bool m_ok = true;
+
+    const uint8_t *take(size_t bytes)
+    {
+        if (!m_ok || bytes > m_size - m_position)
+        {
+            m_ok = false;
+            return nullptr;
+        }
+        const uint8_t *at = m_data + m_position;
+        m_position += bytes;
+        return at;
+    }
+
+    bool readCount(uint64_t &count, size_t elementSize)
+    {
+        return read(count) && (elementSize == 0 || count <= (m_size - m_position) / elementSize);
+    }
 
-        std::cout << "Recovering from error: " << snd_strerror(err) << std::endl;
+public:
+    EffectStateReader(const uint8_t *data, size_t size) : m_data(data), m_size(size) {}
+
+    bool ok() const { return m_ok; }
+    bool atEnd() const { return m_ok && m_position == m_size; }
+
+    template <typename T>
+    bool read(T &value)
+    {
+        static_assert(std::is_trivially_copyable<T>::value, "state is stored as raw bytes");
+        const uint8_t *at = take(sizeof(T));
+        if (at)
+            std::memcpy(&value, at, sizeof(T));
+        return at != nullptr;
+    }
 
-        int recovery = snd_pcm_recover(handle, err, 1);
-        if (recovery < 0)
+    // Into existing storage: the stored count must equal count
+    template <typename T>
+    bool readArray(T *values, size_t count)
+    {
+        uint64_t stored = 0;
+        if (!readCount(stored, sizeof(T)) || stored != count)
         {
-            std::cerr << "Recovery failed: " << snd_strerror(recovery) << std::endl;
+            m_ok = false;
             return false;
         }
+        const uint8_t *at = take(count * sizeof(T));
+        if (at)
+            std::memcpy(values, at, count * sizeof(T));
+        return at != nullptr;
+    }
 
-        return prepare();
+    // Resizing values to the stored count
+    template <typename T>
+    bool readArray(std::vector<T> &values)
+    {
+        uint64_t stored = 0;
+        if (!readCount(stored, sizeof(T)))
+        {
+            m_ok = false;
+            return false;
+        }
+        const uint8_t *at = take(stored * sizeof(T));
+        if (!at)
+            return false;
+        values.resize(stored);
+        std::memcpy(values.data(), at, stored * sizeof(T));
+        return true;
     }
 
-    snd_pcm_t *getHandle() const { return handle; }
+    // The next record as its own reader (invalid when truncated)
+    EffectStateReader readRecord()
+    {
+        uint64_t length = 0;
+        const uint8_t *at = readCount(length, 1) ? take(length) : nullptr;
+        EffectStateReader record(at, at ? length : 0);
+        record.m_ok = at != nullptr;
+        return record;
+    }
 };
 
 // Base class for all audio effects
@@ -405,6 +724,15 @@ public:
     virtual void process(const int32_t *inputBuffer, int32_t *outputBuffer,
                          size_t numSamples, unsigned int channels) = 0;
 
+    // Optional float path for wrappers that hold the signal in float
+    // between their own stages (OversamplingEffect): processes one block per
+    // channel in place, full scale at +-1.0 and nothing clipped. Returns
+    // false when the effect has none; the caller then goes through process().
+    virtual bool processPlanar(float *const * /*channelData*/, size_t /*numFrames*/, unsigned int /*channels*/)
+    {
+        return false;
+    }
+
     // Reset effect state (clear buffers, etc.)
     virtual void reset() = 0;
 
@@ -415,9 +743,128 @@ public:
     // Set sample rate (called when audio system changes sample rate)
     virtual void setSampleRate(unsigned int sampleRate) { m_sampleRate = sampleRate; }
 
+    // Processing latency added by the effect, in frames at the host sample rate
+    virtual size_t getLatency() const { return 0; }
+
+    // Largest block and the channel count process() will see. Effects size
+    // their block scratch here, before processing starts, so blocks up to
+    // maxFrames never allocate on the audio thread.
+    virtual void prepare(size_t /*maxFrames*/, unsigned int /*channels*/) {}
+
+    // A bypassed effect would pass a block with this channel count through
+    // unchanged, so AudioEffectChain does not call it at all. Every effect
+    // must accept outputBuffer == inputBuffer.
+    virtual bool isBypassed(unsigned int channels) const { return !m_enabled || channels == 0; }
+
+    // Layout of stereo buffers passed to process(): left/right, or mid/side
+    // when the effect sits inside an AudioEffectChain mid/side span
+    enum class ChannelDomain
+    {
+        LEFT_RIGHT,
+        MID_SIDE
+    };
+    virtual void setChannelDomain(ChannelDomain domain) { m_channelDomain = domain; }
+    ChannelDomain getChannelDomain() const { return m_channelDomain; }
+
+    // Effects with large buffers may leave zeroing them out of the
+    // constructor (deferState()). The state is then built once, by the
+    // first of prepareState() -- run off the audio path at startup -- and a
+    // control-thread call that needs it (reset, restore). process() never
+    // builds it: the effect passes audio through until it is published.
+    // Effects wrapping others forward prepareState() to them.
+    virtual void prepareState()
+    {
+        if (claimState())
+        {
+            buildState();
+            publishState();
+        }
+    }
+    bool isStateReady() const { return m_stateReady.load(std::memory_order_acquire); }
+
+    // Warm-restart snapshot: parameters plus everything process() carries
+    // from block to block (delay lines, filter states, positions). The base
+    // versions cover the enabled flag; effects whose remaining state is
+    // short-lived or re-adapts on its own keep them. When restoreState()
+    // returns false the caller resets the effect, so overrides may read
+    // lines and filter states in place but commit parameters (the enabled
+    // flag included) only once the whole record has read.
+    virtual void saveState(EffectStateWriter &out) const { out.write(m_enabled); }
+    virtual bool restoreState(EffectStateReader &in) { return in.read(m_enabled); }
+
+    // An effect's state as a record tagged with its type, the way
+    // AudioEffectChain stores each of its effects (and wrappers their inner
+    // one). Restoring fails unless the record is of the same type and reads
+    // to its end.
+    static void saveTagged(EffectStateWriter &out, const AudioEffect &effect)
+    {
+        const char *type = typeid(effect).name();
+        out.writeArray(type, std::strlen(type));
+        const size_t record = out.beginRecord();
+        effect.saveState(out);
+        out.endRecord(record);
+    }
+
+    static bool restoreTagged(EffectStateReader &in, AudioEffect &effect)
+    {
+        std::vector<char> type;
+        in.readArray(type);
+        EffectStateReader record = in.readRecord();
+        const char *expected = typeid(effect).name();
+        const bool sameType = type.size() == std::strlen(expected) && std::equal(type.begin(), type.end(), expected);
+        return record.ok() && sameType && effect.restoreState(record) && record.atEnd();
+    }
+
 protected:
+    static constexpr unsigned int MAX_SNAPSHOT_CHANNELS = 64; // Bound on a restored layout
+
+    virtual void buildState() {}
+    void deferState()
+    {
+        m_stateClaimed.store(false);
+        m_stateReady.store(false);
+    }
+    // True for the one caller that gets to build deferred state, which then
+    // publishes it
+    bool claimState() { return !m_stateClaimed.exchange(true); }
+    void publishState()
+    {
+        {
+            std::lock_guard<std::mutex> lock(stateBuild().mutex);
+            m_stateReady.store(true, std::memory_order_release);
+        }
+        stateBuild().built.notify_all();
+    }
+    // For control-thread callers that must touch the state: builds it or
+    // sleeps until the thread building it publishes it
+    void ensureState()
+    {
+        prepareState();
+        std::unique_lock<std::mutex> lock(stateBuild().mutex);
+        stateBuild().built.wait(lock, [this]()
+                                { return isStateReady(); });
+    }
+
     bool m_enabled = true;
     unsigned int m_sampleRate = 48000;
+    ChannelDomain m_channelDomain = ChannelDomain::LEFT_RIGHT;
+
+private:
+    // Shared by every effect; deferred state is published a handful of
+    // times per run
+    struct StateBuild
+    {
+        std::mutex mutex;
+        std::condition_variable built;
+    };
+    static StateBuild &stateBuild()
+    {
+        static StateBuild build;
+        return build;
+    }
+
+    std::atomic<bool> m_stateClaimed{true};
+    std::atomic<bool> m_stateReady{true};
 };
 
 #pragma once
@@ -428,1047 +875,9354 @@ protected:
 #include <cmath>
 #include <random>
 
-// All-pass filter for reverb
-class AllPassFilter
+// Channel-count specialization. Calls fn(std::integral_constant<unsigned
+// int, N>{}) with N = channels for the common layouts 1, 2, 4 and 8, and
+// N = 0 for any other count. Kernels templated on N use N ? N : channels as
+// their trip count and stride, so the common cases get compile-time loops
+// while the switch runs once per block.
+template <typename Fn>
+inline void dispatchChannels(unsigned int channels, Fn &&fn)
 {
-private:
-    std::vector<float> m_buffer;
-    size_t m_bufferSize;
-    size_t m_writeIndex;
-    float m_gain;
+    switch (channels)
+    {
+    case 1:
+        fn(std::integral_constant<unsigned int, 1>{});
+        break;
+    case 2:
+        fn(std::integral_constant<unsigned int, 2>{});
+        break;
+    case 4:
+        fn(std::integral_constant<unsigned int, 4>{});
+        break;
+    case 8:
+        fn(std::integral_constant<unsigned int, 8>{});
+        break;
+    default:
+        fn(std::integral_constant<unsigned int, 0>{});
+        break;
+    }
+}
 
-public:
-    AllPassFilter(size_t delayInSamples, float gain = 0.7f)
-        : m_bufferSize(delayInSamples), m_writeIndex(0), m_gain(gain)
+// Sample format helpers shared by the float-domain effects
+namespace SampleConversion
+{
+    constexpr float INT32_TO_FLOAT = 1.0f / 2147483648.0f;
+    constexpr float FLOAT_TO_INT32 = 2147483648.0f;
+    constexpr float INT32_MAX_AS_FLOAT = 2147483520.0f; // Largest float below 2^31
+
+    template <unsigned int CH>
+    inline void deinterleaveKernel(const int32_t *input, float *output, size_t numFrames,
+                                   unsigned int channels, unsigned int channel)
     {
-        m_buffer.resize(m_bufferSize, 0.0f);
+        const size_t stride = CH ? CH : channels;
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+            output[i] = static_cast<float>(input[i * stride + channel]) * INT32_TO_FLOAT;
+        }
     }
 
-    float process(float input)
+    template <unsigned int CH>
+    inline void interleaveKernel(const float *input, int32_t *output, size_t numFrames,
+                                 unsigned int channels, unsigned int channel)
     {
-        size_t readIndex = m_writeIndex;
-        float delayed = m_buffer[readIndex];
+        const size_t stride = CH ? CH : channels;
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+            const float scaled = std::clamp(input[i] * FLOAT_TO_INT32, -FLOAT_TO_INT32, INT32_MAX_AS_FLOAT);
+            output[i * stride + channel] = static_cast<int32_t>(scaled);
+        }
+    }
 
-        // All-pass filter equation: y[n] = -g*x[n] + x[n-d] + g*y[n-d]
-        float output = -m_gain * input + delayed;
-        m_buffer[m_writeIndex] = input + m_gain * delayed;
+    // Extract one channel of an interleaved int32 buffer into a float block
+    inline void deinterleave(const int32_t *input, float *output, size_t numFrames,
+                             unsigned int channels, unsigned int channel)
+    {
+        dispatchChannels(channels, [&](auto ch)
+                         { deinterleaveKernel<decltype(ch)::value>(input, output, numFrames, channels, channel); });
+    }
 
-        m_writeIndex = (m_writeIndex + 1) % m_bufferSize;
-        return output;
+    // Write a float block back into one channel of an interleaved int32 buffer
+    inline void interleave(const float *input, int32_t *output, size_t numFrames,
+                           unsigned int channels, unsigned int channel)
+    {
+        dispatchChannels(channels, [&](auto ch)
+                         { interleaveKernel<decltype(ch)::value>(input, output, numFrames, channels, channel); });
     }
+}
 
-    void clear()
+// Biquad over interleaved float frames, transposed direct form II, with the
+// channel loop innermost so the recursion runs across channels in parallel.
+// The specialised channel counts keep the filter state in registers.
+namespace InterleavedBiquad
+{
+    struct Coefficients
     {
-        std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
-        m_writeIndex = 0;
+        float b0, b1, b2, a1, a2;
+    };
+
+    // state: z1 for every channel, then z2 for every channel
+    template <unsigned int CH>
+    inline void runKernel(const Coefficients &c, float *state, float *buffer, size_t frames, unsigned int channels)
+    {
+        if constexpr (CH == 0)
+        {
+            float *z1 = state;
+            float *z2 = state + channels;
+            for (size_t i = 0; i < frames; ++i)
+            {
+                float *frame = buffer + i * channels;
+                for (unsigned int ch = 0; ch < channels; ++ch)
+                {
+                    const float x = frame[ch];
+                    const float y = c.b0 * x + z1[ch];
+                    z1[ch] = c.b1 * x - c.a1 * y + z2[ch];
+                    z2[ch] = c.b2 * x - c.a2 * y;
+                    frame[ch] = y;
+                }
+            }
+        }
+        else
+        {
+            std::array<float, CH> z1;
+            std::array<float, CH> z2;
+            std::copy(state, state + CH, z1.begin());
+            std::copy(state + CH, state + 2 * CH, z2.begin());
+            for (size_t i = 0; i < frames; ++i)
+            {
+                float *frame = buffer + i * CH;
+                for (unsigned int ch = 0; ch < CH; ++ch)
+                {
+                    const float x = frame[ch];
+                    const float y = c.b0 * x + z1[ch];
+                    z1[ch] = c.b1 * x - c.a1 * y + z2[ch];
+                    z2[ch] = c.b2 * x - c.a2 * y;
+                    frame[ch] = y;
+                }
+            }
+            std::copy(z1.begin(), z1.end(), state);
+            std::copy(z2.begin(), z2.end(), state + CH);
+        }
     }
 
-    void setGain(float gain) { m_gain = std::clamp(gain, -0.99f, 0.99f); }
-};
+    inline void run(const Coefficients &c, float *state, float *buffer, size_t frames, unsigned int channels)
+    {
+        dispatchChannels(channels, [&](auto ch)
+                         { runKernel<decltype(ch)::value>(c, state, buffer, frames, channels); });
+    }
+}
 
-// Comb filter (feedback delay line) for reverb
-class CombFilter
+// Float delay line with a power-of-two buffer, shared by the modulated and
+// multi-tap delays. Positions wrap with a mask instead of %, and fractional
+// reads use 4-point cubic (Catmull-Rom) interpolation.
+class InterpolatedDelayLine
 {
 private:
     std::vector<float> m_buffer;
-    size_t m_bufferSize;
+    size_t m_mask;
     size_t m_writeIndex;
-    float m_feedback;
-    float m_damping;
-    float m_filterState;
 
 public:
-    CombFilter(size_t delayInSamples, float feedback = 0.84f, float damping = 0.2f)
-        : m_bufferSize(delayInSamples), m_writeIndex(0),
-          m_feedback(feedback), m_damping(damping), m_filterState(0.0f)
+    explicit InterpolatedDelayLine(size_t maxDelaySamples = 1)
+        : m_mask(0), m_writeIndex(0)
     {
-        m_buffer.resize(m_bufferSize, 0.0f);
+        setMaxDelay(maxDelaySamples);
     }
 
-    float process(float input)
+    // Grows the buffer to hold maxDelaySamples plus the interpolation taps
+    void setMaxDelay(size_t maxDelaySamples)
     {
-        size_t readIndex = m_writeIndex;
-        float delayed = m_buffer[readIndex];
-
-        // One-pole lowpass filter for damping
-        m_filterState = delayed * (1.0f - m_damping) + m_filterState * m_damping;
-
-        m_buffer[m_writeIndex] = input + m_filterState * m_feedback;
-        m_writeIndex = (m_writeIndex + 1) % m_bufferSize;
+        size_t size = 1;
+        while (size < maxDelaySamples + 4)
+        {
+            size <<= 1;
+        }
 
-        return delayed;
+        if (size != m_buffer.size())
+        {
+            m_buffer.assign(size, 0.0f);
+            m_mask = size - 1;
+            m_writeIndex = 0;
+        }
     }
 
+    size_t getMaxDelay() const { return m_buffer.size() - 4; }
+
     void clear()
     {
         std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
         m_writeIndex = 0;
-        m_filterState = 0.0f;
     }
 
-    void setFeedback(float feedback) { m_feedback = std::clamp(feedback, 0.0f, 0.99f); }
-    void setDamping(float damping) { m_damping = std::clamp(damping, 0.0f, 1.0f); }
-};
-
-// Early reflections generator
-class EarlyReflections
-{
-private:
-    static constexpr int NUM_TAPS = 8;
-    std::vector<float> m_buffer;
-    size_t m_bufferSize;
-    size_t m_writeIndex;
-
-    struct Tap
+    void saveState(EffectStateWriter &out) const
     {
-        size_t delay;
-        float gain;
-    };
-
-    std::array<Tap, NUM_TAPS> m_taps;
+        out.writeArray(m_buffer);
+        out.write(m_writeIndex);
+    }
 
-public:
-    EarlyReflections(size_t sampleRate, float roomSize = 1.0f)
+    // Into a line of the same length
+    bool restoreState(EffectStateReader &in)
     {
-        // Buffer size for maximum early reflection delay (50ms)
-        m_bufferSize = static_cast<size_t>(sampleRate * 0.05f);
-        m_buffer.resize(m_bufferSize, 0.0f);
-        m_writeIndex = 0;
-
-        setupTaps(sampleRate, roomSize);
+        if (!in.readArray(m_buffer.data(), m_buffer.size()) || !in.read(m_writeIndex))
+            return false;
+        m_writeIndex &= m_mask;
+        return true;
     }
 
-    void setupTaps(size_t sampleRate, float roomSize)
+    void write(const float *input, size_t numSamples)
     {
-        // Early reflection patterns based on room size
-        float baseDelay = roomSize * 0.01f; // Base delay in seconds
-
-        m_taps[0] = {static_cast<size_t>(baseDelay * 0.5f * sampleRate), 0.8f * roomSize};
-        m_taps[1] = {static_cast<size_t>(baseDelay * 0.8f * sampleRate), 0.6f * roomSize};
-        m_taps[2] = {static_cast<size_t>(baseDelay * 1.2f * sampleRate), 0.7f * roomSize};
-        m_taps[3] = {static_cast<size_t>(baseDelay * 1.8f * sampleRate), 0.5f * roomSize};
-        m_taps[4] = {static_cast<size_t>(baseDelay * 2.3f * sampleRate), 0.4f * roomSize};
-        m_taps[5] = {static_cast<size_t>(baseDelay * 2.9f * sampleRate), 0.3f * roomSize};
-        m_taps[6] = {static_cast<size_t>(baseDelay * 3.5f * sampleRate), 0.25f * roomSize};
-        m_taps[7] = {static_cast<size_t>(baseDelay * 4.2f * sampleRate), 0.2f * roomSize};
-
-        // Ensure delays don't exceed buffer size
-        for (auto &tap : m_taps)
+        for (size_t i = 0; i < numSamples; ++i)
         {
-            tap.delay = std::min(tap.delay, m_bufferSize - 1);
+            m_buffer[(m_writeIndex + i) & m_mask] = input[i];
         }
+        m_writeIndex = (m_writeIndex + numSamples) & m_mask;
     }
 
-    float process(float input)
+    // Reads one output per delay, where delays[i] (in samples) is relative to
+    // the i-th sample of the next block to be written. Reads must not reach
+    // samples that block has not written yet, so callers keep numSamples
+    // below the shortest whole delay.
+    void readCubic(const float *delays, float *output, size_t numSamples) const
     {
-        m_buffer[m_writeIndex] = input;
-
-        float output = 0.0f;
-        for (const auto &tap : m_taps)
+        const float *buffer = m_buffer.data();
+        for (size_t i = 0; i < numSamples; ++i)
         {
-            size_t readIndex = (m_writeIndex + m_bufferSize - tap.delay) % m_bufferSize;
-            output += m_buffer[readIndex] * tap.gain;
+            const size_t whole = static_cast<size_t>(delays[i]);
+            const float frac = delays[i] - static_cast<float>(whole);
+            const size_t base = m_writeIndex + i - whole;
+
+            // y0 is the newest of the four points, y3 the oldest
+            const float y0 = buffer[(base + 1) & m_mask];
+            const float y1 = buffer[base & m_mask];
+            const float y2 = buffer[(base - 1) & m_mask];
+            const float y3 = buffer[(base - 2) & m_mask];
+
+            const float c1 = 0.5f * (y2 - y0);
+            const float c2 = y0 - 2.5f * y1 + 2.0f * y2 - 0.5f * y3;
+            const float c3 = 0.5f * (y3 - y0) + 1.5f * (y1 - y2);
+            output[i] = ((c3 * frac + c2) * frac + c1) * frac + y1;
         }
-
-        m_writeIndex = (m_writeIndex + 1) % m_bufferSize;
-        return output * 0.125f; // Scale down (1/8 for 8 taps)
-    }
-
-    void clear()
-    {
-        std::fill(m_buffer.begin(), m_buffer.end(), 0.0f);
-        m_writeIndex = 0;
     }
 
-    void setRoomSize(float roomSize, size_t sampleRate)
+    // Adds gain * (input delayed by an integer number of samples) to output.
+    // The read is split at the wrap point into contiguous runs.
+    void mixDelayed(size_t delay, float gain, float *output, size_t numSamples) const
     {
-        setupTaps(sampleRate, roomSize);
+        size_t readIndex = (m_writeIndex - delay) & m_mask;
+        size_t done = 0;
+        while (done < numSamples)
+        {
+            const size_t run = std::min(numSamples - done, m_buffer.size() - readIndex);
+            const float *src = m_buffer.data() + readIndex;
+            float *dst = output + done;
+            for (size_t i = 0; i < run; ++i)
+            {
+                dst[i] += gain * src[i];
+            }
+            done += run;
+            readIndex = (readIndex + run) & m_mask;
+        }
     }
 };
 
-// Main reverb effect class
-class ReverbEffect : public AudioEffect
+// Reverb delay lengths. Comb, allpass and late-tail line lengths are rounded
+// to primes that are distinct within one reverb, so no two recirculating
+// lines share a factor and their modes never pile up into a metallic ring.
+// Early reflection taps are distinct primes as well. All of it is constexpr:
+// the room presets at the common sample rates are tabulated at compile time,
+// and custom sizes or other rates run the same code at runtime.
+namespace ReverbTuning
 {
-public:
-    enum RoomType
+    constexpr size_t NUM_COMBS = 4;
+    constexpr size_t NUM_ALLPASS = 3;
+    constexpr size_t NUM_LATE_LINES = 8;
+    constexpr size_t NUM_EARLY_TAPS = 8;
+
+    // Nominal lengths relative to a base that scales with room size
+    constexpr float COMB_BASE_SECONDS = 0.03f;
+    constexpr std::array<float, NUM_COMBS> COMB_RATIOS_L = {1.0f, 1.13f, 1.27f, 1.41f};
+    constexpr std::array<float, NUM_COMBS> COMB_RATIOS_R = {1.05f, 1.18f, 1.32f, 1.46f};
+    constexpr float ALLPASS_BASE_SECONDS = 0.005f;
+    constexpr std::array<float, NUM_ALLPASS> ALLPASS_RATIOS_L = {1.0f, 2.1f, 3.7f};
+    constexpr std::array<float, NUM_ALLPASS> ALLPASS_RATIOS_R = {1.1f, 2.3f, 3.9f};
+    constexpr std::array<float, NUM_LATE_LINES> LATE_LINE_MS = {
+        31.1f, 37.3f, 41.9f, 44.3f, 49.7f, 53.9f, 59.3f, 67.1f};
+    constexpr float EARLY_BASE_SECONDS = 0.01f;
+    constexpr float EARLY_MAX_SECONDS = 0.05f;
+    constexpr std::array<float, NUM_EARLY_TAPS> EARLY_TAP_RATIOS = {0.5f, 0.8f, 1.2f, 1.8f, 2.3f, 2.9f, 3.5f, 4.2f};
+    constexpr std::array<float, NUM_EARLY_TAPS> EARLY_TAP_GAINS = {0.8f, 0.6f, 0.7f, 0.5f, 0.4f, 0.3f, 0.25f, 0.2f};
+
+    // Room sizes of ReverbEffect's presets, in RoomType order
+    constexpr std::array<float, 6> PRESET_ROOM_SIZES = {0.3f, 0.7f, 1.5f, 2.5f, 0.8f, 0.4f};
+    constexpr std::array<size_t, 4> SAMPLE_RATES = {44100, 48000, 88200, 96000};
+
+    constexpr bool isPrime(size_t n)
     {
-        SMALL_ROOM,
-        MEDIUM_ROOM,
-        LARGE_HALL,
-        CATHEDRAL,
-        PLATE,
-        SPRING,
-        CUSTOM
+        if (n < 2)
+            return false;
+        for (size_t d = 2; d * d <= n; ++d)
+        {
+            if (n % d == 0)
+                return false;
+        }
+        return true;
+    }
+
+    // Smallest prime >= n that is not in used[0, count) and does not exceed
+    // limit; the largest such prime below n if none does
+    template <size_t N>
+    constexpr size_t distinctPrime(size_t n, const std::array<size_t, N> &used, size_t count, size_t limit)
+    {
+        auto isFree = [&](size_t p)
+        {
+            for (size_t i = 0; i < count; ++i)
+            {
+                if (used[i] == p)
+                    return false;
+            }
+            return isPrime(p);
+        };
+
+        for (size_t p = std::max<size_t>(n, 2); p <= limit; ++p)
+        {
+            if (isFree(p))
+                return p;
+        }
+        for (size_t p = std::min(n, limit); p >= 2; --p)
+        {
+            if (isFree(p))
+                return p;
+        }
+        return 2;
+    }
+
+    struct Topology
+    {
+        std::array<size_t, NUM_COMBS> combL{};
+        std::array<size_t, NUM_COMBS> combR{};
+        std::array<size_t, NUM_ALLPASS> allpassL{};
+        std::array<size_t, NUM_ALLPASS> allpassR{};
+        std::array<size_t, NUM_LATE_LINES> lateLines{};
+        std::array<size_t, NUM_EARLY_TAPS> earlyL{};
+        std::array<size_t, NUM_EARLY_TAPS> earlyR{};
     };
 
+    // Early reflection taps, kept inside the EARLY_MAX_SECONDS buffer
+    constexpr std::array<size_t, NUM_EARLY_TAPS> makeEarlyTaps(float roomSize, size_t sampleRate)
+    {
+        std::array<size_t, NUM_EARLY_TAPS> taps{};
+        const size_t limit = static_cast<size_t>(sampleRate * EARLY_MAX_SECONDS) - 1;
+        const float base = roomSize * EARLY_BASE_SECONDS * sampleRate;
+        for (size_t i = 0; i < NUM_EARLY_TAPS; ++i)
+        {
+            taps[i] = distinctPrime(static_cast<size_t>(base * EARLY_TAP_RATIOS[i]), taps, i, limit);
+        }
+        return taps;
+    }
+
+    constexpr Topology makeTopology(float roomSize, size_t sampleRate)
+    {
+        Topology topology{};
+        std::array<size_t, 2 * NUM_COMBS + 2 * NUM_ALLPASS + NUM_LATE_LINES> used{};
+        size_t count = 0;
+        const size_t limit = static_cast<size_t>(-1);
+
+        const float combBase = roomSize * sampleRate * COMB_BASE_SECONDS;
+        for (size_t i = 0; i < NUM_COMBS; ++i)
+        {
+            topology.combL[i] = used[count] = distinctPrime(static_cast<size_t>(combBase * COMB_RATIOS_L[i]), used, count, limit);
+            ++count;
+            topology.combR[i] = used[count] = distinctPrime(static_cast<size_t>(combBase * COMB_RATIOS_R[i]), used, count, limit);
+            ++count;
+        }
+
+        const float allpassBase = roomSize * sampleRate * ALLPASS_BASE_SECONDS;
+        for (size_t i = 0; i < NUM_ALLPASS; ++i)
+        {
+            topology.allpassL[i] = used[count] = distinctPrime(static_cast<size_t>(allpassBase * ALLPASS_RATIOS_L[i]), used, count, limit);
+            ++count;
+            topology.allpassR[i] = used[count] = distinctPrime(static_cast<size_t>(allpassBase * ALLPASS_RATIOS_R[i]), used, count, limit);
+            ++count;
+        }
+
+        for (size_t j = 0; j < NUM_LATE_LINES; ++j)
+        {
+            topology.lateLines[j] = used[count] = distinctPrime(static_cast<size_t>(LATE_LINE_MS[j] * 0.001f * roomSize * sampleRate), used, count, limit);
+            ++count;
+        }
+
+        topology.earlyL = makeEarlyTaps(roomSize, sampleRate);
+        topology.earlyR = makeEarlyTaps(roomSize * 1.05f, sampleRate);
+        return topology;
+    }
+
+    // Every preset at every tabulated rate, [preset * rates + rate]
+    constexpr std::array<Topology, PRESET_ROOM_SIZES.size() * SAMPLE_RATES.size()> PRESET_TOPOLOGIES = []()
+    {
+        std::array<Topology, PRESET_ROOM_SIZES.size() * SAMPLE_RATES.size()> table{};
+        for (size_t preset = 0; preset < PRESET_ROOM_SIZES.size(); ++preset)
+        {
+            for (size_t rate = 0; rate < SAMPLE_RATES.size(); ++rate)
+            {
+                table[preset * SAMPLE_RATES.size() + rate] = makeTopology(PRESET_ROOM_SIZES[preset], SAMPLE_RATES[rate]);
+            }
+        }
+        return table;
+    }();
+
+    static_assert(PRESET_TOPOLOGIES[1 * SAMPLE_RATES.size() + 1].combL[0] == 1009,
+                  "medium room at 48 kHz: first comb is the prime at 1008 samples");
+
+    // Tabulated topology when preset and rate are covered, computed otherwise
+    inline Topology getTopology(size_t preset, float roomSize, size_t sampleRate)
+    {
+        if (preset < PRESET_ROOM_SIZES.size() && roomSize == PRESET_ROOM_SIZES[preset])
+        {
+            for (size_t rate = 0; rate < SAMPLE_RATES.size(); ++rate)
+            {
+                if (SAMPLE_RATES[rate] == sampleRate)
+                    return PRESET_TOPOLOGIES[preset * SAMPLE_RATES.size() + rate];
+            }
+        }
+        return makeTopology(roomSize, sampleRate);
+    }
+}
+
+// Sample engines for the reverb and delay primitives. An engine names the
+// stored sample type, the gain type and the few operations the primitives
+// need. Float32Engine is the default; Float64Engine keeps long feedback
+// tails clean for offline/mastering use; Q31Engine runs entirely in 32-bit
+// fixed point for boards without a fast FPU. Q31 gains cover [-1, 1), and
+// its products and sums saturate instead of wrapping, using the AArch64
+// scalar saturating instructions (SQRDMULH, SQADD) or ARM DSP QADD where
+// available.
+struct Float32Engine
+{
+    using Sample = float;
+    using Gain = float;
+    static constexpr const char *NAME = "float32";
+
+    static constexpr Sample fromFloat(float x) { return x; }
+    static constexpr float toFloat(Sample x) { return x; }
+    static constexpr Gain gain(float g) { return g; }
+    static Sample fromInt32(int32_t x) { return static_cast<float>(x) * SampleConversion::INT32_TO_FLOAT; }
+    static int32_t toInt32(Sample x)
+    {
+        return static_cast<int32_t>(std::clamp(x * SampleConversion::FLOAT_TO_INT32, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT));
+    }
+    static Sample mul(Sample x, Gain g) { return x * g; }
+    static Sample add(Sample a, Sample b) { return a + b; }
+    static Sample sub(Sample a, Sample b) { return a - b; }
+};
+
+struct Float64Engine
+{
+    using Sample = double;
+    using Gain = double;
+    static constexpr const char *NAME = "float64";
+
+    static constexpr Sample fromFloat(float x) { return x; }
+    static constexpr float toFloat(Sample x) { return static_cast<float>(x); }
+    static constexpr Gain gain(float g) { return g; }
+    static Sample fromInt32(int32_t x) { return static_cast<double>(x) * (1.0 / 2147483648.0); }
+    static int32_t toInt32(Sample x)
+    {
+        return static_cast<int32_t>(std::clamp(x * 2147483648.0, -2147483648.0, 2147483647.0));
+    }
+    static Sample mul(Sample x, Gain g) { return x * g; }
+    static Sample add(Sample a, Sample b) { return a + b; }
+    static Sample sub(Sample a, Sample b) { return a - b; }
+};
+
+struct Q31Engine
+{
+    using Sample = int32_t;
+    using Gain = int32_t;
+    static constexpr const char *NAME = "q31";
+
+    static constexpr int32_t saturate(int64_t x)
+    {
+        return static_cast<int32_t>(std::clamp<int64_t>(x, std::numeric_limits<int32_t>::min(), std::numeric_limits<int32_t>::max()));
+    }
+
+    static constexpr Sample fromFloat(float x)
+    {
+        return saturate(static_cast<int64_t>(static_cast<double>(x) * 2147483648.0));
+    }
+    static constexpr float toFloat(Sample x) { return static_cast<float>(x) * SampleConversion::INT32_TO_FLOAT; }
+    static constexpr Gain gain(float g) { return fromFloat(g); }
+    static constexpr Sample fromInt32(int32_t x) { return x; }
+    static constexpr int32_t toInt32(Sample x) { return x; }
+
+    // Rounded Q31 product, (x * g + 2^30) >> 31
+    static Sample mul(Sample x, Gain g)
+    {
+#if defined(__aarch64__)
+        return vqrdmulhs_s32(x, g);
+#else
+        return saturate((static_cast<int64_t>(x) * g + (int64_t(1) << 30)) >> 31);
+#endif
+    }
+
+    static Sample add(Sample a, Sample b)
+    {
+#if defined(__aarch64__)
+        return vqadds_s32(a, b);
+#elif defined(__ARM_FEATURE_DSP)
+        return __qadd(a, b);
+#else
+        return saturate(static_cast<int64_t>(a) + b);
+#endif
+    }
+
+    static Sample sub(Sample a, Sample b)
+    {
+#if defined(__aarch64__)
+        return vqsubs_s32(a, b);
+#elif defined(__ARM_FEATURE_DSP)
+        return __qsub(a, b);
+#else
+        return saturate(static_cast<int64_t>(a) - b);
+#endif
+    }
+};
+
+// Engine used by the reverb and delay, chosen per deployment at build time
+// (make DSP_ENGINE=float64 or DSP_ENGINE=q31)
+#if defined(AUDIO_DSP_Q31)
+using DspEngine = Q31Engine;
+#elif defined(AUDIO_DSP_FLOAT64)
+using DspEngine = Float64Engine;
+#else
+using DspEngine = Float32Engine;
+#endif
+
+// All-pass filter for reverb
+template <typename Engine>
+class AllPassFilterT
+{
 private:
-    // Stereo comb filters (different delays for L/R)
-    static constexpr int NUM_COMBS = 4;
-    std::array<std::unique_ptr<CombFilter>, NUM_COMBS> m_combFiltersL;
-    std::array<std::unique_ptr<CombFilter>, NUM_COMBS> m_combFiltersR;
+    using Sample = typename Engine::Sample;
+    using Gain = typename Engine::Gain;
 
-    // Stereo all-pass filters
-    static constexpr int NUM_ALLPASS = 3;
-    std::array<std::unique_ptr<AllPassFilter>, NUM_ALLPASS> m_allPassFiltersL;
-    std::array<std::unique_ptr<AllPassFilter>, NUM_ALLPASS> m_allPassFiltersR;
+    std::vector<Sample> m_buffer;
+    size_t m_bufferSize;
+    size_t m_writeIndex;
+    Gain m_gain;
 
-    // Early reflections
-    std::unique_ptr<EarlyReflections> m_earlyReflectionsL;
-    std::unique_ptr<EarlyReflections> m_earlyReflectionsR;
+public:
+    AllPassFilterT(size_t delayInSamples, float gain = 0.7f)
+        : m_bufferSize(delayInSamples), m_writeIndex(0), m_gain(Engine::gain(gain))
+    {
+        m_buffer.resize(m_bufferSize, Sample{});
+    }
 
-    // Parameters
-    size_t m_sampleRate;
-    size_t m_channels;
-    float m_roomSize;
-    float m_decay;
+    Sample process(Sample input)
+    {
+        size_t readIndex = m_writeIndex;
+        Sample delayed = m_buffer[readIndex];
+
+        // All-pass filter equation: y[n] = -g*x[n] + x[n-d] + g*y[n-d]
+        Sample output = Engine::sub(delayed, Engine::mul(input, m_gain));
+        m_buffer[m_writeIndex] = Engine::add(input, Engine::mul(delayed, m_gain));
+
+        if (++m_writeIndex == m_bufferSize)
+            m_writeIndex = 0;
+        return output;
+    }
+
+    void clear()
+    {
+        std::fill(m_buffer.begin(), m_buffer.end(), Sample{});
+        m_writeIndex = 0;
+    }
+
+    void saveState(EffectStateWriter &out) const
+    {
+        out.writeArray(m_buffer);
+        out.write(m_writeIndex);
+    }
+
+    bool restoreState(EffectStateReader &in)
+    {
+        return in.readArray(m_buffer.data(), m_bufferSize) && in.read(m_writeIndex) && m_writeIndex < m_bufferSize;
+    }
+
+    void setGain(float gain) { m_gain = Engine::gain(std::clamp(gain, -0.99f, 0.99f)); }
+};
+
+// Comb filter (feedback delay line) for reverb
+template <typename Engine>
+class CombFilterT
+{
+private:
+    using Sample = typename Engine::Sample;
+    using Gain = typename Engine::Gain;
+
+    std::vector<Sample> m_buffer;
+    size_t m_bufferSize;
+    size_t m_writeIndex;
+    Gain m_feedback;
+    Gain m_damping;
+    Gain m_undamped; // 1 - damping
+    Sample m_filterState;
+
+public:
+    CombFilterT(size_t delayInSamples, float feedback = 0.84f, float damping = 0.2f)
+        : m_bufferSize(delayInSamples), m_writeIndex(0),
+          m_feedback(Engine::gain(feedback)), m_filterState{}
+    {
+        m_buffer.resize(m_bufferSize, Sample{});
+        setDamping(damping);
+    }
+
+    Sample process(Sample input)
+    {
+        size_t readIndex = m_writeIndex;
+        Sample delayed = m_buffer[readIndex];
+
+        // One-pole lowpass filter for damping
+        m_filterState = Engine::add(Engine::mul(delayed, m_undamped), Engine::mul(m_filterState, m_damping));
+
+        m_buffer[m_writeIndex] = Engine::add(input, Engine::mul(m_filterState, m_feedback));
+        if (++m_writeIndex == m_bufferSize)
+            m_writeIndex = 0;
+
+        return delayed;
+    }
+
+    void clear()
+    {
+        std::fill(m_buffer.begin(), m_buffer.end(), Sample{});
+        m_writeIndex = 0;
+        m_filterState = Sample{};
+    }
+
+    void saveState(EffectStateWriter &out) const
+    {
+        out.writeArray(m_buffer);
+        out.write(m_writeIndex);
+        out.write(m_filterState);
+    }
+
+    bool restoreState(EffectStateReader &in)
+    {
+        return in.readArray(m_buffer.data(), m_bufferSize) && in.read(m_writeIndex) &&
+               in.read(m_filterState) && m_writeIndex < m_bufferSize;
+    }
+
+    void setFeedback(float feedback) { m_feedback = Engine::gain(std::clamp(feedback, 0.0f, 0.99f)); }
+    void setDamping(float damping)
+    {
+        damping = std::clamp(damping, 0.0f, 1.0f);
+        m_damping = Engine::gain(damping);
+        m_undamped = Engine::gain(1.0f - damping);
+    }
+};
+
+// Early reflections generator. One delay line is shared by every output and
+// each output reads it through its own tap set, so stereo (or N-way) early
+// reflections of a common input write the input once. Taps are evaluated per
+// block as contiguous multiply-adds over the line, split only where a
+// segment wraps, leaving no per-tap index arithmetic in the inner loop.
+template <typename Engine>
+class EarlyReflectionsT
+{
+public:
+    static constexpr size_t NUM_TAPS = ReverbTuning::NUM_EARLY_TAPS;
+    static constexpr size_t MAX_BLOCK = 256; // Frames evaluated per pass
+    using Sample = typename Engine::Sample;
+    using Gain = typename Engine::Gain;
+    using TapDelays = std::array<size_t, NUM_TAPS>;
+
+private:
+    struct Tap
+    {
+        size_t delay;
+        Gain gain; // Includes the 1/8 output scale, keeping Q31 gains below 1
+    };
+    using TapSet = std::array<Tap, NUM_TAPS>;
+
+    // The line holds MAX_BLOCK frames beyond the longest tap, so writing a
+    // whole block before reading never overwrites a sample still needed
+    std::vector<Sample> m_buffer;
+    size_t m_maxDelay;
+    size_t m_bufferSize;
+    size_t m_writeIndex;
+    std::vector<TapSet> m_tapSets;
+
+public:
+    EarlyReflectionsT(size_t sampleRate, size_t outputs = 1)
+    {
+        // Longest early reflection delay (50ms)
+        m_maxDelay = static_cast<size_t>(sampleRate * ReverbTuning::EARLY_MAX_SECONDS) - 1;
+        m_bufferSize = m_maxDelay + MAX_BLOCK;
+        m_buffer.resize(m_bufferSize, Sample{});
+        m_writeIndex = 0;
+        m_tapSets.resize(std::max<size_t>(outputs, 1));
+    }
+
+    size_t getOutputCount() const { return m_tapSets.size(); }
+
+    void setupTaps(size_t output, size_t sampleRate, float roomSize)
+    {
+        setupTaps(output, ReverbTuning::makeEarlyTaps(roomSize, sampleRate), roomSize);
+    }
+
+    // Taps from a precomputed table (ReverbTuning::Topology::earlyL/earlyR)
+    void setupTaps(size_t output, const TapDelays &delays, float roomSize)
+    {
+        // Early reflection patterns based on room size, scaled down by 1/8
+        // for 8 taps
+        TapSet &taps = m_tapSets[output];
+        for (size_t i = 0; i < NUM_TAPS; ++i)
+        {
+            taps[i] = {std::min(delays[i], m_maxDelay), Engine::gain(ReverbTuning::EARLY_TAP_GAINS[i] * roomSize * 0.125f)};
+        }
+    }
+
+    // Runs frames samples of input through the first numOutputs tap sets;
+    // outputs[o] receives tap set o. Outputs beyond numOutputs keep reading
+    // the shared line correctly if they are enabled later.
+    void process(const Sample *input, Sample *const *outputs, size_t numOutputs, size_t frames)
+    {
+        numOutputs = std::min(numOutputs, m_tapSets.size());
+        for (size_t start = 0; start < frames; start += MAX_BLOCK)
+        {
+            const size_t count = std::min(MAX_BLOCK, frames - start);
+            processBlock(input + start, outputs, numOutputs, start, count);
+        }
+    }
+
+    void clear()
+    {
+        std::fill(m_buffer.begin(), m_buffer.end(), Sample{});
+        m_writeIndex = 0;
+    }
+
+    // The line only; taps follow from the room parameters
+    void saveState(EffectStateWriter &out) const
+    {
+        out.writeArray(m_buffer);
+        out.write(m_writeIndex);
+    }
+
+    bool restoreState(EffectStateReader &in)
+    {
+        return in.readArray(m_buffer.data(), m_bufferSize) && in.read(m_writeIndex) && m_writeIndex < m_bufferSize;
+    }
+
+private:
+    void processBlock(const Sample *input, Sample *const *outputs, size_t numOutputs,
+                      size_t offset, size_t count)
+    {
+        // Write the block, split at the end of the line
+        const size_t head = std::min(count, m_bufferSize - m_writeIndex);
+        std::copy(input, input + head, m_buffer.begin() + m_writeIndex);
+        std::copy(input + head, input + count, m_buffer.begin());
+
+        const Sample *line = m_buffer.data();
+        for (size_t o = 0; o < numOutputs; ++o)
+        {
+            Sample *out = outputs[o] + offset;
+            std::fill(out, out + count, Sample{});
+            for (const Tap &tap : m_tapSets[o])
+            {
+                // Frame i of the block reads line[writeIndex + i - delay]
+                size_t read = (m_writeIndex >= tap.delay) ? m_writeIndex - tap.delay
+                                                          : m_writeIndex + m_bufferSize - tap.delay;
+                const Gain gain = tap.gain;
+                for (size_t done = 0; done < count; read = 0)
+                {
+                    const size_t run = std::min(count - done, m_bufferSize - read);
+                    const Sample *src = line + read;
+                    Sample *dst = out + done;
+                    for (size_t i = 0; i < run; ++i)
+                    {
+                        dst[i] = Engine::add(dst[i], Engine::mul(src[i], gain));
+                    }
+                    done += run;
+                }
+            }
+        }
+
+        m_writeIndex += count;
+        if (m_writeIndex >= m_bufferSize)
+            m_writeIndex -= m_bufferSize;
+    }
+};
+
+using AllPassFilter = AllPassFilterT<DspEngine>;
+using CombFilter = CombFilterT<DspEngine>;
+using EarlyReflections = EarlyReflectionsT<DspEngine>;
+
+// Eight-line feedback delay network used as the shared late tail of the
+// true-stereo / multichannel reverb. Lines are mixed by a normalized
+// Hadamard matrix, which is lossless, so decay is set by the per-line gains
+// alone. Everything runs on planar blocks: line reads are contiguous, the
+// Hadamard transform is vectorized across samples, and only the one-pole
+// damping recursion is scalar.
+class FeedbackDelayNetwork
+{
+public:
+    static constexpr size_t NUM_LINES = ReverbTuning::NUM_LATE_LINES;
+
+    // Sign of entry (row, column) of the 8x8 Sylvester-Hadamard matrix
+    static float hadamardSign(size_t row, size_t column)
+    {
+        return (__builtin_popcount(static_cast<unsigned int>(row & column)) & 1) ? -1.0f : 1.0f;
+    }
+
+private:
+    std::array<InterpolatedDelayLine, NUM_LINES> m_lines;
+    std::array<size_t, NUM_LINES> m_lengths;
+    std::array<float, NUM_LINES> m_gains;
+    std::array<float, NUM_LINES> m_dampState;
+    std::array<std::vector<float>, NUM_LINES> m_feedback;
     float m_damping;
-    float m_diffusion;
-    float m_earlyReflectionLevel;
-    RoomType m_roomType;
+    size_t m_referenceLength;
+
+public:
+    FeedbackDelayNetwork() : m_damping(0.2f), m_referenceLength(1)
+    {
+        m_lengths.fill(1);
+        m_gains.fill(0.0f);
+        m_dampState.fill(0.0f);
+    }
+
+    // lengths: line lengths in samples (ReverbTuning::Topology::lateLines)
+    void configure(const std::array<size_t, NUM_LINES> &lengths, size_t sampleRate, float roomSize,
+                   float decay, float damping)
+    {
+        for (size_t j = 0; j < NUM_LINES; ++j)
+        {
+            m_lengths[j] = std::max<size_t>(2, lengths[j]);
+            m_lines[j].setMaxDelay(m_lengths[j]);
+        }
+
+        // Decay is specified per average comb length of the classic path
+        m_referenceLength = std::max<size_t>(1, static_cast<size_t>(roomSize * sampleRate * 0.03f * 1.2f));
+        setDecay(decay);
+        setDamping(damping);
+        clear();
+    }
+
+    void setDecay(float decay)
+    {
+        // Equal decay rate per second on every line, Hadamard scale folded in
+        const float normalize = 1.0f / std::sqrt(static_cast<float>(NUM_LINES));
+        for (size_t j = 0; j < NUM_LINES; ++j)
+        {
+            const float exponent = static_cast<float>(m_lengths[j]) / static_cast<float>(m_referenceLength);
+            m_gains[j] = std::pow(decay, exponent) * normalize;
+        }
+    }
+
+    void setDamping(float damping) { m_damping = std::clamp(damping, 0.0f, 1.0f); }
+
+    void clear()
+    {
+        for (auto &line : m_lines)
+        {
+            line.clear();
+        }
+        m_dampState.fill(0.0f);
+    }
+
+    void saveState(EffectStateWriter &out) const
+    {
+        for (const auto &line : m_lines)
+        {
+            line.saveState(out);
+        }
+        out.write(m_dampState);
+    }
+
+    bool restoreState(EffectStateReader &in)
+    {
+        for (auto &line : m_lines)
+        {
+            if (!line.restoreState(in))
+                return false;
+        }
+        return in.read(m_dampState);
+    }
+
+    // Largest block that can run without reading samples it writes itself
+    size_t getMaxChunk() const
+    {
+        return *std::min_element(m_lengths.begin(), m_lengths.end());
+    }
+
+    // inputs[j]: signal injected into line j; outputs[j]: damped output of
+    // line j. count must not exceed getMaxChunk().
+    void process(const float *const *inputs, float *const *outputs, size_t count)
+    {
+        for (size_t j = 0; j < NUM_LINES; ++j)
+        {
+            float *out = outputs[j];
+            std::fill(out, out + count, 0.0f);
+            m_lines[j].mixDelayed(m_lengths[j], 1.0f, out, count);
+
+            // One-pole lowpass in the loop, as in CombFilter
+            float state = m_dampState[j];
+            for (size_t i = 0; i < count; ++i)
+            {
+                state = out[i] * (1.0f - m_damping) + state * m_damping;
+                out[i] = state;
+            }
+            m_dampState[j] = state;
+
+            auto &feedback = m_feedback[j];
+            if (feedback.size() < count)
+            {
+                feedback.resize(count);
+            }
+            const float gain = m_gains[j];
+            for (size_t i = 0; i < count; ++i)
+            {
+                feedback[i] = out[i] * gain;
+            }
+        }
+
+        // In-place fast Walsh-Hadamard transform across the lines
+        for (size_t half = 1; half < NUM_LINES; half <<= 1)
+        {
+            for (size_t j = 0; j < NUM_LINES; j += 2 * half)
+            {
+                for (size_t k = j; k < j + half; ++k)
+                {
+                    float *a = m_feedback[k].data();
+                    float *b = m_feedback[k + half].data();
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        const float sum = a[i] + b[i];
+                        b[i] = a[i] - b[i];
+                        a[i] = sum;
+                    }
+                }
+            }
+        }
+
+        for (size_t j = 0; j < NUM_LINES; ++j)
+        {
+            float *feedback = m_feedback[j].data();
+            const float *input = inputs[j];
+            for (size_t i = 0; i < count; ++i)
+            {
+                feedback[i] += input[i];
+            }
+            m_lines[j].write(feedback, count);
+        }
+    }
+};
+
+// Main reverb effect class
+class ReverbEffect : public AudioEffect
+{
+public:
+    enum RoomType
+    {
+        SMALL_ROOM,
+        MEDIUM_ROOM,
+        LARGE_HALL,
+        CATHEDRAL,
+        PLATE,
+        SPRING,
+        CUSTOM
+    };
+    static_assert(SPRING + 1 == ReverbTuning::PRESET_ROOM_SIZES.size(), "one tabulated room size per preset");
+
+private:
+    // Stereo comb filters (different delays for L/R)
+    static constexpr size_t NUM_COMBS = ReverbTuning::NUM_COMBS;
+    std::array<std::unique_ptr<CombFilter>, NUM_COMBS> m_combFiltersL;
+    std::array<std::unique_ptr<CombFilter>, NUM_COMBS> m_combFiltersR;
+
+    // Stereo all-pass filters
+    static constexpr size_t NUM_ALLPASS = ReverbTuning::NUM_ALLPASS;
+    std::array<std::unique_ptr<AllPassFilter>, NUM_ALLPASS> m_allPassFiltersL;
+    std::array<std::unique_ptr<AllPassFilter>, NUM_ALLPASS> m_allPassFiltersR;
+
+    // Early reflections of the classic path: one line, L and R tap sets
+    std::unique_ptr<EarlyReflections> m_earlyReflections;
+
+    // True-stereo / multichannel path: each input keeps its own early
+    // reflections and diffusion, then all inputs share one FDN late tail
+    static constexpr int NUM_INPUT_DIFFUSERS = 2;
+    std::vector<std::unique_ptr<EarlyReflections>> m_channelEarlyReflections;
+    std::vector<std::unique_ptr<AllPassFilter>> m_inputDiffusers; // [channel * NUM_INPUT_DIFFUSERS + stage]
+    FeedbackDelayNetwork m_lateTail;
+    bool m_trueStereo;
+
+    // Block scratch for the early reflections (not preset state)
+    static constexpr size_t EARLY_BLOCK = EarlyReflections::MAX_BLOCK;
+    std::array<DspEngine::Sample, EARLY_BLOCK> m_earlyInput{};
+    std::array<std::array<DspEngine::Sample, EARLY_BLOCK>, 2> m_earlyOutput{};
+
+    // Planar scratch for the multichannel path
+    std::vector<std::vector<float>> m_channelInput;
+    std::vector<std::vector<float>> m_channelWet;
+    std::vector<float> m_diffused;
+    std::array<std::vector<float>, FeedbackDelayNetwork::NUM_LINES> m_tailInput;
+    std::array<std::vector<float>, FeedbackDelayNetwork::NUM_LINES> m_tailOutput;
+    size_t m_maxFrames;
+
+    // Parameters
+    size_t m_sampleRate;
+    const size_t m_channels; // Read by the preparer thread
+    float m_roomSize;
+    float m_decay;
+    float m_damping;
+    float m_diffusion;
+    float m_earlyReflectionLevel;
+    float m_mix;
+    RoomType m_roomType;
+
+    // Preset switching. setRoomType() only posts the request; the preparer
+    // thread builds the new preset into the standby instance, the audio
+    // thread runs both instances through an equal-power crossfade and swaps
+    // their state, and the preparer then clears the retired state for reuse.
+    // Filters are only ever built or freed off the audio thread. The preparer
+    // sleeps on a condition variable until setRoomType() posts a request; it
+    // only checks back on a timer while a request waits behind a fade, since
+    // the audio thread cannot signal it. The standby and the preparer are
+    // only created by the first setRoomType(); a reverb that never changes
+    // room costs no thread.
+    enum SwitchState
+    {
+        SWITCH_IDLE,    // Standby free, owned by the preparer
+        SWITCH_READY,   // Standby holds the next preset
+        SWITCH_FADING,  // Both instances running, owned by the audio thread
+        SWITCH_RETIRED, // Standby holds the previous preset, cleared before the next switch
+    };
+    static constexpr float CROSSFADE_MS = 50.0f;
+    static constexpr size_t FADE_RESERVE_FRAMES = 1024;
+    static constexpr auto PREPARER_RETRY = std::chrono::milliseconds(5);
+
+    std::unique_ptr<ReverbEffect> m_standby; // Null inside the standby itself
+    std::thread m_preparer;
+    std::mutex m_preparerMutex;
+    std::condition_variable m_preparerWake;
+    bool m_preparerRunning = false; // Guarded by m_preparerMutex
+    std::atomic<int> m_requestedRoom{-1};
+    bool m_requestedTrueStereo = false; // Guarded by m_preparerMutex, taken with the request
+    std::atomic<int> m_switchState{SWITCH_IDLE};
+    size_t m_reserveFrames = FADE_RESERVE_FRAMES; // Standby scratch, raised by prepare()
+    size_t m_fadeLength = 0;
+    size_t m_fadePosition = 0;
+    std::vector<float> m_fadeCurve;       // cos(pi/2 * i / m_fadeLength), i = 0..m_fadeLength
+    std::vector<int32_t> m_fadeInput;     // Input copy, outputs may alias it
+    std::vector<int32_t> m_standbyOutput;
+
+    struct StandbyTag
+    {
+    };
+
+    ReverbEffect(size_t sampleRate, size_t channels, RoomType roomType, StandbyTag)
+        : m_trueStereo(false), m_maxFrames(0), m_sampleRate(sampleRate), m_channels(channels),
+          m_roomType(roomType)
+    {
+        initializeParameters();
+        createFilters();
+    }
+
+    // Convert int32_t to float for processing
+    static constexpr float INT32_TO_FLOAT = 1.0f / 2147483648.0f;
+    static constexpr float FLOAT_TO_INT32 = 2147483648.0f;
+
+    inline float int32ToFloat(int32_t sample) const
+    {
+        return static_cast<float>(sample) * INT32_TO_FLOAT;
+    }
+
+    inline int32_t floatToInt32(float sample) const
+    {
+        sample = std::clamp(sample, -1.0f, 1.0f);
+        return static_cast<int32_t>(sample * FLOAT_TO_INT32);
+    }
+
+public:
+    // The filters are built here rather than deferred like the delay line:
+    // both instances together take at most about 1 MB (CATHEDRAL) and a
+    // fraction of a millisecond to build, and the preparer thread rebuilds
+    // and swaps them on every preset switch, which deferred state would
+    // have to coordinate with
+    ReverbEffect(size_t sampleRate, size_t channels, RoomType roomType = MEDIUM_ROOM)
+        : m_trueStereo(false), m_maxFrames(0), m_sampleRate(sampleRate), m_channels(channels),
+          m_roomType(roomType)
+    {
+
+        initializeParameters();
+        createFilters();
+
+        // The equal-power gains, read forwards for the old preset and
+        // backwards for the new one
+        m_fadeLength = std::max<size_t>(1, static_cast<size_t>(CROSSFADE_MS * 0.001f * m_sampleRate));
+        m_fadeCurve.resize(m_fadeLength + 1);
+        for (size_t i = 0; i <= m_fadeLength; ++i)
+        {
+            m_fadeCurve[i] = std::cos(0.5f * static_cast<float>(M_PI) * static_cast<float>(i) / m_fadeLength);
+        }
+        m_fadeInput.resize(FADE_RESERVE_FRAMES * channels);
+        m_standbyOutput.resize(FADE_RESERVE_FRAMES * channels);
+    }
+
+    ~ReverbEffect() override
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_preparerMutex);
+            m_preparerRunning = false;
+        }
+        m_preparerWake.notify_one();
+        if (m_preparer.joinable())
+        {
+            m_preparer.join();
+        }
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        if (channels != m_channels)
+        {
+            return;
+        }
+        if (m_fadeInput.size() < maxFrames * channels)
+        {
+            m_fadeInput.resize(maxFrames * channels);
+            m_standbyOutput.resize(maxFrames * channels);
+        }
+        if (m_trueStereo || channels > 2)
+        {
+            ensureMultichannelBuffers(maxFrames, channels);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_preparerMutex);
+            m_reserveFrames = std::max(m_reserveFrames, maxFrames);
+        }
+        if (m_standby)
+        {
+            m_standby->prepare(maxFrames, channels);
+        }
+    }
+
+    // A pending or running preset switch still needs process() calls
+    bool isBypassed(unsigned int channels) const override
+    {
+        const int state = m_switchState.load(std::memory_order_acquire);
+        return (!m_enabled || channels != m_channels) && state != SWITCH_READY && state != SWITCH_FADING;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numFrames, unsigned int channels) override
+    {
+        // The standby's own state stays SWITCH_IDLE
+        const int state = m_switchState.load(std::memory_order_acquire);
+        if (state == SWITCH_READY)
+        {
+            if (!m_enabled || channels != m_channels)
+            {
+                // Nothing audible to fade: switch at once
+                swapState(*m_standby);
+                m_switchState.store(SWITCH_RETIRED, std::memory_order_release);
+            }
+            else
+            {
+                m_fadePosition = 0;
+                m_switchState.store(SWITCH_FADING, std::memory_order_relaxed);
+                processCrossfade(inputBuffer, outputBuffer, numFrames, channels);
+                return;
+            }
+        }
+        else if (state == SWITCH_FADING)
+        {
+            processCrossfade(inputBuffer, outputBuffer, numFrames, channels);
+            return;
+        }
+
+        processPreset(inputBuffer, outputBuffer, numFrames, channels);
+    }
+
+private:
+    // The current preset on its own
+    void processPreset(const int32_t *inputBuffer, int32_t *outputBuffer,
+                       size_t numFrames, unsigned int channels)
+    {
+        if (inputBuffer != outputBuffer)
+        {
+            std::memcpy(outputBuffer, inputBuffer, numFrames * channels * sizeof(int32_t));
+        }
+
+        if (!m_enabled || channels != m_channels)
+        {
+            return;
+        }
+
+        int32_t *samples = outputBuffer;
+
+        if (m_trueStereo || channels > 2)
+        {
+            processMultichannel(samples, numFrames, channels);
+            return;
+        }
+
+        // Mono or stereo, chosen once per block
+        if (channels == 1)
+        {
+            processClassic<1>(samples, numFrames);
+        }
+        else
+        {
+            processClassic<2>(samples, numFrames);
+        }
+    }
+
+    template <unsigned int CH>
+    void processClassic(int32_t *samples, size_t numFrames)
+    {
+        static_assert(CH == 1 || CH == 2, "classic path is mono or stereo");
+        const float mix = m_mix;
+        const Gain earlyLevel = DspEngine::gain(m_earlyReflectionLevel);
+        Sample *const earlyOutputs[2] = {m_earlyOutput[0].data(), m_earlyOutput[1].data()};
+
+        for (size_t start = 0; start < numFrames; start += EARLY_BLOCK)
+        {
+            const size_t count = std::min(EARLY_BLOCK, numFrames - start);
+            int32_t *block = samples + start * CH;
+
+            // Reverb input for the block (stereo is summed to mono), then
+            // its early reflections in one pass
+            for (size_t frame = 0; frame < count; ++frame)
+            {
+                if constexpr (CH == 1)
+                {
+                    m_earlyInput[frame] = DspEngine::fromFloat(int32ToFloat(block[frame]));
+                }
+                else
+                {
+                    m_earlyInput[frame] = DspEngine::fromFloat((int32ToFloat(block[frame * 2]) + int32ToFloat(block[frame * 2 + 1])) * 0.5f);
+                }
+            }
+            m_earlyReflections->process(m_earlyInput.data(), earlyOutputs, CH, count);
+
+            for (size_t frame = 0; frame < count; ++frame)
+            {
+                if constexpr (CH == 1)
+                {
+                    // Mono processing
+                    float input = int32ToFloat(block[frame]);
+                    float output = processMono(m_earlyInput[frame], m_earlyOutput[0][frame], earlyLevel);
+                    float mixed = input * (1.0f - mix) + output * mix;
+                    block[frame] = floatToInt32(mixed);
+                }
+                else
+                {
+                    // Stereo processing
+                    float inputL = int32ToFloat(block[frame * 2]);
+                    float inputR = int32ToFloat(block[frame * 2 + 1]);
+
+                    auto [outputL, outputR] = processStereo(m_earlyInput[frame], m_earlyOutput[0][frame],
+                                                            m_earlyOutput[1][frame], earlyLevel);
+
+                    float mixedL = inputL * (1.0f - mix) + outputL * mix;
+                    float mixedR = inputR * (1.0f - mix) + outputR * mix;
+
+                    block[frame * 2] = floatToInt32(mixedL);
+                    block[frame * 2 + 1] = floatToInt32(mixedR);
+                }
+            }
+        }
+    }
+
+    // Both presets on the same input. Each output is dry * (1 - mix) plus its
+    // wet part, so the wet parts are recovered by subtracting the dry share
+    // and faded with the m_fadeCurve gains, while the dry gain moves
+    // linearly between the two presets' dry levels.
+    void processCrossfade(const int32_t *inputBuffer, int32_t *outputBuffer,
+                          size_t numFrames, unsigned int channels)
+    {
+        const size_t totalSamples = numFrames * channels;
+        if (m_fadeInput.size() < totalSamples)
+        {
+            m_fadeInput.resize(totalSamples);
+            m_standbyOutput.resize(totalSamples);
+        }
+        std::copy(inputBuffer, inputBuffer + totalSamples, m_fadeInput.begin());
+
+        processPreset(m_fadeInput.data(), outputBuffer, numFrames, channels);
+        m_standby->processPreset(m_fadeInput.data(), m_standbyOutput.data(), numFrames, channels);
+
+        const float oldDry = 1.0f - m_mix;
+        const float newDry = 1.0f - m_standby->m_mix;
+        for (size_t frame = 0; frame < numFrames; ++frame)
+        {
+            const size_t position = std::min(m_fadePosition + frame, m_fadeLength);
+            const float t = static_cast<float>(position) / m_fadeLength;
+            const float oldGain = m_fadeCurve[position];
+            const float newGain = m_fadeCurve[m_fadeLength - position];
+            const float dryGain = oldDry + (newDry - oldDry) * t;
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                const size_t n = frame * channels + ch;
+                const float dry = int32ToFloat(m_fadeInput[n]);
+                const float oldWet = int32ToFloat(outputBuffer[n]) - oldDry * dry;
+                const float newWet = int32ToFloat(m_standbyOutput[n]) - newDry * dry;
+                outputBuffer[n] = floatToInt32(dryGain * dry + oldGain * oldWet + newGain * newWet);
+            }
+        }
+
+        m_fadePosition += numFrames;
+        if (m_fadePosition >= m_fadeLength)
+        {
+            swapState(*m_standby);
+            m_switchState.store(SWITCH_RETIRED, std::memory_order_release);
+        }
+    }
+
+    // Exchanges every preset-dependent member; moves only, no allocation
+    void swapFilters(ReverbEffect &other)
+    {
+        std::swap(m_combFiltersL, other.m_combFiltersL);
+        std::swap(m_combFiltersR, other.m_combFiltersR);
+        std::swap(m_allPassFiltersL, other.m_allPassFiltersL);
+        std::swap(m_allPassFiltersR, other.m_allPassFiltersR);
+        std::swap(m_earlyReflections, other.m_earlyReflections);
+        std::swap(m_channelEarlyReflections, other.m_channelEarlyReflections);
+        std::swap(m_inputDiffusers, other.m_inputDiffusers);
+        std::swap(m_lateTail, other.m_lateTail);
+    }
+
+    void swapState(ReverbEffect &other)
+    {
+        swapFilters(other);
+        std::swap(m_trueStereo, other.m_trueStereo);
+        std::swap(m_channelInput, other.m_channelInput);
+        std::swap(m_channelWet, other.m_channelWet);
+        std::swap(m_diffused, other.m_diffused);
+        std::swap(m_tailInput, other.m_tailInput);
+        std::swap(m_tailOutput, other.m_tailOutput);
+        std::swap(m_maxFrames, other.m_maxFrames);
+        std::swap(m_roomSize, other.m_roomSize);
+        std::swap(m_decay, other.m_decay);
+        std::swap(m_damping, other.m_damping);
+        std::swap(m_diffusion, other.m_diffusion);
+        std::swap(m_earlyReflectionLevel, other.m_earlyReflectionLevel);
+        std::swap(m_mix, other.m_mix);
+        std::swap(m_roomType, other.m_roomType);
+    }
+
+    void preparerLoop()
+    {
+        std::unique_lock<std::mutex> lock(m_preparerMutex);
+        while (m_preparerRunning)
+        {
+            if (m_requestedRoom.load() < 0)
+            {
+                m_preparerWake.wait(lock);
+                continue;
+            }
+
+            const int state = m_switchState.load(std::memory_order_acquire);
+            if (state == SWITCH_RETIRED)
+            {
+                m_standby->reset();
+                m_switchState.store(SWITCH_IDLE, std::memory_order_release);
+                continue;
+            }
+            if (state != SWITCH_IDLE)
+            {
+                // The previous switch is still fading
+                m_preparerWake.wait_for(lock, PREPARER_RETRY);
+                continue;
+            }
+
+            const int room = m_requestedRoom.exchange(-1);
+            if (room < 0)
+            {
+                continue;
+            }
+
+            const size_t reserveFrames = m_reserveFrames;
+            const bool trueStereo = m_requestedTrueStereo;
+            lock.unlock();
+            ReverbEffect &standby = *m_standby;
+            standby.m_roomType = static_cast<RoomType>(room);
+            standby.m_trueStereo = trueStereo;
+            standby.initializeParameters();
+            standby.createFilters();
+            if (trueStereo || m_channels > 2)
+            {
+                standby.ensureMultichannelBuffers(reserveFrames, static_cast<unsigned int>(m_channels));
+            }
+            m_switchState.store(SWITCH_READY, std::memory_order_release);
+            lock.lock();
+        }
+    }
+
+public:
+    void reset() override
+    {
+        for (auto &comb : m_combFiltersL)
+        {
+            if (comb)
+                comb->clear();
+        }
+        for (auto &comb : m_combFiltersR)
+        {
+            if (comb)
+                comb->clear();
+        }
+        for (auto &allpass : m_allPassFiltersL)
+        {
+            if (allpass)
+                allpass->clear();
+        }
+        for (auto &allpass : m_allPassFiltersR)
+        {
+            if (allpass)
+                allpass->clear();
+        }
+        if (m_earlyReflections)
+            m_earlyReflections->clear();
+        for (auto &early : m_channelEarlyReflections)
+        {
+            early->clear();
+        }
+        for (auto &allpass : m_inputDiffusers)
+        {
+            allpass->clear();
+        }
+        m_lateTail.clear();
+    }
+
+    // The current preset's parameters and every filter line; a preset
+    // switch still in flight is not kept. A snapshot of another room
+    // rebuilds the filters before their lines are read back.
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(static_cast<uint64_t>(m_sampleRate));
+        out.write(static_cast<uint64_t>(m_channels));
+        out.write(static_cast<int32_t>(m_roomType));
+        out.write(m_roomSize);
+        out.write(m_decay);
+        out.write(m_damping);
+        out.write(m_diffusion);
+        out.write(m_earlyReflectionLevel);
+        out.write(m_mix);
+        out.write(m_trueStereo);
+
+        for (const auto *filters : {&m_combFiltersL, &m_combFiltersR})
+        {
+            for (const auto &comb : *filters)
+                comb->saveState(out);
+        }
+        for (const auto *filters : {&m_allPassFiltersL, &m_allPassFiltersR})
+        {
+            for (const auto &allpass : *filters)
+                allpass->saveState(out);
+        }
+        m_earlyReflections->saveState(out);
+        for (const auto &early : m_channelEarlyReflections)
+        {
+            early->saveState(out);
+        }
+        for (const auto &allpass : m_inputDiffusers)
+        {
+            allpass->saveState(out);
+        }
+        m_lateTail.saveState(out);
+    }
+
+    // Parameters are committed only once every line has read. Lines of
+    // another room go into filters built for it on the side, which replace
+    // the current ones at the end.
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        uint64_t sampleRate = 0;
+        uint64_t channels = 0;
+        int32_t roomType = 0;
+        float roomSize = 0.0f;
+        float decay = 0.0f;
+        float damping = 0.0f;
+        float diffusion = 0.0f;
+        float earlyReflectionLevel = 0.0f;
+        float mix = 0.0f;
+        bool trueStereo = false;
+        if (!in.read(enabled) || !in.read(sampleRate) || !in.read(channels) || !in.read(roomType) ||
+            !in.read(roomSize) || !in.read(decay) || !in.read(damping) || !in.read(diffusion) ||
+            !in.read(earlyReflectionLevel) || !in.read(mix) || !in.read(trueStereo))
+            return false;
+        if (sampleRate != m_sampleRate || channels != m_channels || roomType < SMALL_ROOM || roomType > CUSTOM)
+            return false;
+        // Values the setters would not produce are rejected rather than
+        // clamped: the room size sets the line lengths, and a decay of 1 or
+        // more would make the combs unstable
+        auto inRange = [](float value, float low, float high)
+        { return value >= low && value <= high; };
+        if (!inRange(roomSize, 0.1f, 3.0f) || !inRange(decay, 0.1f, MAX_DECAY) || !inRange(damping, 0.0f, 1.0f) ||
+            !inRange(diffusion, 0.0f, 1.0f) || !inRange(earlyReflectionLevel, 0.0f, 1.0f) || !inRange(mix, 0.0f, 1.0f))
+            return false;
+
+        if (roomType != m_roomType || roomSize != m_roomSize)
+        {
+            ReverbEffect staged(m_sampleRate, m_channels, SMALL_ROOM, StandbyTag{});
+            staged.m_roomType = static_cast<RoomType>(roomType);
+            staged.m_roomSize = roomSize;
+            staged.m_decay = decay;
+            staged.m_damping = damping;
+            staged.m_diffusion = diffusion;
+            staged.createFilters();
+            if (!staged.restoreLines(in))
+                return false;
+            swapFilters(staged);
+        }
+        else if (!restoreLines(in))
+        {
+            return false;
+        }
+
+        m_enabled = enabled;
+        m_roomType = static_cast<RoomType>(roomType);
+        m_roomSize = roomSize;
+        m_decay = decay;
+        m_damping = damping;
+        m_diffusion = diffusion;
+        m_earlyReflectionLevel = earlyReflectionLevel;
+        m_mix = mix;
+        m_trueStereo = trueStereo;
+        updateCombFeedback();
+        updateCombDamping();
+        updateAllPassGain();
+        return true;
+    }
+
+    // Stereo input is normally summed to mono before the tail. In true-stereo
+    // mode every input keeps its own path into a shared late tail; inputs
+    // with more than two channels always use it.
+    void setTrueStereo(bool enabled) { m_trueStereo = enabled; }
+    bool isTrueStereo() const { return m_trueStereo; }
+
+    // Room type presets. Switches crossfade over CROSSFADE_MS once the
+    // preparer has built the new preset; a request made while a switch is
+    // in flight replaces any earlier one that has not started yet.
+    void setRoomType(RoomType roomType)
+    {
+        if (!m_preparer.joinable())
+        {
+            // The preparer owns the standby from here on
+            m_standby.reset(new ReverbEffect(m_sampleRate, m_channels, m_roomType, StandbyTag{}));
+            m_preparerRunning = true;
+            m_preparer = std::thread(&ReverbEffect::preparerLoop, this);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_preparerMutex);
+            m_requestedRoom.store(roomType);
+            m_requestedTrueStereo = m_trueStereo;
+        }
+        m_preparerWake.notify_one();
+    }
+
+    RoomType getRoomType() const { return m_roomType; }
+
+    // Parameter controls
+    void setRoomSize(float size)
+    {
+        m_roomSize = std::clamp(size, 0.1f, 3.0f);
+        if (m_roomType == CUSTOM)
+        {
+            createFilters();
+        }
+    }
+
+    void setDecay(float decay)
+    {
+        m_decay = std::clamp(decay, 0.1f, MAX_DECAY);
+        updateCombFeedback();
+    }
+
+    void setDamping(float damping)
+    {
+        m_damping = std::clamp(damping, 0.0f, 1.0f);
+        updateCombDamping();
+    }
+
+    void setDiffusion(float diffusion)
+    {
+        m_diffusion = std::clamp(diffusion, 0.0f, 1.0f);
+        updateAllPassGain();
+    }
+
+    void setEarlyReflectionLevel(float level)
+    {
+        m_earlyReflectionLevel = std::clamp(level, 0.0f, 1.0f);
+    }
+
+    void setMix(float mix)
+    {
+        m_mix = std::clamp(mix, 0.0f, 1.0f);
+    }
+
+    // Getters
+    float getRoomSize() const { return m_roomSize; }
+    float getDecay() const { return m_decay; }
+    float getDamping() const { return m_damping; }
+    float getDiffusion() const { return m_diffusion; }
+    float getEarlyReflectionLevel() const { return m_earlyReflectionLevel; }
+    float getMix() const { return m_mix; }
+
+private:
+    // Every filter line, in the order saveState() writes them
+    bool restoreLines(EffectStateReader &in)
+    {
+        for (auto *filters : {&m_combFiltersL, &m_combFiltersR})
+        {
+            for (auto &comb : *filters)
+            {
+                if (!comb->restoreState(in))
+                    return false;
+            }
+        }
+        for (auto *filters : {&m_allPassFiltersL, &m_allPassFiltersR})
+        {
+            for (auto &allpass : *filters)
+            {
+                if (!allpass->restoreState(in))
+                    return false;
+            }
+        }
+        if (!m_earlyReflections->restoreState(in))
+            return false;
+        for (auto &early : m_channelEarlyReflections)
+        {
+            if (!early->restoreState(in))
+                return false;
+        }
+        for (auto &allpass : m_inputDiffusers)
+        {
+            if (!allpass->restoreState(in))
+                return false;
+        }
+        return m_lateTail.restoreState(in);
+    }
+
+    void initializeParameters()
+    {
+        switch (m_roomType)
+        {
+        case SMALL_ROOM:
+            m_roomSize = ReverbTuning::PRESET_ROOM_SIZES[SMALL_ROOM];
+            m_decay = 0.5f;
+            m_damping = 0.3f;
+            m_diffusion = 0.6f;
+            m_earlyReflectionLevel = 0.4f;
+            break;
+
+        case MEDIUM_ROOM:
+            m_roomSize = ReverbTuning::PRESET_ROOM_SIZES[MEDIUM_ROOM];
+            m_decay = 0.7f;
+            m_damping = 0.2f;
+            m_diffusion = 0.7f;
+            m_earlyReflectionLevel = 0.3f;
+            break;
+
+        case LARGE_HALL:
+            m_roomSize = ReverbTuning::PRESET_ROOM_SIZES[LARGE_HALL];
+            m_decay = 0.85f;
+            m_damping = 0.15f;
+            m_diffusion = 0.8f;
+            m_earlyReflectionLevel = 0.2f;
+            break;
+
+        case CATHEDRAL:
+            m_roomSize = ReverbTuning::PRESET_ROOM_SIZES[CATHEDRAL];
+            m_decay = 0.92f;
+            m_damping = 0.1f;
+            m_diffusion = 0.9f;
+            m_earlyReflectionLevel = 0.15f;
+            break;
+
+        case PLATE:
+            m_roomSize = ReverbTuning::PRESET_ROOM_SIZES[PLATE];
+            m_decay = 0.8f;
+            m_damping = 0.05f;
+            m_diffusion = 0.95f;
+            m_earlyReflectionLevel = 0.1f;
+            break;
+
+        case SPRING:
+            m_roomSize = ReverbTuning::PRESET_ROOM_SIZES[SPRING];
+            m_decay = 0.6f;
+            m_damping = 0.4f;
+            m_diffusion = 0.5f;
+            m_earlyReflectionLevel = 0.5f;
+            break;
+
+        case CUSTOM:
+            // Keep current values
+            break;
+        }
+
+        setMix(0.3f); // Default 30% wet
+    }
+
+    void createFilters()
+    {
+        // Prime delay lengths for this room size and rate (tabulated for presets)
+        const ReverbTuning::Topology topology = ReverbTuning::getTopology(m_roomType, m_roomSize, m_sampleRate);
+
+        // Create comb filters
+        for (size_t i = 0; i < NUM_COMBS; ++i)
+        {
+            m_combFiltersL[i] = std::make_unique<CombFilter>(topology.combL[i], m_decay, m_damping);
+            m_combFiltersR[i] = std::make_unique<CombFilter>(topology.combR[i], m_decay, m_damping);
+        }
+
+        // Create all-pass filters
+        for (size_t i = 0; i < NUM_ALLPASS; ++i)
+        {
+            m_allPassFiltersL[i] = std::make_unique<AllPassFilter>(topology.allpassL[i], m_diffusion * 0.7f);
+            m_allPassFiltersR[i] = std::make_unique<AllPassFilter>(topology.allpassR[i], m_diffusion * 0.7f);
+        }
+
+        // Create early reflections
+        m_earlyReflections = std::make_unique<EarlyReflections>(m_sampleRate, 2);
+        m_earlyReflections->setupTaps(0, topology.earlyL, m_roomSize);
+        m_earlyReflections->setupTaps(1, topology.earlyR, m_roomSize * 1.05f);
+
+        // Per-input early reflections and diffusion for the multichannel path,
+        // slightly detuned per channel for decorrelation
+        m_channelEarlyReflections.clear();
+        m_inputDiffusers.clear();
+        const float diffuserBase = m_sampleRate * 0.0013f;
+        for (size_t ch = 0; ch < m_channels; ++ch)
+        {
+            const float spread = 1.0f + 0.05f * ch;
+            m_channelEarlyReflections.push_back(std::make_unique<EarlyReflections>(m_sampleRate));
+            m_channelEarlyReflections.back()->setupTaps(0, m_sampleRate, m_roomSize * spread);
+            m_inputDiffusers.push_back(std::make_unique<AllPassFilter>(
+                static_cast<size_t>(diffuserBase * spread), m_diffusion * 0.7f));
+            m_inputDiffusers.push_back(std::make_unique<AllPassFilter>(
+                static_cast<size_t>(diffuserBase * 2.3f * spread), m_diffusion * 0.7f));
+        }
+
+        m_lateTail.configure(topology.lateLines, m_sampleRate, m_roomSize, m_decay, m_damping);
+    }
+
+    void updateCombFeedback()
+    {
+        for (auto &comb : m_combFiltersL)
+        {
+            if (comb)
+                comb->setFeedback(m_decay);
+        }
+        for (auto &comb : m_combFiltersR)
+        {
+            if (comb)
+                comb->setFeedback(m_decay);
+        }
+        m_lateTail.setDecay(m_decay);
+    }
+
+    void updateCombDamping()
+    {
+        for (auto &comb : m_combFiltersL)
+        {
+            if (comb)
+                comb->setDamping(m_damping);
+        }
+        for (auto &comb : m_combFiltersR)
+        {
+            if (comb)
+                comb->setDamping(m_damping);
+        }
+        m_lateTail.setDamping(m_damping);
+    }
+
+    void updateAllPassGain()
+    {
+        float gain = m_diffusion * 0.7f;
+        for (auto &allpass : m_allPassFiltersL)
+        {
+            if (allpass)
+                allpass->setGain(gain);
+        }
+        for (auto &allpass : m_allPassFiltersR)
+        {
+            if (allpass)
+                allpass->setGain(gain);
+        }
+        for (auto &allpass : m_inputDiffusers)
+        {
+            allpass->setGain(gain);
+        }
+    }
+
+    // The classic path runs in the deployment's DspEngine; only the dry/wet
+    // mix around it stays in float
+    using Sample = DspEngine::Sample;
+    using Gain = DspEngine::Gain;
+    static constexpr Gain COMB_SCALE = DspEngine::gain(0.25f); // Scale for 4 combs
+    static constexpr Gain TAIL_LEVEL = DspEngine::gain(0.7f);
+
+    // A comb with feedback g has a steady-state gain of 1 / (1 - g), so Q31
+    // combs would saturate for inputs above about -22 dBFS even at 0.92.
+    // Q31 runs the combs and all-passes 1/16 down, undoes the scale in float
+    // on the way out and caps the decay (the comb feedback) at MAX_DECAY,
+    // where the gain is 12.5 and stays inside the 16x headroom. The float
+    // engines need no headroom and allow the full 0.99.
+    static constexpr bool TAIL_HEADROOM = std::is_same_v<DspEngine, Q31Engine>;
+    static constexpr float TAIL_RESTORE = 16.0f;
+    static constexpr float MAX_DECAY = TAIL_HEADROOM ? 0.92f : 0.99f;
+    static_assert(!TAIL_HEADROOM || 1.0f / (1.0f - MAX_DECAY) < TAIL_RESTORE, "comb gain must fit the tail headroom");
+    static constexpr Gain TAIL_INPUT_SCALE = DspEngine::gain(1.0f / TAIL_RESTORE);
+
+    static Sample tailInput(Sample input)
+    {
+        if constexpr (TAIL_HEADROOM)
+            return DspEngine::mul(input, TAIL_INPUT_SCALE);
+        else
+            return input;
+    }
+
+    static float tailOutput(Sample early, Sample tail)
+    {
+        if constexpr (TAIL_HEADROOM)
+            return DspEngine::toFloat(early) + DspEngine::toFloat(DspEngine::mul(tail, TAIL_LEVEL)) * TAIL_RESTORE;
+        else
+            return DspEngine::toFloat(DspEngine::add(early, DspEngine::mul(tail, TAIL_LEVEL)));
+    }
+
+    // Per-sample tail; the early reflections come in precomputed per block
+    float processMono(Sample input, Sample earlyTaps, Gain earlyLevel)
+    {
+        // Early reflections
+        Sample early = DspEngine::mul(earlyTaps, earlyLevel);
+
+        // Comb filters (parallel)
+        const Sample combInput = tailInput(input);
+        Sample combOut{};
+        for (auto &comb : m_combFiltersL)
+        {
+            combOut = DspEngine::add(combOut, DspEngine::mul(comb->process(combInput), COMB_SCALE));
+        }
+
+        // All-pass filters (series)
+        Sample allpassOut = combOut;
+        for (auto &allpass : m_allPassFiltersL)
+        {
+            allpassOut = allpass->process(allpassOut);
+        }
+
+        return tailOutput(early, allpassOut);
+    }
+
+    // monoInput is the L/R sum the early reflections were computed from
+    std::pair<float, float> processStereo(Sample monoInput, Sample earlyTapsL, Sample earlyTapsR, Gain earlyLevel)
+    {
+        // Early reflections
+        Sample earlyL = DspEngine::mul(earlyTapsL, earlyLevel);
+        Sample earlyR = DspEngine::mul(earlyTapsR, earlyLevel);
+
+        // Comb filters (parallel) - separate L/R
+        const Sample combInput = tailInput(monoInput);
+        Sample combOutL{};
+        Sample combOutR{};
+
+        for (auto &comb : m_combFiltersL)
+        {
+            combOutL = DspEngine::add(combOutL, DspEngine::mul(comb->process(combInput), COMB_SCALE));
+        }
+        for (auto &comb : m_combFiltersR)
+        {
+            combOutR = DspEngine::add(combOutR, DspEngine::mul(comb->process(combInput), COMB_SCALE));
+        }
+
+        // All-pass filters (series)
+        Sample allpassOutL = combOutL;
+        Sample allpassOutR = combOutR;
+
+        for (auto &allpass : m_allPassFiltersL)
+        {
+            allpassOutL = allpass->process(allpassOutL);
+        }
+        for (auto &allpass : m_allPassFiltersR)
+        {
+            allpassOutR = allpass->process(allpassOutR);
+        }
+
+        return {tailOutput(earlyL, allpassOutL), tailOutput(earlyR, allpassOutR)};
+    }
+
+    void ensureMultichannelBuffers(size_t numFrames, unsigned int channels)
+    {
+        if (numFrames <= m_maxFrames && m_channelInput.size() == channels)
+        {
+            return;
+        }
+        m_maxFrames = std::max(m_maxFrames, numFrames);
+        m_channelInput.assign(channels, std::vector<float>(m_maxFrames, 0.0f));
+        m_channelWet.assign(channels, std::vector<float>(m_maxFrames, 0.0f));
+        m_diffused.assign(m_maxFrames, 0.0f);
+        for (size_t j = 0; j < FeedbackDelayNetwork::NUM_LINES; ++j)
+        {
+            m_tailInput[j].assign(m_maxFrames, 0.0f);
+            m_tailOutput[j].assign(m_maxFrames, 0.0f);
+        }
+    }
+
+    // Per-input early reflections and diffusion, shared FDN tail. Channel c
+    // is injected along Hadamard row c and read back along row c + 1, so
+    // every input excites the whole tail with a distinct spatial pattern.
+    // Only the per-channel front end scales with the channel count.
+    void processMultichannel(int32_t *samples, size_t numFrames, unsigned int channels)
+    {
+        constexpr size_t NUM_LINES = FeedbackDelayNetwork::NUM_LINES;
+        ensureMultichannelBuffers(numFrames, channels);
+
+        const float injectGain = 1.0f / std::sqrt(static_cast<float>(channels));
+        const float outputGain = 0.4f / std::sqrt(static_cast<float>(NUM_LINES));
+
+        for (size_t j = 0; j < NUM_LINES; ++j)
+        {
+            std::fill(m_tailInput[j].begin(), m_tailInput[j].begin() + numFrames, 0.0f);
+        }
+
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            float *input = m_channelInput[ch].data();
+            float *wet = m_channelWet[ch].data();
+            SampleConversion::deinterleave(samples, input, numFrames, channels, ch);
+
+            EarlyReflections &early = *m_channelEarlyReflections[ch];
+            AllPassFilter &diffuser1 = *m_inputDiffusers[ch * NUM_INPUT_DIFFUSERS];
+            AllPassFilter &diffuser2 = *m_inputDiffusers[ch * NUM_INPUT_DIFFUSERS + 1];
+
+            // Early reflections go straight to this channel's wet signal
+            float *diffused = m_diffused.data();
+            Sample *const earlyOutput = m_earlyOutput[0].data();
+            for (size_t start = 0; start < numFrames; start += EARLY_BLOCK)
+            {
+                const size_t count = std::min(EARLY_BLOCK, numFrames - start);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    m_earlyInput[i] = DspEngine::fromFloat(input[start + i]);
+                }
+                early.process(m_earlyInput.data(), &earlyOutput, 1, count);
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const Sample x = m_earlyInput[i];
+                    wet[start + i] = DspEngine::toFloat(earlyOutput[i]) * m_earlyReflectionLevel;
+                    diffused[start + i] = DspEngine::toFloat(diffuser2.process(diffuser1.process(x))) * injectGain;
+                }
+            }
+
+            const size_t row = ch % NUM_LINES;
+            for (size_t j = 0; j < NUM_LINES; ++j)
+            {
+                const float sign = FeedbackDelayNetwork::hadamardSign(row, j);
+                float *tailInput = m_tailInput[j].data();
+                for (size_t i = 0; i < numFrames; ++i)
+                {
+                    tailInput[i] += sign * diffused[i];
+                }
+            }
+        }
+
+        // Shared late tail, chunked by its shortest line
+        const size_t maxChunk = m_lateTail.getMaxChunk();
+        std::array<const float *, NUM_LINES> tailIn;
+        std::array<float *, NUM_LINES> tailOut;
+        for (size_t start = 0; start < numFrames; start += maxChunk)
+        {
+            const size_t count = std::min(maxChunk, numFrames - start);
+            for (size_t j = 0; j < NUM_LINES; ++j)
+            {
+                tailIn[j] = m_tailInput[j].data() + start;
+                tailOut[j] = m_tailOutput[j].data() + start;
+            }
+            m_lateTail.process(tailIn.data(), tailOut.data(), count);
+        }
+
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            float *input = m_channelInput[ch].data();
+            float *wet = m_channelWet[ch].data();
+            const size_t row = (ch + 1) % NUM_LINES;
+            for (size_t j = 0; j < NUM_LINES; ++j)
+            {
+                const float gain = FeedbackDelayNetwork::hadamardSign(row, j) * outputGain;
+                const float *tail = m_tailOutput[j].data();
+                for (size_t i = 0; i < numFrames; ++i)
+                {
+                    wet[i] += gain * tail[i];
+                }
+            }
+
+            for (size_t i = 0; i < numFrames; ++i)
+            {
+                input[i] = input[i] * (1.0f - m_mix) + wet[i] * m_mix;
+            }
+            SampleConversion::interleave(input, samples, numFrames, channels, ch);
+        }
+    }
+};
+
+// Delay effect implementation. Storage and gains use the sample engine, so
+// the Q31 build never touches the FPU per sample.
+template <typename Engine>
+class DelayEffectT : public AudioEffect
+{
+private:
+    using Sample = typename Engine::Sample;
+    using Gain = typename Engine::Gain;
+
+    std::vector<Sample> m_delayBuffer; // Interleaved, m_bufferSize frames of m_bufferChannels
+    unsigned int m_bufferChannels = 0;
+    size_t m_writeIndex = 0;           // Write position in frames, shared by all channels
+    size_t m_bufferSize;
+    size_t m_delaySamples;
+    float m_feedback;
+    float m_wetLevel;
+    float m_dryLevel;
+    Gain m_feedbackGain;
+    Gain m_wetGain;
+    Gain m_dryGain;
+
+public:
+    DelayEffectT(float delayTimeMs = 250.0f, float feedback = 0.3f,
+                 float wetLevel = 0.3f, float dryLevel = 0.7f)
+        : m_feedback(feedback), m_wetLevel(wetLevel), m_dryLevel(dryLevel),
+          m_feedbackGain(Engine::gain(feedback)), m_wetGain(Engine::gain(wetLevel)), m_dryGain(Engine::gain(dryLevel))
+    {
+        // The line is zeroed by prepareState(), reset() or restoreState()
+        resizeDelay(delayTimeMs);
+        this->deferState();
+    }
+
+    void setDelayTime(float delayTimeMs)
+    {
+        resizeDelay(delayTimeMs);
+        reset();
+    }
+
+    void setFeedback(float feedback)
+    {
+        // Prevent runaway feedback
+        m_feedback = std::max(0.0f, std::min(0.95f, feedback));
+        m_feedbackGain = Engine::gain(m_feedback);
+    }
+
+    void setWetLevel(float wetLevel)
+    {
+        m_wetLevel = std::max(0.0f, std::min(1.0f, wetLevel));
+        m_wetGain = Engine::gain(m_wetLevel);
+    }
+
+    void setDryLevel(float dryLevel)
+    {
+        m_dryLevel = std::max(0.0f, std::min(1.0f, dryLevel));
+        m_dryGain = Engine::gain(m_dryLevel);
+    }
+
+    void setMix(float wetLevel, float dryLevel)
+    {
+        setWetLevel(wetLevel);
+        setDryLevel(dryLevel);
+    }
+
+    // Getters
+    float getDelayTimeMs() const
+    {
+        return (static_cast<float>(m_delaySamples) / this->m_sampleRate) * 1000.0f;
+    }
+
+    float getFeedback() const { return m_feedback; }
+    float getWetLevel() const { return m_wetLevel; }
+    float getDryLevel() const { return m_dryLevel; }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        float currentDelayMs = getDelayTimeMs();
+        AudioEffect::setSampleRate(sampleRate);
+        setDelayTime(currentDelayMs); // Recalculate delay samples for new sample rate
+    }
+
+    void reset() override
+    {
+        // Whoever builds the state zeroes it; a line built earlier is zeroed here
+        if (this->claimState())
+        {
+            buildState();
+            this->publishState();
+            return;
+        }
+        this->ensureState();
+        buildState();
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!this->m_enabled || channels == 0 || !this->isStateReady())
+        {
+            // Pass through, also while the line is being built off this thread
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        // Ensure we have enough delay buffers
+        if (m_bufferChannels < channels)
+        {
+            m_bufferChannels = channels;
+            m_delayBuffer.assign(m_bufferSize * m_bufferChannels, Sample{});
+            m_writeIndex = 0;
+        }
+
+        dispatchChannels(channels, [&](auto ch)
+                         { this->template processFrames<decltype(ch)::value>(inputBuffer, outputBuffer, numSamples, channels); });
+    }
+
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(m_delaySamples);
+        out.write(m_bufferSize);
+        out.write(m_feedback);
+        out.write(m_wetLevel);
+        out.write(m_dryLevel);
+        // A line never built is saved empty
+        const bool built = this->isStateReady();
+        out.write(built ? m_bufferChannels : 0u);
+        out.write(built ? m_writeIndex : 0);
+        out.writeArray(m_delayBuffer.data(), built ? m_delayBuffer.size() : 0);
+    }
+
+    // The line comes straight from the snapshot instead of being zeroed;
+    // the parameters are committed only once it has read
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        size_t delaySamples = 0;
+        size_t bufferSize = 0;
+        float feedback = 0.0f;
+        float wetLevel = 0.0f;
+        float dryLevel = 0.0f;
+        unsigned int bufferChannels = 0;
+        size_t writeIndex = 0;
+        if (!in.read(enabled) || !in.read(delaySamples) || !in.read(bufferSize) ||
+            !in.read(feedback) || !in.read(wetLevel) || !in.read(dryLevel) ||
+            !in.read(bufferChannels) || !in.read(writeIndex) || delaySamples >= bufferSize)
+            return false;
+
+        const bool claimed = this->claimState();
+        if (!claimed)
+        {
+            this->ensureState();
+        }
+        bool restored = in.readArray(m_delayBuffer) && writeIndex < bufferSize &&
+                        m_delayBuffer.size() == bufferSize * bufferChannels;
+        if (restored)
+        {
+            this->m_enabled = enabled;
+            m_delaySamples = delaySamples;
+            m_bufferSize = bufferSize;
+            setFeedback(feedback);
+            setWetLevel(wetLevel);
+            setDryLevel(dryLevel);
+        }
+        if (restored && bufferChannels > 0)
+        {
+            m_bufferChannels = bufferChannels;
+            m_writeIndex = writeIndex;
+        }
+        else
+        {
+            buildState();
+        }
+        if (claimed)
+        {
+            this->publishState();
+        }
+        return restored;
+    }
+
+protected:
+    void buildState() override
+    {
+        // Initialize delay buffers for each channel
+        m_bufferChannels = std::max(m_bufferChannels, 8u); // Support up to 8 channels
+        m_delayBuffer.assign(m_bufferSize * m_bufferChannels, Sample{});
+        m_writeIndex = 0;
+    }
+
+private:
+    void resizeDelay(float delayTimeMs)
+    {
+        m_delaySamples = static_cast<size_t>((delayTimeMs / 1000.0f) * this->m_sampleRate);
+        // Add some extra buffer space to prevent overflow
+        m_bufferSize = m_delaySamples + 1024;
+    }
+
+    // One frame per step; the channel loop has a compile-time trip count for
+    // the specialised layouts. The buffer keeps m_bufferChannels slots per
+    // frame, so channel counts below it leave the rest unused.
+    template <unsigned int CH>
+    void processFrames(const int32_t *inputBuffer, int32_t *outputBuffer,
+                       size_t numSamples, unsigned int channels)
+    {
+        const unsigned int numChannels = CH ? CH : channels;
+        const size_t bufferStride = m_bufferChannels;
+        const size_t bufferSize = m_bufferSize;
+        const Gain feedback = m_feedbackGain;
+        const Gain dryLevel = m_dryGain;
+        const Gain wetLevel = m_wetGain;
+        Sample *delayBuffer = m_delayBuffer.data();
+        size_t writeIndex = m_writeIndex;
+        // Read position (delay samples behind write position)
+        size_t readIndex = (writeIndex + bufferSize - m_delaySamples) % bufferSize;
+
+        for (size_t sample = 0; sample < numSamples; ++sample)
+        {
+            const int32_t *input = inputBuffer + sample * numChannels;
+            int32_t *output = outputBuffer + sample * numChannels;
+            Sample *writeFrame = delayBuffer + writeIndex * bufferStride;
+            const Sample *readFrame = delayBuffer + readIndex * bufferStride;
+
+            for (unsigned int ch = 0; ch < numChannels; ++ch)
+            {
+                const Sample inputSample = Engine::fromInt32(input[ch]);
+
+                // Get delayed sample
+                const Sample delayedSample = readFrame[ch];
+
+                // Write to delay buffer (input + delayed sample * feedback)
+                writeFrame[ch] = Engine::add(inputSample, Engine::mul(delayedSample, feedback));
+
+                // Mix dry and wet signals
+                output[ch] = Engine::toInt32(Engine::add(Engine::mul(inputSample, dryLevel), Engine::mul(delayedSample, wetLevel)));
+            }
+
+            // Advance write and read positions
+            if (++writeIndex == bufferSize)
+                writeIndex = 0;
+            if (++readIndex == bufferSize)
+                readIndex = 0;
+        }
+
+        m_writeIndex = writeIndex;
+    }
+};
+
+using DelayEffect = DelayEffectT<DspEngine>;
+
+// Linear-phase half-band FIR stage for 2x up/down sampling.
+// Every other tap of a half-band filter is zero and the centre tap is 0.5, so
+// in polyphase form one output phase is a pure delay and the other is a short
+// convolution with the odd-offset taps only. The convolutions run tap-major
+// over whole blocks so the inner loops are contiguous and vectorize.
+class HalfBandStage
+{
+private:
+    std::vector<float> m_coeffs; // Odd-offset taps (symmetric, sum to 0.5)
+    size_t m_halfLength;         // K: number of taps on each side of centre
+
+    // Per-channel filter histories
+    std::vector<std::vector<float>> m_upHistory;
+    std::vector<std::vector<float>> m_downOddHistory;
+    std::vector<std::vector<float>> m_downEvenHistory;
+
+    // Scratch buffers (grown on demand)
+    std::vector<float> m_work;
+    std::vector<float> m_workEven;
+    std::vector<float> m_acc;
+
+    static double besselI0(double x)
+    {
+        double sum = 1.0;
+        double term = 1.0;
+        for (int k = 1; k < 32; ++k)
+        {
+            term *= (x / (2.0 * k)) * (x / (2.0 * k));
+            sum += term;
+        }
+        return sum;
+    }
+
+    void ensureScratch(size_t numSamples)
+    {
+        const size_t needed = m_coeffs.size() - 1 + numSamples;
+        if (m_work.size() < needed)
+        {
+            m_work.resize(needed);
+            m_workEven.resize(needed);
+            m_acc.resize(numSamples);
+        }
+    }
+
+public:
+    // halfLength: taps per side of centre (filter length is 4 * halfLength - 1)
+    // beta: Kaiser window shape (8.0 gives roughly 80 dB stopband rejection)
+    HalfBandStage(size_t halfLength, double beta = 8.0)
+        : m_halfLength(std::max<size_t>(halfLength, 1))
+    {
+        const size_t numCoeffs = 2 * m_halfLength;
+        const double centre = static_cast<double>(2 * m_halfLength - 1);
+        m_coeffs.resize(numCoeffs);
+
+        double sum = 0.0;
+        for (size_t j = 0; j < numCoeffs; ++j)
+        {
+            // Offset from the centre tap is always odd
+            const double offset = 2.0 * j - centre;
+            const double x = M_PI * offset * 0.5;
+            const double sinc = std::sin(x) / x;
+            const double ratio = offset / centre;
+            const double window = besselI0(beta * std::sqrt(std::max(0.0, 1.0 - ratio * ratio))) / besselI0(beta);
+            const double tap = 0.5 * sinc * window;
+            m_coeffs[j] = static_cast<float>(tap);
+            sum += tap;
+        }
+
+        // Normalize for unity DC gain (centre tap contributes the other half)
+        for (auto &coeff : m_coeffs)
+        {
+            coeff = static_cast<float>(coeff * (0.5 / sum));
+        }
+    }
+
+    void setChannels(unsigned int channels)
+    {
+        m_upHistory.assign(channels, std::vector<float>(m_coeffs.size() - 1, 0.0f));
+        m_downOddHistory.assign(channels, std::vector<float>(m_coeffs.size() - 1, 0.0f));
+        m_downEvenHistory.assign(channels, std::vector<float>(m_halfLength - 1, 0.0f));
+    }
+
+    unsigned int getChannels() const { return static_cast<unsigned int>(m_upHistory.size()); }
+
+    // Scratch for blocks of up to maxSamples at the lower rate
+    void reserve(size_t maxSamples) { ensureScratch(maxSamples); }
+
+    void clear()
+    {
+        for (auto &history : m_upHistory)
+            std::fill(history.begin(), history.end(), 0.0f);
+        for (auto &history : m_downOddHistory)
+            std::fill(history.begin(), history.end(), 0.0f);
+        for (auto &history : m_downEvenHistory)
+            std::fill(history.begin(), history.end(), 0.0f);
+    }
+
+    // Filter histories; restored into a stage set to the same channel count
+    void saveState(EffectStateWriter &out) const
+    {
+        for (const auto *histories : {&m_upHistory, &m_downOddHistory, &m_downEvenHistory})
+        {
+            for (const auto &history : *histories)
+                out.writeArray(history);
+        }
+    }
+
+    bool restoreState(EffectStateReader &in)
+    {
+        for (auto *histories : {&m_upHistory, &m_downOddHistory, &m_downEvenHistory})
+        {
+            for (auto &history : *histories)
+            {
+                if (!in.readArray(history.data(), history.size()))
+                    return false;
+            }
+        }
+        return true;
+    }
+
+    // Latency of an up + down pair, in samples at the higher rate
+    size_t getRoundTripLatency() const { return 4 * m_halfLength - 3; }
+
+    // input: numSamples at the lower rate, output: 2 * numSamples
+    void upsample(const float *input, float *output, size_t numSamples, unsigned int channel)
+    {
+        const size_t numCoeffs = m_coeffs.size();
+        auto &history = m_upHistory[channel];
+        ensureScratch(numSamples);
+
+        float *work = m_work.data();
+        float *acc = m_acc.data();
+        std::copy(history.begin(), history.end(), work);
+        std::copy(input, input + numSamples, work + numCoeffs - 1);
+        std::fill(acc, acc + numSamples, 0.0f);
+
+        // Even phase: convolution with the odd-offset taps (gain 2 for zero stuffing)
+        for (size_t k = 0; k < numCoeffs; ++k)
+        {
+            const float coeff = 2.0f * m_coeffs[k];
+            const float *src = work + k;
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                acc[i] += coeff * src[i];
+            }
+        }
+
+        // Odd phase: centre tap only, i.e. the input delayed by K - 1 samples
+        const float *centre = work + m_halfLength;
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            output[2 * i] = acc[i];
+            output[2 * i + 1] = centre[i];
+        }
+
+        std::copy(work + numSamples, work + numSamples + numCoeffs - 1, history.begin());
+    }
+
+    // input: 2 * numSamples at the higher rate, output: numSamples
+    void downsample(const float *input, float *output, size_t numSamples, unsigned int channel)
+    {
+        const size_t numCoeffs = m_coeffs.size();
+        auto &oddHistory = m_downOddHistory[channel];
+        auto &evenHistory = m_downEvenHistory[channel];
+        ensureScratch(numSamples);
+
+        float *odd = m_work.data();
+        float *even = m_workEven.data();
+        float *acc = m_acc.data();
+        std::copy(oddHistory.begin(), oddHistory.end(), odd);
+        std::copy(evenHistory.begin(), evenHistory.end(), even);
+
+        float *oddIn = odd + numCoeffs - 1;
+        float *evenIn = even + m_halfLength - 1;
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            evenIn[i] = input[2 * i];
+            oddIn[i] = input[2 * i + 1];
+        }
+
+        // Even samples only see the centre tap
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            acc[i] = 0.5f * even[i];
+        }
+
+        for (size_t k = 0; k < numCoeffs; ++k)
+        {
+            const float coeff = m_coeffs[k];
+            const float *src = odd + k;
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                acc[i] += coeff * src[i];
+            }
+        }
+
+        std::copy(acc, acc + numSamples, output);
+        std::copy(odd + numSamples, odd + numSamples + numCoeffs - 1, oddHistory.begin());
+        std::copy(even + numSamples, even + numSamples + m_halfLength - 1, evenHistory.begin());
+    }
+};
+
+// Runs a wrapped effect at 2x, 4x or 8x the host sample rate through a
+// cascade of half-band stages. The first stage carries the steep transition
+// band; later stages only need to reject images far above the audio band, so
+// they are much shorter.
+class OversamplingEffect : public AudioEffect
+{
+public:
+    enum Factor
+    {
+        OVERSAMPLE_2X = 2,
+        OVERSAMPLE_4X = 4,
+        OVERSAMPLE_8X = 8
+    };
+
+private:
+    std::unique_ptr<AudioEffect> m_effect;
+    Factor m_factor;
+    std::vector<std::unique_ptr<HalfBandStage>> m_stages;
+
+    // Per-channel planar buffers, one per rate (index 0 = host rate). The
+    // signal stays in float from the first stage to the last; only the
+    // host-rate output, and the int32 hop for a wrapped effect without a
+    // float path, saturate.
+    std::vector<std::vector<std::vector<float>>> m_rateBuffers;
+    std::vector<float *> m_oversampledChannels; // Into m_rateBuffers.back()
+    std::vector<int32_t> m_oversampledBuffer;
+    size_t m_maxFrames;
+    unsigned int m_channels;
+
+    static size_t stageHalfLength(size_t stageIndex)
+    {
+        // Transition band shrinks relative to the stage rate at each step up
+        static constexpr std::array<size_t, 3> HALF_LENGTHS = {16, 5, 3};
+        return HALF_LENGTHS[std::min(stageIndex, HALF_LENGTHS.size() - 1)];
+    }
+
+    void ensureBuffers(size_t numFrames, unsigned int channels)
+    {
+        if (numFrames <= m_maxFrames && channels == m_channels)
+        {
+            return;
+        }
+
+        m_maxFrames = std::max(numFrames, m_maxFrames);
+        if (channels != m_channels)
+        {
+            m_channels = channels;
+            for (auto &stage : m_stages)
+            {
+                stage->setChannels(channels);
+            }
+        }
+
+        m_rateBuffers.resize(m_stages.size() + 1);
+        for (size_t rate = 0; rate < m_rateBuffers.size(); ++rate)
+        {
+            m_rateBuffers[rate].assign(channels, std::vector<float>(m_maxFrames << rate, 0.0f));
+        }
+        m_oversampledChannels.resize(channels);
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            m_oversampledChannels[ch] = m_rateBuffers.back()[ch].data();
+        }
+        m_oversampledBuffer.resize(m_maxFrames * m_factor * channels);
+    }
+
+public:
+    OversamplingEffect(std::unique_ptr<AudioEffect> effect, Factor factor = OVERSAMPLE_2X)
+        : m_effect(std::move(effect)), m_factor(factor), m_maxFrames(0), m_channels(0)
+    {
+        size_t numStages = 0;
+        for (unsigned int f = m_factor; f > 1; f >>= 1)
+        {
+            m_stages.push_back(std::make_unique<HalfBandStage>(stageHalfLength(numStages++)));
+        }
+
+        if (m_effect)
+        {
+            m_effect->setSampleRate(m_sampleRate * m_factor);
+        }
+    }
+
+    AudioEffect *getEffect() const { return m_effect.get(); }
+    Factor getFactor() const { return m_factor; }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        AudioEffect::setSampleRate(sampleRate);
+        if (m_effect)
+        {
+            m_effect->setSampleRate(sampleRate * m_factor);
+        }
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        ensureBuffers(maxFrames, channels);
+        for (size_t s = 0; s < m_stages.size(); ++s)
+        {
+            m_stages[s]->reserve(maxFrames << s);
+        }
+        if (m_effect)
+        {
+            m_effect->prepare(maxFrames * m_factor, channels);
+        }
+    }
+
+    void prepareState() override
+    {
+        AudioEffect::prepareState();
+        if (m_effect)
+        {
+            m_effect->prepareState();
+        }
+    }
+
+    size_t getLatency() const override
+    {
+        // Each stage's round trip is measured at its own (higher) rate
+        float latency = 0.0f;
+        for (size_t i = 0; i < m_stages.size(); ++i)
+        {
+            latency += static_cast<float>(m_stages[i]->getRoundTripLatency()) / static_cast<float>(2u << i);
+        }
+
+        const size_t innerLatency = m_effect ? m_effect->getLatency() : 0;
+        return static_cast<size_t>(std::lround(latency)) + innerLatency / m_factor;
+    }
+
+    void reset() override
+    {
+        for (auto &stage : m_stages)
+        {
+            stage->clear();
+        }
+        if (m_effect)
+        {
+            m_effect->reset();
+        }
+    }
+
+    // The stage histories, then the wrapped effect's own record
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(static_cast<int32_t>(m_factor));
+        out.write(m_channels);
+        for (const auto &stage : m_stages)
+        {
+            stage->saveState(out);
+        }
+        out.write(m_effect != nullptr);
+        if (m_effect)
+        {
+            AudioEffect::saveTagged(out, *m_effect);
+        }
+    }
+
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        int32_t factor = 0;
+        unsigned int channels = 0;
+        if (!in.read(enabled) || !in.read(factor) || !in.read(channels) ||
+            factor != m_factor || channels != m_channels)
+            return false;
+        for (auto &stage : m_stages)
+        {
+            if (!stage->restoreState(in))
+                return false;
+        }
+        bool hasEffect = false;
+        if (!in.read(hasEffect) || hasEffect != (m_effect != nullptr) ||
+            (m_effect && !AudioEffect::restoreTagged(in, *m_effect)))
+            return false;
+        m_enabled = enabled;
+        return true;
+    }
+
+    bool isBypassed(unsigned int channels) const override
+    {
+        return !m_enabled || !m_effect || channels == 0;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || !m_effect || channels == 0)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        ensureBuffers(numSamples, channels);
+        const size_t numStages = m_stages.size();
+        const size_t oversampledFrames = numSamples * m_factor;
+
+        // Up: host rate -> m_factor * host rate
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            SampleConversion::deinterleave(inputBuffer, m_rateBuffers[0][ch].data(), numSamples, channels, ch);
+            for (size_t s = 0; s < numStages; ++s)
+            {
+                m_stages[s]->upsample(m_rateBuffers[s][ch].data(), m_rateBuffers[s + 1][ch].data(),
+                                      numSamples << s, ch);
+            }
+        }
+
+        if (!m_effect->processPlanar(m_oversampledChannels.data(), oversampledFrames, channels))
+        {
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                SampleConversion::interleave(m_oversampledChannels[ch], m_oversampledBuffer.data(),
+                                             oversampledFrames, channels, ch);
+            }
+            m_effect->process(m_oversampledBuffer.data(), m_oversampledBuffer.data(), oversampledFrames, channels);
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                SampleConversion::deinterleave(m_oversampledBuffer.data(), m_oversampledChannels[ch],
+                                               oversampledFrames, channels, ch);
+            }
+        }
+
+        // Down: m_factor * host rate -> host rate
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            for (size_t s = numStages; s-- > 0;)
+            {
+                m_stages[s]->downsample(m_rateBuffers[s + 1][ch].data(), m_rateBuffers[s][ch].data(),
+                                        numSamples << s, ch);
+            }
+            SampleConversion::interleave(m_rateBuffers[0][ch].data(), outputBuffer, numSamples, channels, ch);
+        }
+    }
+};
+
+// Branch-free waveshaping curves and their antiderivatives. Everything here
+// is plain arithmetic, min/max and bit manipulation so block loops calling
+// these functions auto-vectorize; no libm calls on the audio path.
+namespace Waveshaper
+{
+    // Natural log via exponent extraction and a 5-term atanh series on the
+    // mantissa, folded into [sqrt(0.5), sqrt(2)). Accurate to ~1 ulp for x > 0.
+    inline float fastLog(float x)
+    {
+        int32_t bits;
+        std::memcpy(&bits, &x, sizeof(bits));
+        int32_t exponent = ((bits >> 23) & 0xff) - 127;
+        int32_t mantissaBits = (bits & 0x007fffff) | 0x3f800000;
+
+        // Fold mantissas above sqrt(2) down by one octave
+        const int32_t fold = mantissaBits > 0x3fb504f3 ? 1 : 0;
+        exponent += fold;
+        mantissaBits -= fold << 23;
+
+        float m;
+        std::memcpy(&m, &mantissaBits, sizeof(m));
+        const float t = (m - 1.0f) / (m + 1.0f);
+        const float t2 = t * t;
+        const float series = t * (2.0f + t2 * (2.0f / 3.0f + t2 * (2.0f / 5.0f + t2 * (2.0f / 7.0f + t2 * (2.0f / 9.0f)))));
+        return series + static_cast<float>(exponent) * 0.69314718f;
+    }
+
+    // Pade [3/2] approximant of tanh; reaches exactly +-1 with zero slope at |x| = 3
+    constexpr float TANH_PADE_LIMIT = 3.0f;
+
+    inline float tanhPade32(float x)
+    {
+        x = std::clamp(x, -TANH_PADE_LIMIT, TANH_PADE_LIMIT);
+        const float x2 = x * x;
+        return x * (27.0f + x2) / (27.0f + 9.0f * x2);
+    }
+
+    // Antiderivative of tanhPade32, zero at the origin
+    inline float tanhPade32Integral(float x)
+    {
+        const float clamped = std::clamp(x, -TANH_PADE_LIMIT, TANH_PADE_LIMIT);
+        const float x2 = clamped * clamped;
+        const float inside = x2 * (1.0f / 18.0f) + (4.0f / 3.0f) * fastLog(1.0f + x2 * (1.0f / 3.0f));
+        // Linear continuation beyond the limit where the curve is flat at +-1
+        return inside + (std::fabs(x) - std::fabs(clamped));
+    }
+
+    // Pade [7/6] approximant of tanh (Lambert continued fraction), saturated from |x| = 4.97
+    constexpr float TANH_PADE76_LIMIT = 4.97f;
+
+    inline float tanhPade76(float x)
+    {
+        x = std::clamp(x, -TANH_PADE76_LIMIT, TANH_PADE76_LIMIT);
+        const float x2 = x * x;
+        const float num = x * (135135.0f + x2 * (17325.0f + x2 * (378.0f + x2)));
+        const float den = 135135.0f + x2 * (62370.0f + x2 * (3150.0f + x2 * 28.0f));
+        return std::clamp(num / den, -1.0f, 1.0f);
+    }
+
+    // Cubic soft clipper 1.5x - 0.5x^3: slope 1.5 at the origin, reaching
+    // +-1 with zero slope at |x| = 1
+    inline float softClip(float x)
+    {
+        x = std::clamp(x, -1.0f, 1.0f);
+        return 1.5f * x - 0.5f * x * x * x;
+    }
+
+    inline float softClipIntegral(float x)
+    {
+        const float clamped = std::clamp(x, -1.0f, 1.0f);
+        const float x2 = clamped * clamped;
+        return 0.75f * x2 - 0.125f * x2 * x2 + (std::fabs(x) - std::fabs(clamped));
+    }
+}
+
+// Tape-style saturation with first-order antiderivative anti-aliasing (ADAA).
+// ADAA replaces f(x[n]) by the divided difference of the curve's
+// antiderivative, (F(x[n]) - F(x[n-1])) / (x[n] - x[n-1]), which suppresses
+// aliasing of the generated harmonics at the cost of half a sample of delay.
+class SaturationEffect : public AudioEffect
+{
+public:
+    enum Curve
+    {
+        TANH,
+        SOFT_CLIP,
+        ASYMMETRIC
+    };
+
+private:
+    // Below this input step the divided difference is ill-conditioned and
+    // the curve is evaluated at the midpoint instead
+    static constexpr float ADAA_EPSILON = 1.0e-3f;
+
+    Curve m_curve;
+    float m_drive;
+    float m_bias;
+    float m_mix;
+    float m_outputGain;
+    bool m_antialiasing;
+
+    // Bias offsets for the asymmetric curve, so that f(0) = F(0) = 0
+    float m_biasOffset;
+    float m_biasIntegralOffset;
+
+    // DC blocker coefficient (asymmetric curve generates DC)
+    float m_dcCoeff;
+
+    // Per-channel state
+    std::vector<float> m_prevInput;
+    std::vector<float> m_dcInput;
+    std::vector<float> m_dcOutput;
+
+    // Block scratch: one extra leading slot for the previous sample
+    std::vector<float> m_dry;
+    std::vector<float> m_shaped;
+    std::vector<float> m_integral;
+    std::vector<float> m_wet;
+
+    template <Curve C>
+    inline float shapeSample(float x) const
+    {
+        if constexpr (C == SOFT_CLIP)
+            return Waveshaper::softClip(x);
+        else if constexpr (C == ASYMMETRIC)
+            return Waveshaper::tanhPade32(x + m_bias) - m_biasOffset;
+        else
+            return Waveshaper::tanhPade32(x);
+    }
+
+    template <Curve C>
+    inline float integralSample(float x) const
+    {
+        if constexpr (C == SOFT_CLIP)
+            return Waveshaper::softClipIntegral(x);
+        else if constexpr (C == ASYMMETRIC)
+            return Waveshaper::tanhPade32Integral(x + m_bias) - m_biasIntegralOffset - m_biasOffset * x;
+        else
+            return Waveshaper::tanhPade32Integral(x);
+    }
+
+    void updateBias()
+    {
+        m_biasOffset = Waveshaper::tanhPade32(m_bias);
+        m_biasIntegralOffset = Waveshaper::tanhPade32Integral(m_bias);
+    }
+
+    void updateDcBlocker()
+    {
+        // ~10 Hz one-pole high-pass
+        m_dcCoeff = 1.0f - (2.0f * static_cast<float>(M_PI) * 10.0f / static_cast<float>(m_sampleRate));
+    }
+
+    void ensureBuffers(size_t numFrames, unsigned int channels)
+    {
+        if (m_prevInput.size() < channels)
+        {
+            m_prevInput.resize(channels, 0.0f);
+            m_dcInput.resize(channels, 0.0f);
+            m_dcOutput.resize(channels, 0.0f);
+        }
+        if (m_dry.size() < numFrames + 1)
+        {
+            m_dry.resize(numFrames + 1);
+            m_shaped.resize(numFrames + 1);
+            m_integral.resize(numFrames + 1);
+            m_wet.resize(numFrames);
+        }
+    }
+
+    // Shapes m_shaped[0..numFrames] into m_wet with ADAA; m_shaped[0] is the
+    // last driven sample of the previous block
+    template <Curve C>
+    void processAntialiased(size_t numFrames)
+    {
+        const float *x = m_shaped.data();
+        float *F = m_integral.data();
+        float *wet = m_wet.data();
+
+        for (size_t i = 0; i <= numFrames; ++i)
+        {
+            F[i] = integralSample<C>(x[i]);
+        }
+
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+            const float dx = x[i + 1] - x[i];
+            const bool conditioned = std::fabs(dx) > ADAA_EPSILON;
+            const float divided = (F[i + 1] - F[i]) / (conditioned ? dx : 1.0f);
+            const float midpoint = shapeSample<C>(0.5f * (x[i + 1] + x[i]));
+            wet[i] = conditioned ? divided : midpoint;
+        }
+    }
+
+    // Shapes m_shaped[1..numFrames] into m_wet without ADAA
+    template <Curve C>
+    void processStatic(size_t numFrames)
+    {
+        const float *x = m_shaped.data() + 1;
+        float *wet = m_wet.data();
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+            wet[i] = shapeSample<C>(x[i]);
+        }
+    }
+
+public:
+    SaturationEffect(Curve curve = TANH, float driveDb = 6.0f, float mix = 1.0f)
+        : m_curve(curve), m_bias(0.2f), m_outputGain(1.0f), m_antialiasing(true)
+    {
+        setDrive(driveDb);
+        setMix(mix);
+        updateBias();
+        updateDcBlocker();
+    }
+
+    void setCurve(Curve curve)
+    {
+        m_curve = curve;
+        reset();
+    }
+
+    // Input gain into the curve, in dB
+    void setDrive(float driveDb)
+    {
+        driveDb = std::clamp(driveDb, 0.0f, 36.0f);
+        m_drive = std::pow(10.0f, driveDb / 20.0f);
+    }
+
+    // Operating point offset for the asymmetric curve (adds even harmonics)
+    void setBias(float bias)
+    {
+        m_bias = std::clamp(bias, -0.9f, 0.9f);
+        updateBias();
+        reset();
+    }
+
+    void setMix(float mix) { m_mix = std::clamp(mix, 0.0f, 1.0f); }
+    void setOutputGain(float gain) { m_outputGain = std::clamp(gain, 0.0f, 4.0f); }
+    void setAntialiasing(bool enabled) { m_antialiasing = enabled; }
+
+    Curve getCurve() const { return m_curve; }
+    float getDrive() const { return 20.0f * std::log10(m_drive); }
+    float getBias() const { return m_bias; }
+    float getMix() const { return m_mix; }
+    float getOutputGain() const { return m_outputGain; }
+    bool getAntialiasing() const { return m_antialiasing; }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        AudioEffect::setSampleRate(sampleRate);
+        updateDcBlocker();
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        ensureBuffers(maxFrames, channels);
+    }
+
+    void reset() override
+    {
+        std::fill(m_prevInput.begin(), m_prevInput.end(), 0.0f);
+        std::fill(m_dcInput.begin(), m_dcInput.end(), 0.0f);
+        std::fill(m_dcOutput.begin(), m_dcOutput.end(), 0.0f);
+    }
+
+    // Parameters plus the per-channel ADAA input and DC blocker state
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(static_cast<int32_t>(m_curve));
+        out.write(m_drive);
+        out.write(m_bias);
+        out.write(m_mix);
+        out.write(m_outputGain);
+        out.write(m_antialiasing);
+        out.writeArray(m_prevInput);
+        out.writeArray(m_dcInput);
+        out.writeArray(m_dcOutput);
+    }
+
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        int32_t curve = 0;
+        float drive = 1.0f;
+        float bias = 0.0f;
+        float mix = 0.0f;
+        float outputGain = 0.0f;
+        bool antialiasing = false;
+        std::vector<float> prevInput;
+        std::vector<float> dcInput;
+        std::vector<float> dcOutput;
+        if (!in.read(enabled) || !in.read(curve) || !in.read(drive) || !in.read(bias) || !in.read(mix) ||
+            !in.read(outputGain) || !in.read(antialiasing) || !in.readArray(prevInput) ||
+            !in.readArray(dcInput) || !in.readArray(dcOutput))
+            return false;
+        if (curve < TANH || curve > ASYMMETRIC || dcInput.size() != prevInput.size() ||
+            dcOutput.size() != prevInput.size())
+            return false;
+
+        m_enabled = enabled;
+        m_curve = static_cast<Curve>(curve);
+        m_drive = std::clamp(drive, 1.0f, std::pow(10.0f, 36.0f / 20.0f));
+        m_bias = std::clamp(bias, -0.9f, 0.9f);
+        updateBias();
+        setMix(mix);
+        setOutputGain(outputGain);
+        m_antialiasing = antialiasing;
+        // Channels prepare() sized for stay, zeroed if the snapshot had fewer
+        const size_t channels = std::max(m_prevInput.size(), prevInput.size());
+        prevInput.resize(channels, 0.0f);
+        dcInput.resize(channels, 0.0f);
+        dcOutput.resize(channels, 0.0f);
+        m_prevInput = std::move(prevInput);
+        m_dcInput = std::move(dcInput);
+        m_dcOutput = std::move(dcOutput);
+        return true;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels == 0)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        ensureBuffers(numSamples, channels);
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            float *dry = m_dry.data();
+            SampleConversion::deinterleave(inputBuffer, dry, numSamples, channels, ch);
+            processChannel(dry, numSamples, ch);
+            SampleConversion::interleave(dry, outputBuffer, numSamples, channels, ch);
+        }
+    }
+
+    bool processPlanar(float *const *channelData, size_t numFrames, unsigned int channels) override
+    {
+        if (m_enabled && channels > 0)
+        {
+            ensureBuffers(numFrames, channels);
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                processChannel(channelData[ch], numFrames, ch);
+            }
+        }
+        return true;
+    }
+
+private:
+    // One channel's block, in place
+    void processChannel(float *dry, size_t numSamples, unsigned int ch)
+    {
+        // Undo the drive on the way out so mix and level stay comparable
+        const float wetGain = m_mix * m_outputGain / std::min(m_drive, 4.0f);
+        const float dryGain = 1.0f - m_mix;
+        float *shaped = m_shaped.data();
+
+        // shaped[0] carries the previous driven sample for ADAA
+        shaped[0] = m_prevInput[ch];
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            shaped[i + 1] = dry[i] * m_drive;
+        }
+
+        if (m_antialiasing)
+        {
+            switch (m_curve)
+            {
+            case SOFT_CLIP:
+                processAntialiased<SOFT_CLIP>(numSamples);
+                break;
+            case ASYMMETRIC:
+                processAntialiased<ASYMMETRIC>(numSamples);
+                break;
+            default:
+                processAntialiased<TANH>(numSamples);
+                break;
+            }
+        }
+        else
+        {
+            switch (m_curve)
+            {
+            case SOFT_CLIP:
+                processStatic<SOFT_CLIP>(numSamples);
+                break;
+            case ASYMMETRIC:
+                processStatic<ASYMMETRIC>(numSamples);
+                break;
+            default:
+                processStatic<TANH>(numSamples);
+                break;
+            }
+        }
+        m_prevInput[ch] = shaped[numSamples];
+
+        float *wet = m_wet.data();
+        if (m_curve == ASYMMETRIC)
+        {
+            // Recursive, so stays scalar
+            float x1 = m_dcInput[ch];
+            float y1 = m_dcOutput[ch];
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                const float y = wet[i] - x1 + m_dcCoeff * y1;
+                x1 = wet[i];
+                y1 = y;
+                wet[i] = y;
+            }
+            m_dcInput[ch] = x1;
+            m_dcOutput[ch] = y1;
+        }
+
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            dry[i] = dry[i] * dryGain + wet[i] * wetGain;
+        }
+    }
+};
+
+// Timing helpers for the --bench mode
+namespace Benchmark
+{
+    struct Result
+    {
+        double nsPerSample;
+        double cyclesPerSample; // Negative when no cycle counter is available
+    };
+
+    // Keeps the optimizer from hoisting or discarding the measured work
+    inline void clobber()
+    {
+        asm volatile("" : : : "memory");
+    }
+
+    // Runs fn() `runs` times and reports the cost per processed sample
+    template <typename Fn>
+    Result measure(Fn &&fn, size_t samplesPerRun, int runs)
+    {
+        fn(); // Warm caches and lazily sized buffers
+
+        const auto start = std::chrono::steady_clock::now();
+#if defined(__x86_64__) || defined(__i386__)
+        const uint64_t startCycles = __rdtsc();
+#endif
+        for (int run = 0; run < runs; ++run)
+        {
+            fn();
+            clobber();
+        }
+#if defined(__x86_64__) || defined(__i386__)
+        const double cycles = static_cast<double>(__rdtsc() - startCycles);
+#else
+        const double cycles = -1.0;
+#endif
+        const double ns = std::chrono::duration<double, std::nano>(std::chrono::steady_clock::now() - start).count();
+
+        const double totalSamples = static_cast<double>(samplesPerRun) * runs;
+        return {ns / totalSamples, cycles < 0.0 ? -1.0 : cycles / totalSamples};
+    }
+
+    inline void printRow(const std::string &name, const Result &result, double maxError = -1.0)
+    {
+        std::cout << "  " << std::left << std::setw(28) << name << std::right << std::fixed
+                  << std::setw(10) << std::setprecision(2) << result.nsPerSample;
+        if (result.cyclesPerSample >= 0.0)
+            std::cout << std::setw(12) << std::setprecision(2) << result.cyclesPerSample;
+        else
+            std::cout << std::setw(12) << "n/a";
+        if (maxError >= 0.0)
+            std::cout << std::setw(14) << std::scientific << std::setprecision(2) << maxError;
+        else
+            std::cout << std::setw(14) << "-";
+        std::cout << std::defaultfloat << std::endl;
+    }
+
+    inline void printHeader(const std::string &title)
+    {
+        std::cout << "\n"
+                  << title << std::endl;
+        std::cout << "  " << std::left << std::setw(28) << "variant" << std::right
+                  << std::setw(10) << "ns/smp" << std::setw(12) << "cycles/smp"
+                  << std::setw(14) << "max error" << std::endl;
+    }
+}
+
+// Accuracy versus cost of the tanh approximations, and per-sample cost of
+// each saturation curve with and without ADAA
+void runSaturationBenchmark()
+{
+    constexpr size_t NUM_POINTS = 4096;
+    constexpr int RUNS = 2000;
+
+    std::vector<float> input(NUM_POINTS);
+    std::vector<float> output(NUM_POINTS);
+    for (size_t i = 0; i < NUM_POINTS; ++i)
+    {
+        input[i] = -6.0f + 12.0f * static_cast<float>(i) / (NUM_POINTS - 1);
+    }
+
+    auto maxErrorAgainstTanh = [&]()
+    {
+        double maxError = 0.0;
+        for (size_t i = 0; i < NUM_POINTS; ++i)
+        {
+            maxError = std::max(maxError, std::fabs(static_cast<double>(output[i]) - std::tanh(static_cast<double>(input[i]))));
+        }
+        return maxError;
+    };
+
+    Benchmark::printHeader("tanh approximations (input range +-6)");
+
+    auto result = Benchmark::measure([&]()
+                                     { for (size_t i = 0; i < NUM_POINTS; ++i) output[i] = std::tanh(input[i]); },
+                                     NUM_POINTS, RUNS);
+    Benchmark::printRow("std::tanh", result, maxErrorAgainstTanh());
+
+    result = Benchmark::measure([&]()
+                                { for (size_t i = 0; i < NUM_POINTS; ++i) output[i] = Waveshaper::tanhPade32(input[i]); },
+                                NUM_POINTS, RUNS);
+    Benchmark::printRow("pade [3/2]", result, maxErrorAgainstTanh());
+
+    result = Benchmark::measure([&]()
+                                { for (size_t i = 0; i < NUM_POINTS; ++i) output[i] = Waveshaper::tanhPade76(input[i]); },
+                                NUM_POINTS, RUNS);
+    Benchmark::printRow("pade [7/6]", result, maxErrorAgainstTanh());
+
+    // Full effect cost, stereo 48 kHz periods
+    constexpr size_t FRAMES = 120;
+    constexpr unsigned int CHANNELS = 2;
+    std::vector<int32_t> block(FRAMES * CHANNELS);
+    for (size_t i = 0; i < FRAMES; ++i)
+    {
+        const float value = 0.8f * std::sin(2.0f * static_cast<float>(M_PI) * 1000.0f * i / 48000.0f);
+        block[i * CHANNELS] = block[i * CHANNELS + 1] = static_cast<int32_t>(value * SampleConversion::FLOAT_TO_INT32);
+    }
+    std::vector<int32_t> processed(block.size());
+
+    Benchmark::printHeader("SaturationEffect (stereo, 120-frame periods)");
+
+    const std::array<std::pair<SaturationEffect::Curve, const char *>, 3> curves = {{
+        {SaturationEffect::TANH, "tanh"},
+        {SaturationEffect::SOFT_CLIP, "soft clip"},
+        {SaturationEffect::ASYMMETRIC, "asymmetric"},
+    }};
+
+    for (const auto &curve : curves)
+    {
+        for (bool antialiasing : {false, true})
+        {
+            SaturationEffect saturation(curve.first, 12.0f);
+            saturation.setAntialiasing(antialiasing);
+            result = Benchmark::measure([&]()
+                                        { saturation.process(block.data(), processed.data(), FRAMES, CHANNELS); },
+                                        FRAMES * CHANNELS, RUNS * 10);
+            Benchmark::printRow(std::string(curve.second) + (antialiasing ? " + ADAA" : ""), result);
+        }
+    }
+}
+
+// Sine LFO generated a block at a time by rotating a (sin, cos) phasor.
+// Costs two multiplies and adds per sample per output; the amplitude is
+// renormalized once per block so rounding cannot make it drift.
+class QuadratureLfo
+{
+private:
+    float m_sin;
+    float m_cos;
+    float m_rotSin;
+    float m_rotCos;
+
+public:
+    QuadratureLfo() : m_sin(0.0f), m_cos(1.0f), m_rotSin(0.0f), m_rotCos(1.0f) {}
+
+    void setFrequency(float frequencyHz, unsigned int sampleRate)
+    {
+        const double omega = 2.0 * M_PI * frequencyHz / sampleRate;
+        m_rotSin = static_cast<float>(std::sin(omega));
+        m_rotCos = static_cast<float>(std::cos(omega));
+    }
+
+    void setPhase(float radians)
+    {
+        m_sin = std::sin(radians);
+        m_cos = std::cos(radians);
+    }
+
+    // The phasor only; the rotation follows from the rate
+    void saveState(EffectStateWriter &out) const
+    {
+        out.write(m_sin);
+        out.write(m_cos);
+    }
+
+    bool restoreState(EffectStateReader &in)
+    {
+        return in.read(m_sin) && in.read(m_cos);
+    }
+
+    void generate(float *output, size_t numSamples)
+    {
+        float s = m_sin;
+        float c = m_cos;
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            output[i] = s;
+            const float nextS = s * m_rotCos + c * m_rotSin;
+            c = c * m_rotCos - s * m_rotSin;
+            s = nextS;
+        }
+
+        // First-order correction towards unit magnitude
+        const float gain = 1.5f - 0.5f * (s * s + c * c);
+        m_sin = s * gain;
+        m_cos = c * gain;
+    }
+};
+
+// Shared engine for chorus, flanger and vibrato: one interpolated delay line
+// per channel read by one or more LFO-modulated voices. Delay and LFO
+// buffers are computed per block, split into chunks shorter than the minimum
+// delay so no voice reads samples the same chunk is still writing.
+class ModulatedDelayEffect : public AudioEffect
+{
+protected:
+    static constexpr size_t MAX_VOICES = 8;
+    static constexpr float MAX_BASE_DELAY_MS = 50.0f;
+    static constexpr float MAX_DEPTH_MS = 20.0f;
+
+    struct Modulation
+    {
+        float baseDelayMs;
+        float depthMs;
+        float rateHz;
+        size_t numVoices;
+    };
+
+    // Control side edits m_pending under m_pendingMutex; the audio thread
+    // copies it into the members below at the start of a block. Lines are
+    // sized for the longest delay any setting reaches, so a change never
+    // reallocates them.
+    Modulation m_pending;
+    std::mutex m_pendingMutex;
+    std::atomic<bool> m_changed{false};
+
+    float m_baseDelayMs;
+    float m_depthMs;
+    float m_rateHz;
+    float m_voiceSpreadMs; // Extra base delay per voice
+    float m_feedback;
+    float m_wetLevel;
+    float m_dryLevel;
+    size_t m_numVoices;
+
+    std::vector<InterpolatedDelayLine> m_delayLines;   // One per channel
+    std::vector<std::vector<QuadratureLfo>> m_lfos;   // [channel][voice]
+    unsigned int m_channels;
+
+    // Block scratch
+    std::vector<float> m_input;
+    std::vector<float> m_wet;
+    std::vector<float> m_delays;
+    std::vector<float> m_voiceOut;
+    size_t m_maxFrames;
+
+    float msToSamples(float ms) const { return ms * 0.001f * static_cast<float>(m_sampleRate); }
+
+    // Shortest delay any voice can reach (voice 0 at the LFO minimum)
+    size_t minDelaySamples() const
+    {
+        return std::max<size_t>(static_cast<size_t>(msToSamples(m_baseDelayMs)), 2);
+    }
+
+    // Room for the longest delay any voice can be set to reach
+    size_t lineLength(float voiceSpreadMs) const
+    {
+        const float maxDelayMs = MAX_BASE_DELAY_MS + MAX_DEPTH_MS + voiceSpreadMs * (MAX_VOICES - 1);
+        return static_cast<size_t>(msToSamples(maxDelayMs)) + 2;
+    }
+
+    void configureDelayLines()
+    {
+        const size_t length = lineLength(m_voiceSpreadMs);
+        for (auto &line : m_delayLines)
+        {
+            line.setMaxDelay(length);
+        }
+    }
+
+    void configureLfos()
+    {
+        for (size_t ch = 0; ch < m_lfos.size(); ++ch)
+        {
+            for (size_t v = 0; v < m_lfos[ch].size(); ++v)
+            {
+                // Voices spread evenly around the cycle; odd channels in quadrature
+                const float phase = 2.0f * static_cast<float>(M_PI) * v / m_numVoices +
+                                    ((ch & 1) ? 0.5f * static_cast<float>(M_PI) : 0.0f);
+                m_lfos[ch][v].setFrequency(m_rateHz, m_sampleRate);
+                m_lfos[ch][v].setPhase(phase);
+            }
+        }
+    }
+
+    void ensureChannels(unsigned int channels)
+    {
+        if (channels == m_channels)
+        {
+            return;
+        }
+        m_channels = channels;
+        m_delayLines.assign(channels, InterpolatedDelayLine());
+        m_lfos.assign(channels, std::vector<QuadratureLfo>(MAX_VOICES));
+        configureDelayLines();
+        configureLfos();
+    }
+
+    void ensureBuffers(size_t numFrames)
+    {
+        if (numFrames > m_maxFrames)
+        {
+            m_maxFrames = numFrames;
+            m_input.resize(numFrames);
+            m_wet.resize(numFrames);
+            m_delays.resize(numFrames);
+            m_voiceOut.resize(numFrames);
+        }
+    }
+
+    void postModulation()
+    {
+        m_changed.store(true, std::memory_order_release);
+    }
+
+    // Audio thread: take the latest settings if the control side isn't
+    // editing them. The LFOs restart when their rate or voice count moves.
+    void acceptPending()
+    {
+        if (!m_changed.load(std::memory_order_acquire) || !m_pendingMutex.try_lock())
+            return;
+
+        const Modulation pending = m_pending;
+        m_changed.store(false, std::memory_order_relaxed);
+        m_pendingMutex.unlock();
+
+        const bool lfosChanged = pending.rateHz != m_rateHz || pending.numVoices != m_numVoices;
+        m_baseDelayMs = pending.baseDelayMs;
+        m_depthMs = pending.depthMs;
+        m_rateHz = pending.rateHz;
+        m_numVoices = pending.numVoices;
+        if (lfosChanged)
+        {
+            configureLfos();
+        }
+    }
+
+public:
+    ModulatedDelayEffect(float baseDelayMs, float depthMs, float rateHz, size_t numVoices,
+                         float feedback, float wetLevel, float dryLevel)
+        : m_baseDelayMs(baseDelayMs), m_depthMs(depthMs), m_rateHz(rateHz), m_voiceSpreadMs(0.0f),
+          m_feedback(feedback), m_wetLevel(wetLevel), m_dryLevel(dryLevel),
+          m_numVoices(std::clamp<size_t>(numVoices, 1, MAX_VOICES)), m_channels(0), m_maxFrames(0)
+    {
+        m_pending = {m_baseDelayMs, m_depthMs, m_rateHz, m_numVoices};
+    }
+
+    void setBaseDelay(float delayMs)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.baseDelayMs = std::clamp(delayMs, 0.1f, MAX_BASE_DELAY_MS);
+        postModulation();
+    }
+
+    void setDepth(float depthMs)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.depthMs = std::clamp(depthMs, 0.0f, MAX_DEPTH_MS);
+        postModulation();
+    }
+
+    void setRate(float rateHz)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.rateHz = std::clamp(rateHz, 0.01f, 20.0f);
+        postModulation();
+    }
+
+    void setFeedback(float feedback)
+    {
+        // Negative feedback gives the hollow flanger colour
+        m_feedback = std::clamp(feedback, -0.95f, 0.95f);
+    }
+
+    void setMix(float wetLevel, float dryLevel)
+    {
+        m_wetLevel = std::clamp(wetLevel, 0.0f, 1.0f);
+        m_dryLevel = std::clamp(dryLevel, 0.0f, 1.0f);
+    }
+
+    // Control-side view of the modulation
+    float getBaseDelay() const { return m_pending.baseDelayMs; }
+    float getDepth() const { return m_pending.depthMs; }
+    float getRate() const { return m_pending.rateHz; }
+    float getFeedback() const { return m_feedback; }
+    float getWetLevel() const { return m_wetLevel; }
+    float getDryLevel() const { return m_dryLevel; }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        AudioEffect::setSampleRate(sampleRate);
+        configureDelayLines();
+        configureLfos();
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        ensureChannels(channels);
+        ensureBuffers(maxFrames);
+    }
+
+    void reset() override
+    {
+        for (auto &line : m_delayLines)
+        {
+            line.clear();
+        }
+        configureLfos();
+    }
+
+    // Parameters as last set, every channel's line and each voice's LFO
+    // phase
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(m_pending.baseDelayMs);
+        out.write(m_pending.depthMs);
+        out.write(m_pending.rateHz);
+        out.write(m_voiceSpreadMs);
+        out.write(m_feedback);
+        out.write(m_wetLevel);
+        out.write(m_dryLevel);
+        out.write(static_cast<uint64_t>(m_pending.numVoices));
+        out.write(m_channels);
+        for (const auto &line : m_delayLines)
+        {
+            line.saveState(out);
+        }
+        for (const auto &voices : m_lfos)
+        {
+            for (const auto &lfo : voices)
+                lfo.saveState(out);
+        }
+    }
+
+    // Lines and LFOs are read into new ones sized from the stored
+    // parameters, which replace the current ones once the record has read
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        float baseDelayMs = 0.0f;
+        float depthMs = 0.0f;
+        float rateHz = 0.0f;
+        float voiceSpreadMs = 0.0f;
+        float feedback = 0.0f;
+        float wetLevel = 0.0f;
+        float dryLevel = 0.0f;
+        uint64_t numVoices = 0;
+        unsigned int channels = 0;
+        if (!in.read(enabled) || !in.read(baseDelayMs) || !in.read(depthMs) || !in.read(rateHz) ||
+            !in.read(voiceSpreadMs) || !in.read(feedback) || !in.read(wetLevel) || !in.read(dryLevel) ||
+            !in.read(numVoices) || !in.read(channels))
+            return false;
+        if (numVoices < 1 || numVoices > MAX_VOICES || channels > MAX_SNAPSHOT_CHANNELS ||
+            !(baseDelayMs >= 0.1f && baseDelayMs <= MAX_BASE_DELAY_MS) ||
+            !(depthMs >= 0.0f && depthMs <= MAX_DEPTH_MS) || !(voiceSpreadMs >= 0.0f && voiceSpreadMs <= 50.0f))
+            return false;
+
+        std::vector<InterpolatedDelayLine> lines(channels);
+        const size_t length = lineLength(voiceSpreadMs);
+        for (auto &line : lines)
+        {
+            line.setMaxDelay(length);
+            if (!line.restoreState(in))
+                return false;
+        }
+        std::vector<std::vector<QuadratureLfo>> lfos(channels, std::vector<QuadratureLfo>(MAX_VOICES));
+        for (auto &voices : lfos)
+        {
+            for (auto &lfo : voices)
+            {
+                if (!lfo.restoreState(in))
+                    return false;
+            }
+        }
+
+        m_enabled = enabled;
+        m_baseDelayMs = baseDelayMs;
+        m_depthMs = depthMs;
+        m_rateHz = std::clamp(rateHz, 0.01f, 20.0f);
+        m_voiceSpreadMs = voiceSpreadMs;
+        setFeedback(feedback);
+        setMix(wetLevel, dryLevel);
+        m_numVoices = numVoices;
+        m_channels = channels;
+        m_delayLines = std::move(lines);
+        m_lfos = std::move(lfos);
+        for (auto &voices : m_lfos)
+        {
+            for (auto &lfo : voices)
+                lfo.setFrequency(m_rateHz, m_sampleRate);
+        }
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_pending = {m_baseDelayMs, m_depthMs, m_rateHz, m_numVoices};
+            m_changed.store(false, std::memory_order_relaxed);
+        }
+        return true;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels == 0)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        acceptPending();
+        ensureChannels(channels);
+        ensureBuffers(numSamples);
+
+        const float baseDelay = msToSamples(m_baseDelayMs);
+        const float depth = msToSamples(m_depthMs);
+        const float voiceSpread = msToSamples(m_voiceSpreadMs);
+        const float voiceGain = 1.0f / static_cast<float>(m_numVoices);
+        const size_t maxChunk = minDelaySamples() - 1;
+
+        float *input = m_input.data();
+        float *wet = m_wet.data();
+        float *delays = m_delays.data();
+        float *voiceOut = m_voiceOut.data();
+
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            InterpolatedDelayLine &line = m_delayLines[ch];
+            SampleConversion::deinterleave(inputBuffer, input, numSamples, channels, ch);
+
+            for (size_t start = 0; start < numSamples; start += maxChunk)
+            {
+                const size_t count = std::min(maxChunk, numSamples - start);
+                float *chunkWet = wet + start;
+                std::fill(chunkWet, chunkWet + count, 0.0f);
+
+                for (size_t v = 0; v < m_numVoices; ++v)
+                {
+                    // LFO in [-1, 1] -> delay in [base, base + depth]
+                    m_lfos[ch][v].generate(delays, count);
+                    const float voiceBase = baseDelay + voiceSpread * v + 0.5f * depth;
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        delays[i] = voiceBase + 0.5f * depth * delays[i];
+                    }
+
+                    line.readCubic(delays, voiceOut, count);
+                    for (size_t i = 0; i < count; ++i)
+                    {
+                        chunkWet[i] += voiceGain * voiceOut[i];
+                    }
+                }
+
+                // Write input plus feedback; voiceOut is free again as scratch
+                const float *chunkIn = input + start;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    voiceOut[i] = chunkIn[i] + m_feedback * chunkWet[i];
+                }
+                line.write(voiceOut, count);
+            }
+
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                input[i] = input[i] * m_dryLevel + wet[i] * m_wetLevel;
+            }
+            SampleConversion::interleave(input, outputBuffer, numSamples, channels, ch);
+        }
+    }
+};
+
+// Multi-voice chorus: several slowly modulated 10-30 ms delays
+class ChorusEffect : public ModulatedDelayEffect
+{
+public:
+    ChorusEffect(size_t numVoices = 3, float rateHz = 0.8f, float depthMs = 3.0f)
+        : ModulatedDelayEffect(12.0f, depthMs, rateHz, numVoices, 0.0f, 0.5f, 0.7f)
+    {
+        m_voiceSpreadMs = 4.0f;
+    }
+
+    void setVoices(size_t numVoices)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending.numVoices = std::clamp<size_t>(numVoices, 1, MAX_VOICES);
+        postModulation();
+    }
+
+    size_t getVoices() const { return m_pending.numVoices; }
+};
+
+// Flanger: one short swept delay with (optionally negative) feedback
+class FlangerEffect : public ModulatedDelayEffect
+{
+public:
+    FlangerEffect(float rateHz = 0.25f, float depthMs = 2.0f, float feedback = 0.5f)
+        : ModulatedDelayEffect(1.0f, depthMs, rateHz, 1, feedback, 0.5f, 0.5f)
+    {
+    }
+};
+
+// Vibrato: pitch modulation only, fully wet
+class VibratoEffect : public ModulatedDelayEffect
+{
+public:
+    VibratoEffect(float rateHz = 5.0f, float depthMs = 1.5f)
+        : ModulatedDelayEffect(2.0f, depthMs, rateHz, 1, 0.0f, 1.0f, 0.0f)
+    {
+    }
+};
+
+// Multi-tap echo: every tap reads the same per-channel write buffer, so N taps
+// cost N contiguous multiply-adds per channel instead of N full delay effects.
+// Ping-pong taps read the partner channel of a stereo pair, and each tap can
+// feed its output back into the buffer of the channel it plays on.
+class MultiTapDelayEffect : public AudioEffect
+{
+public:
+    struct Tap
+    {
+        float delayMs;
+        float gain;
+        float pan;      // -1 (left) .. 1 (right), equal-power
+        float feedback; // Amount of this tap written back into the buffer
+        bool pingPong;  // Read from the opposite channel of the pair
+    };
+
+    static constexpr size_t MAX_TAPS = 16;
+    static constexpr float MAX_TAP_DELAY_MS = 4000.0f;
+    // Bound on the summed gain * feedback of all taps. Every buffer is fed
+    // by at most that much of the delayed signal, so the loop decays
+    // whatever the tap layout is.
+    static constexpr float MAX_LOOP_GAIN = 0.95f;
+
+private:
+    // Control side edits m_taps under m_pendingMutex; the audio thread copies
+    // it into m_activeTaps at the start of a block
+    std::vector<Tap> m_taps;
+    mutable std::mutex m_pendingMutex;
+    std::atomic<bool> m_changed;
+
+    std::vector<Tap> m_activeTaps;
+    std::vector<size_t> m_tapDelays;     // Tap delays in samples
+    std::vector<float> m_feedbackGains;  // gain * feedback, normalized to MAX_LOOP_GAIN
+    std::vector<InterpolatedDelayLine> m_delayLines;
+    float m_wetLevel;
+    float m_dryLevel;
+    unsigned int m_channels;
+
+    // Planar block scratch, [channel][frame]
+    std::vector<std::vector<float>> m_input;
+    std::vector<std::vector<float>> m_wet;
+    std::vector<std::vector<float>> m_feedback;
+    size_t m_maxFrames;
+
+    size_t maxDelaySamples() const
+    {
+        return static_cast<size_t>((MAX_TAP_DELAY_MS / 1000.0f) * m_sampleRate) + 1;
+    }
+
+    void markChanged()
+    {
+        m_changed.store(true, std::memory_order_release);
+    }
+
+    static Tap clampTap(const Tap &tap)
+    {
+        return {std::clamp(tap.delayMs, 1.0f, MAX_TAP_DELAY_MS),
+                std::clamp(tap.gain, 0.0f, 1.0f),
+                std::clamp(tap.pan, -1.0f, 1.0f),
+                std::clamp(tap.feedback, 0.0f, 0.95f),
+                tap.pingPong};
+    }
+
+    // Audio thread: take the latest tap set if the control side isn't
+    // editing it. Lines are sized for MAX_TAP_DELAY_MS, so a tap change
+    // never reallocates them; only a sample rate change can grow them.
+    void acceptPending()
+    {
+        if (!m_changed.load(std::memory_order_acquire) || !m_pendingMutex.try_lock())
+            return;
+
+        m_activeTaps.assign(m_taps.begin(), m_taps.end());
+        m_changed.store(false, std::memory_order_relaxed);
+        m_pendingMutex.unlock();
+
+        const size_t tapCount = m_activeTaps.size();
+        m_tapDelays.resize(tapCount);
+        m_feedbackGains.resize(tapCount);
+        float loopGain = 0.0f;
+        for (size_t i = 0; i < tapCount; ++i)
+        {
+            m_tapDelays[i] = std::max<size_t>(1, static_cast<size_t>((m_activeTaps[i].delayMs / 1000.0f) * m_sampleRate));
+            m_feedbackGains[i] = m_activeTaps[i].gain * m_activeTaps[i].feedback;
+            loopGain += m_feedbackGains[i];
+        }
+        if (loopGain > MAX_LOOP_GAIN)
+        {
+            const float scale = MAX_LOOP_GAIN / loopGain;
+            for (float &gain : m_feedbackGains)
+            {
+                gain *= scale;
+            }
+        }
+
+        const size_t maxDelay = maxDelaySamples();
+        for (auto &line : m_delayLines)
+        {
+            if (line.getMaxDelay() < maxDelay)
+            {
+                line.setMaxDelay(maxDelay);
+            }
+        }
+    }
+
+    size_t minTapDelay() const
+    {
+        size_t minDelay = SIZE_MAX;
+        for (size_t delay : m_tapDelays)
+        {
+            minDelay = std::min(minDelay, delay);
+        }
+        return minDelay;
+    }
+
+    // Equal-power pan gain for a channel; channels pair up as L/R
+    float panGain(const Tap &tap, unsigned int channel, unsigned int channels) const
+    {
+        if (channels < 2 || (channel == channels - 1 && (channels & 1)))
+        {
+            return 1.0f;
+        }
+        const float angle = (tap.pan + 1.0f) * 0.25f * static_cast<float>(M_PI);
+        return (channel & 1) ? std::sin(angle) : std::cos(angle);
+    }
+
+    unsigned int partnerChannel(unsigned int channel, unsigned int channels) const
+    {
+        const unsigned int partner = channel ^ 1u;
+        return partner < channels ? partner : channel;
+    }
+
+    void ensureBuffers(size_t numFrames, unsigned int channels)
+    {
+        if (channels != m_channels)
+        {
+            m_channels = channels;
+            m_delayLines.assign(channels, InterpolatedDelayLine(maxDelaySamples()));
+            m_maxFrames = 0;
+        }
+        if (numFrames > m_maxFrames)
+        {
+            m_maxFrames = numFrames;
+            m_input.assign(channels, std::vector<float>(numFrames, 0.0f));
+            m_wet.assign(channels, std::vector<float>(numFrames, 0.0f));
+            m_feedback.assign(channels, std::vector<float>(numFrames, 0.0f));
+        }
+    }
+
+public:
+    MultiTapDelayEffect(float wetLevel = 0.4f, float dryLevel = 0.7f)
+        : m_changed(false), m_wetLevel(wetLevel), m_dryLevel(dryLevel), m_channels(0), m_maxFrames(0)
+    {
+        m_taps.reserve(MAX_TAPS);
+        m_activeTaps.reserve(MAX_TAPS);
+        m_tapDelays.reserve(MAX_TAPS);
+        m_feedbackGains.reserve(MAX_TAPS);
+    }
+
+    // Returns the index of the new tap, or MAX_TAPS if full
+    size_t addTap(const Tap &tap)
+    {
+        size_t index;
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            if (m_taps.size() >= MAX_TAPS)
+            {
+                return MAX_TAPS;
+            }
+            m_taps.push_back(tap);
+            index = m_taps.size() - 1;
+        }
+        setTap(index, tap);
+        return index;
+    }
+
+    void setTap(size_t index, const Tap &tap)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        if (index >= m_taps.size())
+        {
+            return;
+        }
+        m_taps[index] = clampTap(tap);
+        markChanged();
+    }
+
+    void removeTap(size_t index)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        if (index < m_taps.size())
+        {
+            m_taps.erase(m_taps.begin() + index);
+            markChanged();
+        }
+    }
+
+    void clearTaps()
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_taps.clear();
+        markChanged();
+    }
+
+    // Control-side view of the taps
+    size_t getTapCount() const { return m_taps.size(); }
+    const Tap &getTap(size_t index) const { return m_taps[index]; }
+
+    void setMix(float wetLevel, float dryLevel)
+    {
+        m_wetLevel = std::clamp(wetLevel, 0.0f, 1.0f);
+        m_dryLevel = std::clamp(dryLevel, 0.0f, 1.0f);
+    }
+
+    float getWetLevel() const { return m_wetLevel; }
+    float getDryLevel() const { return m_dryLevel; }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        AudioEffect::setSampleRate(sampleRate);
+        markChanged();
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        ensureBuffers(maxFrames, channels);
+    }
+
+    void reset() override
+    {
+        for (auto &line : m_delayLines)
+        {
+            line.clear();
+        }
+    }
+
+    // Mix, the control-side taps and every channel's line. Lines are always
+    // MAX_TAP_DELAY_MS long, so they only restore at the same sample rate.
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(m_wetLevel);
+        out.write(m_dryLevel);
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            out.writeArray(m_taps);
+        }
+        out.write(m_channels);
+        for (const auto &line : m_delayLines)
+        {
+            line.saveState(out);
+        }
+    }
+
+    // The taps reach the audio thread like any other edit, at the next block
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        float wetLevel = 0.0f;
+        float dryLevel = 0.0f;
+        std::vector<Tap> taps;
+        unsigned int channels = 0;
+        if (!in.read(enabled) || !in.read(wetLevel) || !in.read(dryLevel) || !in.readArray(taps) ||
+            !in.read(channels) || taps.size() > MAX_TAPS || channels > MAX_SNAPSHOT_CHANNELS)
+            return false;
+
+        std::vector<InterpolatedDelayLine> lines(channels, InterpolatedDelayLine(maxDelaySamples()));
+        for (auto &line : lines)
+        {
+            if (!line.restoreState(in))
+                return false;
+        }
+
+        m_enabled = enabled;
+        setMix(wetLevel, dryLevel);
+        if (channels != m_channels)
+        {
+            // As ensureBuffers() does: the scratch follows at the next block
+            m_channels = channels;
+            m_maxFrames = 0;
+        }
+        m_delayLines = std::move(lines);
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_taps.clear();
+            for (const Tap &tap : taps)
+            {
+                m_taps.push_back(clampTap(tap));
+            }
+            markChanged();
+        }
+        return true;
+    }
+
+    bool isBypassed(unsigned int channels) const override
+    {
+        return !m_enabled || channels == 0 ||
+               (m_activeTaps.empty() && !m_changed.load(std::memory_order_acquire));
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (m_enabled && channels != 0)
+        {
+            ensureBuffers(numSamples, channels);
+            acceptPending();
+        }
+
+        if (!m_enabled || channels == 0 || m_activeTaps.empty())
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            SampleConversion::deinterleave(inputBuffer, m_input[ch].data(), numSamples, channels, ch);
+            std::fill(m_wet[ch].begin(), m_wet[ch].begin() + numSamples, 0.0f);
+        }
+
+        // Taps may be shorter than a period; chunk so reads never reach
+        // samples the current chunk is about to write
+        const size_t maxChunk = minTapDelay();
+
+        for (size_t start = 0; start < numSamples; start += maxChunk)
+        {
+            const size_t count = std::min(maxChunk, numSamples - start);
+
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                float *wet = m_wet[ch].data() + start;
+                float *feedback = m_feedback[ch].data();
+                std::fill(feedback, feedback + count, 0.0f);
+
+                for (size_t t = 0; t < m_activeTaps.size(); ++t)
+                {
+                    const Tap &tap = m_activeTaps[t];
+                    const unsigned int source = tap.pingPong ? partnerChannel(ch, channels) : ch;
+                    const InterpolatedDelayLine &line = m_delayLines[source];
+
+                    line.mixDelayed(m_tapDelays[t], tap.gain * panGain(tap, ch, channels), wet, count);
+                    if (m_feedbackGains[t] > 0.0f)
+                    {
+                        line.mixDelayed(m_tapDelays[t], m_feedbackGains[t], feedback, count);
+                    }
+                }
+            }
+
+            // All reads for this chunk are done; now extend every buffer
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                float *feedback = m_feedback[ch].data();
+                const float *input = m_input[ch].data() + start;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    feedback[i] += input[i];
+                }
+                m_delayLines[ch].write(feedback, count);
+            }
+        }
+
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            float *input = m_input[ch].data();
+            const float *wet = m_wet[ch].data();
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                input[i] = input[i] * m_dryLevel + wet[i] * m_wetLevel;
+            }
+            SampleConversion::interleave(input, outputBuffer, numSamples, channels, ch);
+        }
+    }
+};
+
+// Radix-2 FFT on planar (split real/imaginary) arrays, so butterflies and
+// the per-bin stages of callers are contiguous float loops that vectorize.
+// Real transforms of size N run as one complex transform of size N / 2.
+class FFT
+{
+private:
+    size_t m_size;     // Real transform size N
+    size_t m_halfSize; // Complex transform size N / 2
+    std::vector<float> m_cos;
+    std::vector<float> m_sin;
+    std::vector<float> m_postCos; // e^{-2 pi i k / N}, real split/merge twiddles
+    std::vector<float> m_postSin;
+    std::vector<size_t> m_bitReverse;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+
+    // In-place complex transform of size m_halfSize; sign -1 forward, +1 inverse
+    void transform(float *re, float *im, float sign) const
+    {
+        const size_t n = m_halfSize;
+        for (size_t i = 0; i < n; ++i)
+        {
+            const size_t j = m_bitReverse[i];
+            if (j > i)
+            {
+                std::swap(re[i], re[j]);
+                std::swap(im[i], im[j]);
+            }
+        }
+
+        for (size_t span = 1; span < n; span <<= 1)
+        {
+            const size_t stride = n / (2 * span);
+            for (size_t start = 0; start < n; start += 2 * span)
+            {
+                float *aRe = re + start;
+                float *aIm = im + start;
+                float *bRe = aRe + span;
+                float *bIm = aIm + span;
+                for (size_t k = 0; k < span; ++k)
+                {
+                    const float wRe = m_cos[k * stride];
+                    const float wIm = sign * m_sin[k * stride];
+                    const float tRe = bRe[k] * wRe - bIm[k] * wIm;
+                    const float tIm = bRe[k] * wIm + bIm[k] * wRe;
+                    bRe[k] = aRe[k] - tRe;
+                    bIm[k] = aIm[k] - tIm;
+                    aRe[k] += tRe;
+                    aIm[k] += tIm;
+                }
+            }
+        }
+    }
+
+public:
+    // size must be a power of two >= 4
+    explicit FFT(size_t size)
+        : m_size(size), m_halfSize(size / 2)
+    {
+        m_cos.resize(m_halfSize);
+        m_sin.resize(m_halfSize);
+        for (size_t k = 0; k < m_halfSize; ++k)
+        {
+            const double angle = 2.0 * M_PI * k / m_halfSize;
+            m_cos[k] = static_cast<float>(std::cos(angle));
+            m_sin[k] = static_cast<float>(std::sin(angle));
+        }
+
+        m_postCos.resize(m_halfSize + 1);
+        m_postSin.resize(m_halfSize + 1);
+        for (size_t k = 0; k <= m_halfSize; ++k)
+        {
+            const double angle = 2.0 * M_PI * k / m_size;
+            m_postCos[k] = static_cast<float>(std::cos(angle));
+            m_postSin[k] = static_cast<float>(-std::sin(angle));
+        }
+
+        size_t bits = 0;
+        while ((size_t(1) << bits) < m_halfSize)
+        {
+            ++bits;
+        }
+        m_bitReverse.resize(m_halfSize);
+        for (size_t i = 0; i < m_halfSize; ++i)
+        {
+            size_t reversed = 0;
+            for (size_t b = 0; b < bits; ++b)
+            {
+                reversed |= ((i >> b) & 1) << (bits - 1 - b);
+            }
+            m_bitReverse[i] = reversed;
+        }
+
+        m_re.resize(m_halfSize);
+        m_im.resize(m_halfSize);
+    }
+
+    size_t getSize() const { return m_size; }
+    size_t getNumBins() const { return m_halfSize + 1; }
+
+    // input: N real samples; re/im: N / 2 + 1 bins (unnormalized)
+    void forward(const float *input, float *re, float *im)
+    {
+        float *zRe = m_re.data();
+        float *zIm = m_im.data();
+        for (size_t m = 0; m < m_halfSize; ++m)
+        {
+            zRe[m] = input[2 * m];
+            zIm[m] = input[2 * m + 1];
+        }
+        transform(zRe, zIm, -1.0f);
+
+        // Split the packed spectrum into the even/odd sample spectra
+        for (size_t k = 0; k <= m_halfSize; ++k)
+        {
+            const size_t a = (k == m_halfSize) ? 0 : k;
+            const size_t b = (k == 0) ? 0 : m_halfSize - k;
+            const float evenRe = 0.5f * (zRe[a] + zRe[b]);
+            const float evenIm = 0.5f * (zIm[a] - zIm[b]);
+            const float oddRe = 0.5f * (zIm[a] + zIm[b]);
+            const float oddIm = -0.5f * (zRe[a] - zRe[b]);
+            re[k] = evenRe + m_postCos[k] * oddRe - m_postSin[k] * oddIm;
+            im[k] = evenIm + m_postCos[k] * oddIm + m_postSin[k] * oddRe;
+        }
+    }
+
+    // re/im: N / 2 + 1 bins; output: N real samples, scaled by 1 / N
+    void inverse(const float *re, const float *im, float *output)
+    {
+        float *zRe = m_re.data();
+        float *zIm = m_im.data();
+        for (size_t k = 0; k < m_halfSize; ++k)
+        {
+            const size_t b = m_halfSize - k;
+            const float evenRe = 0.5f * (re[k] + re[b]);
+            const float evenIm = 0.5f * (im[k] - im[b]);
+            const float diffRe = 0.5f * (re[k] - re[b]);
+            const float diffIm = 0.5f * (im[k] + im[b]);
+            // Undo the twiddle: multiply by e^{+2 pi i k / N}
+            const float oddRe = diffRe * m_postCos[k] + diffIm * m_postSin[k];
+            const float oddIm = diffIm * m_postCos[k] - diffRe * m_postSin[k];
+            zRe[k] = evenRe - oddIm;
+            zIm[k] = evenIm + oddRe;
+        }
+        transform(zRe, zIm, 1.0f);
+
+        const float scale = 1.0f / static_cast<float>(m_halfSize);
+        for (size_t m = 0; m < m_halfSize; ++m)
+        {
+            output[2 * m] = zRe[m] * scale;
+            output[2 * m + 1] = zIm[m] * scale;
+        }
+    }
+};
+
+// STFT spectral gating for stationary background noise (HVAC, fans).
+// Frames of WINDOW_LENGTH samples (two 120-frame periods) are zero-padded to
+// the FFT size, hop is a quarter window, and sqrt-Hann windows on both sides
+// give perfect reconstruction when the gains are 1. The noise floor per bin
+// is tracked by minimum statistics: the minimum of the smoothed power over
+// ~1.5 s, kept as a ring of sub-window minima so each update is O(1) per bin.
+class NoiseSuppressionEffect : public AudioEffect
+{
+private:
+    static constexpr size_t FFT_SIZE = 256;
+    static constexpr size_t WINDOW_LENGTH = 240;
+    static constexpr size_t HOP_SIZE = WINDOW_LENGTH / 4;
+    static constexpr size_t NUM_BINS = FFT_SIZE / 2 + 1;
+
+    // Minimum statistics: NUM_SUBWINDOWS x SUBWINDOW_FRAMES hops (~1.5 s at 48 kHz)
+    static constexpr size_t NUM_SUBWINDOWS = 8;
+    static constexpr size_t SUBWINDOW_FRAMES = 150;
+    static constexpr float POWER_SMOOTHING = 0.96f;
+    static constexpr float MINIMUM_BIAS = 4.0f; // The minimum underestimates the mean noise power
+    static constexpr float GAIN_ATTACK = 0.6f;  // Gain smoothing when opening
+    static constexpr float GAIN_RELEASE = 0.15f; // Gain smoothing when closing
+
+    struct ChannelState
+    {
+        std::vector<float> input;  // Last WINDOW_LENGTH input samples
+        std::vector<float> overlap; // Overlap-add accumulator
+        std::vector<float> ready;  // Finished output for the current hop
+        std::vector<float> smoothedPower;
+        std::vector<float> subwindowMin;
+        std::vector<float> windowMin;
+        std::vector<std::vector<float>> subwindowHistory;
+        std::vector<float> gain;
+        size_t hopPosition = 0;
+        size_t subwindowFrames = 0;
+        size_t subwindowIndex = 0;
+        bool primed = false;
+    };
+
+    FFT m_fft;
+    std::vector<float> m_window;
+    std::vector<ChannelState> m_states;
+
+    // Frame scratch
+    std::vector<float> m_frame;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+    std::vector<float> m_power;
+
+    float m_floorGain;
+    float m_overSubtraction;
+
+    void initChannel(ChannelState &state)
+    {
+        state.input.assign(WINDOW_LENGTH, 0.0f);
+        state.overlap.assign(WINDOW_LENGTH, 0.0f);
+        state.ready.assign(HOP_SIZE, 0.0f);
+        state.smoothedPower.assign(NUM_BINS, 0.0f);
+        state.subwindowMin.assign(NUM_BINS, 0.0f);
+        state.windowMin.assign(NUM_BINS, 0.0f);
+        state.subwindowHistory.assign(NUM_SUBWINDOWS, std::vector<float>(NUM_BINS, 0.0f));
+        state.gain.assign(NUM_BINS, 1.0f);
+        state.hopPosition = 0;
+        state.subwindowFrames = 0;
+        state.subwindowIndex = 0;
+        state.primed = false;
+    }
+
+    void updateNoiseEstimate(ChannelState &state)
+    {
+        const float *power = m_power.data();
+        float *smoothed = state.smoothedPower.data();
+        float *subMin = state.subwindowMin.data();
+
+        if (!state.primed)
+        {
+            // Seed every sub-window from the first frame so gating starts at once
+            std::copy(power, power + NUM_BINS, smoothed);
+            std::copy(power, power + NUM_BINS, subMin);
+            std::copy(power, power + NUM_BINS, state.windowMin.begin());
+            for (auto &history : state.subwindowHistory)
+            {
+                std::copy(power, power + NUM_BINS, history.begin());
+            }
+            state.primed = true;
+        }
+
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            smoothed[k] = POWER_SMOOTHING * smoothed[k] + (1.0f - POWER_SMOOTHING) * power[k];
+            subMin[k] = std::min(subMin[k], smoothed[k]);
+        }
+
+        if (++state.subwindowFrames == SUBWINDOW_FRAMES)
+        {
+            // Retire the oldest sub-window and rebuild the window minimum
+            std::copy(subMin, subMin + NUM_BINS, state.subwindowHistory[state.subwindowIndex].begin());
+            state.subwindowIndex = (state.subwindowIndex + 1) % NUM_SUBWINDOWS;
+
+            float *windowMin = state.windowMin.data();
+            std::copy(state.subwindowHistory[0].begin(), state.subwindowHistory[0].end(), windowMin);
+            for (size_t u = 1; u < NUM_SUBWINDOWS; ++u)
+            {
+                const float *history = state.subwindowHistory[u].data();
+                for (size_t k = 0; k < NUM_BINS; ++k)
+                {
+                    windowMin[k] = std::min(windowMin[k], history[k]);
+                }
+            }
+
+            std::copy(smoothed, smoothed + NUM_BINS, subMin);
+            state.subwindowFrames = 0;
+        }
+    }
+
+    void processFrame(ChannelState &state)
+    {
+        float *frame = m_frame.data();
+        float *re = m_re.data();
+        float *im = m_im.data();
+        float *power = m_power.data();
+
+        for (size_t i = 0; i < WINDOW_LENGTH; ++i)
+        {
+            frame[i] = state.input[i] * m_window[i];
+        }
+        std::fill(frame + WINDOW_LENGTH, frame + FFT_SIZE, 0.0f);
+        m_fft.forward(frame, re, im);
+
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            power[k] = re[k] * re[k] + im[k] * im[k];
+        }
+
+        updateNoiseEstimate(state);
+
+        // Power subtraction gain, floored, then smoothed over time to avoid
+        // musical noise: fast to open, slow to close
+        const float *windowMin = state.windowMin.data();
+        const float *subMin = state.subwindowMin.data();
+        float *gain = state.gain.data();
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            const float noise = MINIMUM_BIAS * std::min(windowMin[k], subMin[k]);
+            const float target = std::max(m_floorGain, 1.0f - m_overSubtraction * noise / (power[k] + 1.0e-20f));
+            const float rate = target > gain[k] ? GAIN_ATTACK : GAIN_RELEASE;
+            gain[k] += rate * (target - gain[k]);
+            re[k] *= gain[k];
+            im[k] *= gain[k];
+        }
+
+        m_fft.inverse(re, im, frame);
+
+        // Synthesis window; sqrt-Hann squared at quarter-window hop sums to 2
+        float *overlap = state.overlap.data();
+        for (size_t i = 0; i < WINDOW_LENGTH; ++i)
+        {
+            overlap[i] += frame[i] * m_window[i] * 0.5f;
+        }
+
+        std::copy(overlap, overlap + HOP_SIZE, state.ready.begin());
+        std::copy(overlap + HOP_SIZE, overlap + WINDOW_LENGTH, overlap);
+        std::fill(overlap + WINDOW_LENGTH - HOP_SIZE, overlap + WINDOW_LENGTH, 0.0f);
+        std::copy(state.input.begin() + HOP_SIZE, state.input.end(), state.input.begin());
+    }
+
+public:
+    NoiseSuppressionEffect(float reductionDb = 18.0f, float overSubtraction = 1.5f)
+        : m_fft(FFT_SIZE)
+    {
+        m_window.resize(WINDOW_LENGTH);
+        for (size_t i = 0; i < WINDOW_LENGTH; ++i)
+        {
+            // Periodic sqrt-Hann
+            m_window[i] = std::sqrt(0.5f - 0.5f * std::cos(2.0f * static_cast<float>(M_PI) * i / WINDOW_LENGTH));
+        }
+        m_frame.resize(FFT_SIZE);
+        m_re.resize(NUM_BINS);
+        m_im.resize(NUM_BINS);
+        m_power.resize(NUM_BINS);
+
+        setReduction(reductionDb);
+        setOverSubtraction(overSubtraction);
+    }
+
+    // Maximum attenuation applied to noise-only bins
+    void setReduction(float reductionDb)
+    {
+        reductionDb = std::clamp(reductionDb, 0.0f, 40.0f);
+        m_floorGain = std::pow(10.0f, -reductionDb / 20.0f);
+    }
+
+    // How aggressively the noise estimate is subtracted (1.0 = plain subtraction)
+    void setOverSubtraction(float factor) { m_overSubtraction = std::clamp(factor, 0.5f, 4.0f); }
+
+    float getReduction() const { return -20.0f * std::log10(m_floorGain); }
+    float getOverSubtraction() const { return m_overSubtraction; }
+
+    size_t getLatency() const override { return WINDOW_LENGTH; }
+
+    void prepare(size_t /*maxFrames*/, unsigned int channels) override
+    {
+        ensureChannels(channels);
+    }
+
+    void reset() override
+    {
+        for (auto &state : m_states)
+        {
+            initChannel(state);
+        }
+    }
+
+private:
+    void ensureChannels(unsigned int channels)
+    {
+        if (m_states.size() != channels)
+        {
+            m_states.resize(channels);
+            reset();
+        }
+    }
+
+public:
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels == 0)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        ensureChannels(channels);
+
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            ChannelState &state = m_states[ch];
+            size_t done = 0;
+            while (done < numSamples)
+            {
+                // Advance to the next hop boundary (or the end of the block)
+                const size_t count = std::min(HOP_SIZE - state.hopPosition, numSamples - done);
+                float *input = state.input.data() + WINDOW_LENGTH - HOP_SIZE + state.hopPosition;
+                const float *ready = state.ready.data() + state.hopPosition;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const size_t index = (done + i) * channels + ch;
+                    input[i] = static_cast<float>(inputBuffer[index]) * SampleConversion::INT32_TO_FLOAT;
+                    const float scaled = std::clamp(ready[i] * SampleConversion::FLOAT_TO_INT32,
+                                                    -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT);
+                    outputBuffer[index] = static_cast<int32_t>(scaled);
+                }
+
+                state.hopPosition += count;
+                done += count;
+                if (state.hopPosition == HOP_SIZE)
+                {
+                    processFrame(state);
+                    state.hopPosition = 0;
+                }
+            }
+        }
+    }
+};
+
+// CPU cost per channel of the noise suppressor at 48 kHz
+void runNoiseSuppressionBenchmark()
+{
+    constexpr size_t FRAMES = 120;
+    constexpr unsigned int SAMPLE_RATE = 48000;
+    constexpr int PERIODS = 4000;
+
+    std::cout << "\nNoiseSuppressionEffect (" << FRAMES << "-frame periods, 48 kHz)" << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "channels" << std::right
+              << std::setw(14) << "us/period" << std::setw(16) << "us/period/ch"
+              << std::setw(14) << "% realtime" << std::endl;
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int32_t> noise(-(1 << 24), 1 << 24);
+
+    for (unsigned int channels : {1u, 2u, 4u, 8u})
+    {
+        NoiseSuppressionEffect suppressor;
+        std::vector<int32_t> block(FRAMES * channels);
+        for (auto &sample : block)
+        {
+            sample = noise(rng);
+        }
+        std::vector<int32_t> processed(block.size());
+
+        const auto result = Benchmark::measure([&]()
+                                               { suppressor.process(block.data(), processed.data(), FRAMES, channels); },
+                                               FRAMES, PERIODS);
+        const double usPerPeriod = result.nsPerSample * FRAMES / 1000.0;
+        const double periodUs = 1.0e6 * FRAMES / SAMPLE_RATE;
+        std::cout << "  " << std::left << std::setw(12) << channels << std::right << std::fixed
+                  << std::setprecision(2) << std::setw(14) << usPerPeriod
+                  << std::setw(16) << usPerPeriod / channels
+                  << std::setw(14) << 100.0 * usPerPeriod / periodUs
+                  << std::defaultfloat << std::endl;
+    }
+}
+
+// Acoustic echo canceller for duplex installs where the playback signal leaks
+// back into the capture device. The echo path is modelled by a partitioned-
+// block frequency-domain adaptive filter (MDF): the tail is split into
+// BLOCK_SIZE partitions filtered by overlap-save, each bin's step is
+// normalized by the reference power over the whole tail and scaled by the
+// estimated residual-to-error ratio, so adaptation slows down when near-end
+// speech dominates. The gradient constraint that keeps the filter linear is
+// applied to one partition per block (alternating MDF), which keeps the work
+// per block fixed: a period costs at most ceil(period / BLOCK_SIZE) blocks
+// whatever the signal. A spectral residual echo suppressor removes the
+// echo the linear filter misses.
+//
+// The reference is the mono downmix of what was sent to playback, pushed from
+// the processing thread after each period, and read back setReferenceDelay()
+// frames behind the capture position.
+class EchoCancellerEffect : public AudioEffect
+{
+private:
+    static constexpr size_t BLOCK_SIZE = 64;
+    static constexpr size_t FFT_SIZE = 2 * BLOCK_SIZE;
+    static constexpr size_t NUM_BINS = FFT_SIZE / 2 + 1;
+    static constexpr size_t REFERENCE_SIZE = 1 << 15; // ~680 ms of reference history at 48 kHz
+    static constexpr size_t REFERENCE_MASK = REFERENCE_SIZE - 1;
+    static constexpr int64_t DELAY_TOLERANCE = BLOCK_SIZE / 2; // Smaller delay changes are left to the filter
+
+    static constexpr float REFERENCE_FLOOR = 1.0e-6f; // Per-sample reference power below which adaptation pauses
+    static constexpr float REGULARIZATION = 1.0e-7f;  // Per-bin, per-partition power added to the step normalization
+    static constexpr float INITIAL_STEP = 0.25f;      // Step until the leak estimate is trusted
+    static constexpr float MAX_STEP = 0.5f;
+    static constexpr float MIN_LEAK = 0.005f;
+    static constexpr float ADAPTED_LEAK = 0.03f;
+    static constexpr size_t DIVERGENCE_BLOCKS = 50;
+    static constexpr float RES_OVERSUBTRACTION = 2.0f;
+    static constexpr float RES_GAIN_RECOVERY = 0.3f; // Gain smoothing when reopening; closing is immediate
+    static constexpr float ERLE_SMOOTHING = 0.02f;
+    static constexpr float POWER_EPSILON = 1.0e-20f;
+
+    struct ChannelState
+    {
+        std::vector<float> weightsRe; // numPartitions x NUM_BINS
+        std::vector<float> weightsIm;
+        std::vector<float> nearBlock;  // Capture samples of the block being filled
+        std::vector<float> ready;      // Finished output for the current block
+        std::vector<float> errorFrame; // Previous and current error blocks, for the suppressor
+        std::vector<float> echoFrame;  // Previous and current echo estimates
+        std::vector<float> overlap;
+        std::vector<float> errorMean; // Smoothed suppressor spectra, for the leak estimate
+        std::vector<float> echoMean;
+        std::vector<float> suppressorGain;
+        float pey = 0.0f;
+        float pyy = 0.0f;
+        float leak = MIN_LEAK;
+        float adaptSum = 0.0f;
+        bool adapted = false;
+        size_t divergedBlocks = 0;
+        float nearPower = 0.0f; // Smoothed, for ERLE
+        float errorPower = 0.0f;
+    };
+
+    FFT m_fft;
+    size_t m_numPartitions;
+    std::vector<float> m_window;
+    std::vector<ChannelState> m_states;
+
+    // Mono reference ring, indexed by absolute frame count
+    std::vector<float> m_reference;
+    uint64_t m_referenceFrames = 0;
+    uint64_t m_captureFrames = 0; // Capture frames consumed by finished blocks
+    int64_t m_referenceDelay = 0;
+
+    // Reference spectra of the last numPartitions blocks, newest at m_historyHead
+    std::vector<float> m_historyRe;
+    std::vector<float> m_historyIm;
+    std::vector<float> m_historyPower; // Per-bin |X|^2 summed over the history
+    size_t m_historyHead = 0;
+    size_t m_constrainedPartition = 0;
+    size_t m_blockPosition = 0;
+
+    // Leak estimate smoothing, per block at the configured sample rate
+    float m_spectrumSmoothing;
+    float m_leakRateEcho;
+    float m_leakRateMax;
+
+    float m_floorGain;
+    std::atomic<float> m_erleDb{0.0f};
+
+    // Block scratch
+    std::vector<float> m_time;
+    std::vector<float> m_echo;
+    std::vector<float> m_error;
+    std::vector<float> m_yRe;
+    std::vector<float> m_yIm;
+    std::vector<float> m_eRe;
+    std::vector<float> m_eIm;
+    std::vector<float> m_ewRe;
+    std::vector<float> m_ewIm;
+    std::vector<float> m_errorSpectrum;
+    std::vector<float> m_echoSpectrum;
+    std::vector<float> m_step;
+
+    size_t historySlot(size_t partition) const
+    {
+        const size_t slot = m_historyHead + partition;
+        return slot < m_numPartitions ? slot : slot - m_numPartitions;
+    }
+
+    void resetFilter(ChannelState &state)
+    {
+        std::fill(state.weightsRe.begin(), state.weightsRe.end(), 0.0f);
+        std::fill(state.weightsIm.begin(), state.weightsIm.end(), 0.0f);
+        std::fill(state.errorMean.begin(), state.errorMean.end(), 0.0f);
+        std::fill(state.echoMean.begin(), state.echoMean.end(), 0.0f);
+        state.pey = 0.0f;
+        state.pyy = 0.0f;
+        state.leak = MIN_LEAK;
+        state.adaptSum = 0.0f;
+        state.adapted = false;
+        state.divergedBlocks = 0;
+    }
+
+    void initChannel(ChannelState &state)
+    {
+        state.weightsRe.assign(m_numPartitions * NUM_BINS, 0.0f);
+        state.weightsIm.assign(m_numPartitions * NUM_BINS, 0.0f);
+        state.nearBlock.assign(BLOCK_SIZE, 0.0f);
+        state.ready.assign(BLOCK_SIZE, 0.0f);
+        state.errorFrame.assign(FFT_SIZE, 0.0f);
+        state.echoFrame.assign(FFT_SIZE, 0.0f);
+        state.overlap.assign(FFT_SIZE, 0.0f);
+        state.errorMean.assign(NUM_BINS, 0.0f);
+        state.echoMean.assign(NUM_BINS, 0.0f);
+        state.suppressorGain.assign(NUM_BINS, 1.0f);
+        resetFilter(state);
+        state.nearPower = 0.0f;
+        state.errorPower = 0.0f;
+    }
+
+    // Spectrum of the reference aligned with the capture block, pushed into the history
+    float updateReference()
+    {
+        const int64_t newest = static_cast<int64_t>(m_referenceFrames) - static_cast<int64_t>(BLOCK_SIZE);
+        const int64_t oldest = static_cast<int64_t>(m_referenceFrames) - static_cast<int64_t>(REFERENCE_SIZE - BLOCK_SIZE);
+        const int64_t start = std::clamp(static_cast<int64_t>(m_captureFrames) - m_referenceDelay, oldest, newest);
+
+        // Overlap-save frame: previous block followed by the current one.
+        // Frames before the first push wrap to unwritten (zero) slots.
+        float *frame = m_time.data();
+        float referencePower = 0.0f;
+        for (size_t i = 0; i < FFT_SIZE; ++i)
+        {
+            const int64_t index = start - static_cast<int64_t>(BLOCK_SIZE) + static_cast<int64_t>(i);
+            frame[i] = m_reference[static_cast<size_t>(index) & REFERENCE_MASK];
+        }
+        for (size_t i = BLOCK_SIZE; i < FFT_SIZE; ++i)
+        {
+            referencePower += frame[i] * frame[i];
+        }
+
+        m_historyHead = (m_historyHead == 0 ? m_numPartitions : m_historyHead) - 1;
+        float *xRe = &m_historyRe[m_historyHead * NUM_BINS];
+        float *xIm = &m_historyIm[m_historyHead * NUM_BINS];
+        float *power = m_historyPower.data();
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            power[k] -= xRe[k] * xRe[k] + xIm[k] * xIm[k];
+        }
+        m_fft.forward(frame, xRe, xIm);
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            power[k] += xRe[k] * xRe[k] + xIm[k] * xIm[k];
+        }
+
+        if (m_historyHead == 0)
+        {
+            // Once per history cycle, recompute the running sum to drop rounding drift
+            std::fill(power, power + NUM_BINS, 0.0f);
+            for (size_t p = 0; p < m_numPartitions; ++p)
+            {
+                const float *re = &m_historyRe[p * NUM_BINS];
+                const float *im = &m_historyIm[p * NUM_BINS];
+                for (size_t k = 0; k < NUM_BINS; ++k)
+                {
+                    power[k] += re[k] * re[k] + im[k] * im[k];
+                }
+            }
+        }
+
+        return referencePower;
+    }
+
+    // Leakage of the echo estimate into the error (Valin's MDF): regression of
+    // the error spectrum's variations on the echo estimate's
+    void updateLeak(ChannelState &state, float echoPower, float errorPower)
+    {
+        const float *errorSpectrum = m_errorSpectrum.data();
+        const float *echoSpectrum = m_echoSpectrum.data();
+        float *errorMean = state.errorMean.data();
+        float *echoMean = state.echoMean.data();
+
+        float pey = 0.0f;
+        float pyy = 0.0f;
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            const float errorVariation = errorSpectrum[k] - errorMean[k];
+            const float echoVariation = echoSpectrum[k] - echoMean[k];
+            pey += errorVariation * echoVariation;
+            pyy += echoVariation * echoVariation;
+            errorMean[k] += m_spectrumSmoothing * (errorSpectrum[k] - errorMean[k]);
+            echoMean[k] += m_spectrumSmoothing * (echoSpectrum[k] - echoMean[k]);
+        }
+        pyy = std::sqrt(pyy);
+        pey = pyy > 0.0f ? pey / pyy : 0.0f;
+
+        // Track faster while the echo estimate dominates the error
+        const float alpha = errorPower > POWER_EPSILON
+                                ? std::min(m_leakRateEcho * echoPower, m_leakRateMax * errorPower) / errorPower
+                                : 0.0f;
+        state.pey += alpha * (pey - state.pey);
+        state.pyy += alpha * (pyy - state.pyy);
+        state.pyy = std::max(state.pyy, POWER_EPSILON);
+        state.pey = std::clamp(state.pey, MIN_LEAK * state.pyy, state.pyy);
+        state.leak = state.pey / state.pyy;
+    }
+
+    // Per-bin normalized step into m_step; false when there is nothing to adapt on
+    bool computeStep(ChannelState &state, float referencePower, float echoPower,
+                     float errorPower, float crossPower)
+    {
+        if (referencePower < BLOCK_SIZE * REFERENCE_FLOOR || errorPower < POWER_EPSILON)
+        {
+            return false;
+        }
+
+        const float regularization = REGULARIZATION * FFT_SIZE * m_numPartitions;
+        const float *historyPower = m_historyPower.data();
+        float *step = m_step.data();
+
+        if (!state.adapted)
+        {
+            // Fixed step until the filter has seen enough reference to trust the leak estimate
+            const float rate = INITIAL_STEP * std::min(referencePower, errorPower) / errorPower;
+            state.adaptSum += rate;
+            if (state.adaptSum > m_numPartitions && state.leak > ADAPTED_LEAK)
+            {
+                state.adapted = true;
+            }
+            for (size_t k = 0; k < NUM_BINS; ++k)
+            {
+                step[k] = rate / (historyPower[k] + regularization);
+            }
+            return true;
+        }
+
+        // Residual-to-error ratio: the optimal NLMS step is the share of the
+        // error that is still echo
+        float residualRatio = (1.0e-4f * referencePower + 3.0f * state.leak * echoPower) / errorPower;
+        residualRatio = std::max(residualRatio, crossPower * crossPower / (errorPower * echoPower + POWER_EPSILON));
+        residualRatio = std::min(residualRatio, MAX_STEP);
+
+        const float *errorSpectrum = m_errorSpectrum.data();
+        const float *echoSpectrum = m_echoSpectrum.data();
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            const float error = errorSpectrum[k] + POWER_EPSILON;
+            const float residual = std::min(state.leak * echoSpectrum[k], MAX_STEP * error);
+            const float rate = (0.7f * residual + 0.3f * residualRatio * error) / error;
+            step[k] = rate / (historyPower[k] + regularization);
+        }
+        return true;
+    }
+
+    float processChannel(ChannelState &state, float referencePower)
+    {
+        float *time = m_time.data();
+        float *yRe = m_yRe.data();
+        float *yIm = m_yIm.data();
+
+        // Echo estimate: sum over partitions of weights x delayed reference spectra
+        std::fill(yRe, yRe + NUM_BINS, 0.0f);
+        std::fill(yIm, yIm + NUM_BINS, 0.0f);
+        for (size_t p = 0; p < m_numPartitions; ++p)
+        {
+            const size_t slot = historySlot(p);
+            const float *wRe = &state.weightsRe[p * NUM_BINS];
+            const float *wIm = &state.weightsIm[p * NUM_BINS];
+            const float *xRe = &m_historyRe[slot * NUM_BINS];
+            const float *xIm = &m_historyIm[slot * NUM_BINS];
+            for (size_t k = 0; k < NUM_BINS; ++k)
+            {
+                yRe[k] += wRe[k] * xRe[k] - wIm[k] * xIm[k];
+                yIm[k] += wRe[k] * xIm[k] + wIm[k] * xRe[k];
+            }
+        }
+        m_fft.inverse(yRe, yIm, time);
+
+        // Overlap-save: the second half is the linear convolution
+        const float *nearBlock = state.nearBlock.data();
+        float *echo = m_echo.data();
+        float *error = m_error.data();
+        float nearPower = 0.0f;
+        float echoPower = 0.0f;
+        float errorPower = 0.0f;
+        float crossPower = 0.0f;
+        for (size_t i = 0; i < BLOCK_SIZE; ++i)
+        {
+            echo[i] = time[BLOCK_SIZE + i];
+            error[i] = nearBlock[i] - echo[i];
+            nearPower += nearBlock[i] * nearBlock[i];
+            echoPower += echo[i] * echo[i];
+            errorPower += error[i] * error[i];
+            crossPower += error[i] * echo[i];
+        }
+
+        // A filter that adds more than it removes has diverged (echo path
+        // change, or adaptation during double talk): start over
+        if (!std::isfinite(errorPower))
+        {
+            resetFilter(state);
+            std::fill(echo, echo + BLOCK_SIZE, 0.0f);
+            std::copy(nearBlock, nearBlock + BLOCK_SIZE, error);
+            errorPower = nearPower;
+            echoPower = 0.0f;
+            crossPower = 0.0f;
+        }
+        else if (errorPower > 4.0f * nearPower + BLOCK_SIZE * REFERENCE_FLOOR)
+        {
+            if (++state.divergedBlocks >= DIVERGENCE_BLOCKS)
+            {
+                resetFilter(state);
+            }
+        }
+        else
+        {
+            state.divergedBlocks = 0;
+        }
+
+        // Windowed error and echo spectra over the last two blocks, shared by
+        // the leak estimate and the residual echo suppressor
+        std::copy(state.errorFrame.begin() + BLOCK_SIZE, state.errorFrame.end(), state.errorFrame.begin());
+        std::copy(error, error + BLOCK_SIZE, state.errorFrame.begin() + BLOCK_SIZE);
+        std::copy(state.echoFrame.begin() + BLOCK_SIZE, state.echoFrame.end(), state.echoFrame.begin());
+        std::copy(echo, echo + BLOCK_SIZE, state.echoFrame.begin() + BLOCK_SIZE);
+
+        float *ewRe = m_ewRe.data();
+        float *ewIm = m_ewIm.data();
+        float *errorSpectrum = m_errorSpectrum.data();
+        float *echoSpectrum = m_echoSpectrum.data();
+        for (size_t i = 0; i < FFT_SIZE; ++i)
+        {
+            time[i] = state.echoFrame[i] * m_window[i];
+        }
+        m_fft.forward(time, yRe, yIm);
+        for (size_t i = 0; i < FFT_SIZE; ++i)
+        {
+            time[i] = state.errorFrame[i] * m_window[i];
+        }
+        m_fft.forward(time, ewRe, ewIm);
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            errorSpectrum[k] = ewRe[k] * ewRe[k] + ewIm[k] * ewIm[k];
+            echoSpectrum[k] = yRe[k] * yRe[k] + yIm[k] * yIm[k];
+        }
+
+        updateLeak(state, echoPower, errorPower);
+
+        if (computeStep(state, referencePower, echoPower, errorPower, crossPower))
+        {
+            // Gradient from the zero-padded error block
+            float *eRe = m_eRe.data();
+            float *eIm = m_eIm.data();
+            std::fill(time, time + BLOCK_SIZE, 0.0f);
+            std::copy(error, error + BLOCK_SIZE, time + BLOCK_SIZE);
+            m_fft.forward(time, eRe, eIm);
+
+            const float *step = m_step.data();
+            for (size_t k = 0; k < NUM_BINS; ++k)
+            {
+                eRe[k] *= step[k];
+                eIm[k] *= step[k];
+            }
+
+            for (size_t p = 0; p < m_numPartitions; ++p)
+            {
+                const size_t slot = historySlot(p);
+                float *wRe = &state.weightsRe[p * NUM_BINS];
+                float *wIm = &state.weightsIm[p * NUM_BINS];
+                const float *xRe = &m_historyRe[slot * NUM_BINS];
+                const float *xIm = &m_historyIm[slot * NUM_BINS];
+                for (size_t k = 0; k < NUM_BINS; ++k)
+                {
+                    // conj(X) * E
+                    wRe[k] += xRe[k] * eRe[k] + xIm[k] * eIm[k];
+                    wIm[k] += xRe[k] * eIm[k] - xIm[k] * eRe[k];
+                }
+            }
+
+            // Gradient constraint on one partition: drop the circular half of its impulse response
+            float *wRe = &state.weightsRe[m_constrainedPartition * NUM_BINS];
+            float *wIm = &state.weightsIm[m_constrainedPartition * NUM_BINS];
+            m_fft.inverse(wRe, wIm, time);
+            std::fill(time + BLOCK_SIZE, time + FFT_SIZE, 0.0f);
+            m_fft.forward(time, wRe, wIm);
+        }
+
+        // Residual echo suppression on the windowed error
+        float *gain = state.suppressorGain.data();
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            const float residual = state.leak * echoSpectrum[k];
+            const float target = std::max(m_floorGain, 1.0f - RES_OVERSUBTRACTION * residual / (errorSpectrum[k] + POWER_EPSILON));
+            gain[k] = target < gain[k] ? target : gain[k] + RES_GAIN_RECOVERY * (target - gain[k]);
+            ewRe[k] *= gain[k];
+            ewIm[k] *= gain[k];
+        }
+        m_fft.inverse(ewRe, ewIm, time);
+
+        // sqrt-Hann squared at half-window hop sums to 1
+        float *overlap = state.overlap.data();
+        for (size_t i = 0; i < FFT_SIZE; ++i)
+        {
+            overlap[i] += time[i] * m_window[i];
+        }
+        std::copy(overlap, overlap + BLOCK_SIZE, state.ready.begin());
+        std::copy(overlap + BLOCK_SIZE, overlap + FFT_SIZE, overlap);
+        std::fill(overlap + BLOCK_SIZE, overlap + FFT_SIZE, 0.0f);
+
+        state.nearPower += ERLE_SMOOTHING * (nearPower - state.nearPower);
+        state.errorPower += ERLE_SMOOTHING * (errorPower - state.errorPower);
+        return 10.0f * std::log10((state.nearPower + POWER_EPSILON) / (state.errorPower + POWER_EPSILON));
+    }
+
+    void processBlock()
+    {
+        const float referencePower = updateReference();
+
+        float erle = 0.0f;
+        for (auto &state : m_states)
+        {
+            erle += processChannel(state, referencePower);
+        }
+        m_erleDb.store(erle / m_states.size(), std::memory_order_relaxed);
+
+        m_constrainedPartition = (m_constrainedPartition + 1) % m_numPartitions;
+        m_captureFrames += BLOCK_SIZE;
+    }
+
+public:
+    EchoCancellerEffect(unsigned int sampleRate, float tailMs = 200.0f, float suppressionDb = 30.0f)
+        : m_fft(FFT_SIZE)
+    {
+        m_sampleRate = sampleRate;
+        tailMs = std::clamp(tailMs, 10.0f, 500.0f);
+        const size_t tailSamples = static_cast<size_t>(tailMs * sampleRate / 1000.0f);
+        m_numPartitions = (tailSamples + BLOCK_SIZE - 1) / BLOCK_SIZE;
+
+        m_window.resize(FFT_SIZE);
+        for (size_t i = 0; i < FFT_SIZE; ++i)
+        {
+            // Periodic sqrt-Hann
+            m_window[i] = std::sqrt(0.5f - 0.5f * std::cos(2.0f * static_cast<float>(M_PI) * i / FFT_SIZE));
+        }
+
+        // ~1 s averaging for the spectra, leak tracking between 4 s and 0.5 s
+        const float blockSeconds = static_cast<float>(BLOCK_SIZE) / sampleRate;
+        m_spectrumSmoothing = blockSeconds;
+        m_leakRateEcho = 2.0f * blockSeconds;
+        m_leakRateMax = 0.5f * blockSeconds;
+
+        m_reference.assign(REFERENCE_SIZE, 0.0f);
+        m_historyRe.assign(m_numPartitions * NUM_BINS, 0.0f);
+        m_historyIm.assign(m_numPartitions * NUM_BINS, 0.0f);
+        m_historyPower.assign(NUM_BINS, 0.0f);
+
+        m_time.resize(FFT_SIZE);
+        m_echo.resize(BLOCK_SIZE);
+        m_error.resize(BLOCK_SIZE);
+        m_yRe.resize(NUM_BINS);
+        m_yIm.resize(NUM_BINS);
+        m_eRe.resize(NUM_BINS);
+        m_eIm.resize(NUM_BINS);
+        m_ewRe.resize(NUM_BINS);
+        m_ewIm.resize(NUM_BINS);
+        m_errorSpectrum.resize(NUM_BINS);
+        m_echoSpectrum.resize(NUM_BINS);
+        m_step.resize(NUM_BINS);
+
+        setSuppression(suppressionDb);
+    }
+
+    // Feed the frames that were sent to playback. Call from the processing
+    // thread once per period, after process() has run on the matching capture.
+    void pushReference(const int32_t *frames, size_t numFrames, unsigned int channels)
+    {
+        if (!m_enabled || channels == 0)
+        {
+            return;
+        }
+
+        const float scale = SampleConversion::INT32_TO_FLOAT / channels;
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+            float sum = 0.0f;
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                sum += static_cast<float>(frames[i * channels + ch]);
+            }
+            m_reference[(m_referenceFrames + i) & REFERENCE_MASK] = sum * scale;
+        }
+        m_referenceFrames += numFrames;
+    }
+
+    // Frames between a reference frame leaving the chain and its echo
+    // entering it (playback queue + device delays + capture queue)
+    void setReferenceDelay(size_t frames)
+    {
+        const int64_t delay = static_cast<int64_t>(std::min(frames, REFERENCE_SIZE - 2 * BLOCK_SIZE));
+        if (std::abs(delay - m_referenceDelay) >= DELAY_TOLERANCE)
+        {
+            m_referenceDelay = delay;
+        }
+    }
+
+    // Maximum attenuation of the residual echo suppressor (0 dB disables it)
+    void setSuppression(float suppressionDb)
+    {
+        suppressionDb = std::clamp(suppressionDb, 0.0f, 60.0f);
+        m_floorGain = std::pow(10.0f, -suppressionDb / 20.0f);
+    }
+
+    size_t getReferenceDelay() const { return static_cast<size_t>(m_referenceDelay); }
+    float getSuppression() const { return -20.0f * std::log10(m_floorGain); }
+    float getTailLength() const { return 1000.0f * m_numPartitions * BLOCK_SIZE / m_sampleRate; }
+
+    // Echo return loss enhancement of the adaptive filter, averaged over channels
+    float getErle() const { return m_erleDb.load(std::memory_order_relaxed); }
+
+    // One block of input buffering plus half a suppressor window
+    size_t getLatency() const override { return 2 * BLOCK_SIZE; }
+
+    void prepare(size_t /*maxFrames*/, unsigned int channels) override
+    {
+        ensureChannels(channels);
+    }
+
+    void reset() override
+    {
+        for (auto &state : m_states)
+        {
+            initChannel(state);
+        }
+        std::fill(m_reference.begin(), m_reference.end(), 0.0f);
+        std::fill(m_historyRe.begin(), m_historyRe.end(), 0.0f);
+        std::fill(m_historyIm.begin(), m_historyIm.end(), 0.0f);
+        std::fill(m_historyPower.begin(), m_historyPower.end(), 0.0f);
+        m_referenceFrames = 0;
+        m_captureFrames = 0;
+        m_historyHead = 0;
+        m_constrainedPartition = 0;
+        m_blockPosition = 0;
+        m_erleDb.store(0.0f, std::memory_order_relaxed);
+    }
+
+private:
+    void ensureChannels(unsigned int channels)
+    {
+        if (m_states.size() != channels)
+        {
+            m_states.resize(channels);
+            reset();
+        }
+    }
+
+public:
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels == 0)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        ensureChannels(channels);
+
+        // Keep the reference clock locked to the capture clock; they drift
+        // apart only if the effect is toggled between process() and pushReference()
+        m_referenceFrames = m_captureFrames + m_blockPosition;
+
+        size_t done = 0;
+        while (done < numSamples)
+        {
+            // Advance to the next block boundary (or the end of the period)
+            const size_t count = std::min(BLOCK_SIZE - m_blockPosition, numSamples - done);
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                float *nearBlock = m_states[ch].nearBlock.data() + m_blockPosition;
+                const float *ready = m_states[ch].ready.data() + m_blockPosition;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const size_t index = (done + i) * channels + ch;
+                    nearBlock[i] = static_cast<float>(inputBuffer[index]) * SampleConversion::INT32_TO_FLOAT;
+                    const float scaled = std::clamp(ready[i] * SampleConversion::FLOAT_TO_INT32,
+                                                    -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT);
+                    outputBuffer[index] = static_cast<int32_t>(scaled);
+                }
+            }
+
+            m_blockPosition += count;
+            done += count;
+            if (m_blockPosition == BLOCK_SIZE)
+            {
+                processBlock();
+                m_blockPosition = 0;
+            }
+        }
+    }
+};
+
+// CPU cost of the echo canceller per 120-frame period at 48 kHz
+void runEchoCancellerBenchmark()
+{
+    constexpr size_t FRAMES = 120;
+    constexpr unsigned int SAMPLE_RATE = 48000;
+    constexpr int PERIODS = 4000;
+
+    std::cout << "\nEchoCancellerEffect (" << FRAMES << "-frame periods, 48 kHz)" << std::endl;
+    std::cout << "  " << std::left << std::setw(12) << "tail ms" << std::setw(10) << "channels" << std::right
+              << std::setw(14) << "us/period" << std::setw(14) << "% realtime" << std::endl;
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int32_t> noise(-(1 << 24), 1 << 24);
+
+    for (int tailMs : {100, 200, 400})
+    {
+        for (unsigned int channels : {1u, 2u})
+        {
+            EchoCancellerEffect canceller(SAMPLE_RATE, static_cast<float>(tailMs));
+            canceller.setReferenceDelay(4 * FRAMES);
+            std::vector<int32_t> capture(FRAMES * channels);
+            std::vector<int32_t> playback(FRAMES * channels);
+            for (size_t i = 0; i < capture.size(); ++i)
+            {
+                capture[i] = noise(rng);
+                playback[i] = noise(rng);
+            }
+            std::vector<int32_t> processed(capture.size());
+
+            const auto result = Benchmark::measure([&]()
+                                                   {
+                                                       canceller.process(capture.data(), processed.data(), FRAMES, channels);
+                                                       canceller.pushReference(playback.data(), FRAMES, channels); },
+                                                   FRAMES, PERIODS);
+            const double usPerPeriod = result.nsPerSample * FRAMES / 1000.0;
+            const double periodUs = 1.0e6 * FRAMES / SAMPLE_RATE;
+            std::cout << "  " << std::left << std::setw(12) << tailMs << std::setw(10) << channels << std::right
+                      << std::fixed << std::setprecision(2) << std::setw(14) << usPerPeriod
+                      << std::setw(14) << 100.0 * usPerPeriod / periodUs
+                      << std::defaultfloat << std::endl;
+        }
+    }
+}
+
+// Acoustic feedback (howl) suppressor. The audio thread only runs a bank of
+// narrow notch filters and copies a mono downmix of its input into a
+// lock-free analysis ring. A detector thread wakes every few periods, takes
+// an FFT of the newest samples and looks for howl candidates: peaks that
+// stand well above the spectrum average, carry no harmonic partner (music
+// does) and keep growing or refuse to decay. A confirmed peak gets a notch,
+// published through atomics and picked up at the next period, so a notch is
+// in place one period after detection. Re-detection near an existing notch
+// retunes and deepens it; notches that stay quiet are released slowly.
+class FeedbackSuppressorEffect : public AudioEffect
+{
+private:
+    static constexpr size_t MAX_NOTCHES = 8;
+    static constexpr size_t ANALYSIS_SIZE = 1024;
+    static constexpr size_t ANALYSIS_HOP = ANALYSIS_SIZE / 2; // ~10.7 ms at 48 kHz
+    static constexpr size_t NUM_BINS = ANALYSIS_SIZE / 2 + 1;
+    static constexpr size_t RING_SIZE = 8192;
+    static constexpr size_t RING_MASK = RING_SIZE - 1;
+
+    // Detection
+    static constexpr float MIN_LEVEL_DB = -70.0f;   // Peak level, dBFS
+    static constexpr float PAPR_DB = 15.0f;         // Peak over average spectrum power
+    static constexpr float PHPR_DB = 18.0f;         // Peak over its octave neighbours
+    static constexpr float GROWTH_DB = 6.0f;        // Rise over a candidate streak that confirms howl
+    static constexpr size_t MIN_STREAK = 4;         // Hops (~43 ms) before growth is judged
+    static constexpr size_t PERSISTENT_STREAK = 32; // Hops (~340 ms) of a steady, isolated peak
+
+    // Notch bank
+    static constexpr float NOTCH_Q = 20.0f;
+    static constexpr float INITIAL_DEPTH_DB = 9.0f;
+    static constexpr float DEPTH_STEP_DB = 3.0f;
+    static constexpr float MERGE_RATIO = 0.02f;     // Re-detections within 2% retune an existing notch
+    static constexpr size_t HOLD_HOPS = 940;        // ~10 s before a quiet notch starts releasing
+    static constexpr size_t RELEASE_INTERVAL_HOPS = 94; // Then DEPTH_STEP_DB every ~1 s
+
+    struct NotchCoefficients
+    {
+        float b0 = 1.0f, b1 = 0.0f, b2 = 0.0f, a1 = 0.0f, a2 = 0.0f;
+    };
+
+    // Detector-side notch bookkeeping
+    struct NotchTrack
+    {
+        float frequency = 0.0f;
+        float depthDb = 0.0f;
+        uint64_t lastTrigger = 0;
+        uint64_t lastRelease = 0;
+    };
+
+    // Published notch parameters; depth 0 means the slot is free
+    std::array<std::atomic<float>, MAX_NOTCHES> m_publishedFrequency;
+    std::array<std::atomic<float>, MAX_NOTCHES> m_publishedDepth;
+    std::atomic<uint32_t> m_notchVersion{0};
+
+    // Audio thread
+    uint32_t m_appliedVersion = 0;
+    std::array<NotchCoefficients, MAX_NOTCHES> m_coefficients;
+    std::array<bool, MAX_NOTCHES> m_notchActive{};
+    std::vector<float> m_z1; // MAX_NOTCHES x channels
+    std::vector<float> m_z2;
+    std::vector<float> m_buffer;
+    unsigned int m_channels = 0;
+
+    // Single-producer/single-consumer sample queue from the audio thread to
+    // the detector. The audio thread drops samples rather than overwrite
+    // ones the detector hasn't taken yet, and posts m_hopReady for every
+    // ANALYSIS_HOP it completes, so the detector sleeps while disabled.
+    std::vector<float> m_ring;
+    std::atomic<uint64_t> m_ringWritten{0};
+    std::atomic<uint64_t> m_ringRead{0};
+    sem_t m_hopReady;
+
+    // Detector thread
+    std::thread m_detector;
+    std::atomic<bool> m_running{true};
+    std::atomic<bool> m_clearRequested{false};
+    std::atomic<float> m_maxDepthDb{24.0f};
+    FFT m_fft;
+    std::vector<float> m_window;
+    std::vector<float> m_history; // Newest ANALYSIS_SIZE samples taken off the queue
+    uint64_t m_historyFilled = 0;
+    std::vector<float> m_frame;
+    std::vector<float> m_re;
+    std::vector<float> m_im;
+    std::vector<float> m_levelDb;
+    std::vector<size_t> m_streak;
+    std::vector<size_t> m_previousStreak;
+    std::vector<float> m_streakStartDb;
+    std::vector<float> m_previousStartDb;
+    std::array<NotchTrack, MAX_NOTCHES> m_tracks{};
+    uint64_t m_hop = 0;
+
+    // RBJ peaking filter with negative gain
+    NotchCoefficients designNotch(float frequency, float depthDb) const
+    {
+        const float omega = 2.0f * static_cast<float>(M_PI) * frequency / m_sampleRate;
+        const float alpha = std::sin(omega) / (2.0f * NOTCH_Q);
+        const float amplitude = std::pow(10.0f, -depthDb / 40.0f);
+        const float cosOmega = std::cos(omega);
+        const float a0 = 1.0f + alpha / amplitude;
+
+        NotchCoefficients c;
+        c.b0 = (1.0f + alpha * amplitude) / a0;
+        c.b1 = -2.0f * cosOmega / a0;
+        c.b2 = (1.0f - alpha * amplitude) / a0;
+        c.a1 = c.b1;
+        c.a2 = (1.0f - alpha / amplitude) / a0;
+        return c;
+    }
+
+    void applyPublishedNotches()
+    {
+        const uint32_t version = m_notchVersion.load(std::memory_order_acquire);
+        if (version == m_appliedVersion)
+        {
+            return;
+        }
+        m_appliedVersion = version;
+
+        for (size_t n = 0; n < MAX_NOTCHES; ++n)
+        {
+            const float depth = m_publishedDepth[n].load(std::memory_order_relaxed);
+            const float frequency = m_publishedFrequency[n].load(std::memory_order_relaxed);
+            const bool active = depth > 0.0f;
+            if (active)
+            {
+                m_coefficients[n] = designNotch(frequency, depth);
+            }
+            if (active && !m_notchActive[n])
+            {
+                // Fresh slot: start from silence rather than a retired filter's state
+                std::fill(m_z1.begin() + n * m_channels, m_z1.begin() + (n + 1) * m_channels, 0.0f);
+                std::fill(m_z2.begin() + n * m_channels, m_z2.begin() + (n + 1) * m_channels, 0.0f);
+            }
+            m_notchActive[n] = active;
+        }
+    }
+
+    void ensureBuffers(size_t numFrames, unsigned int channels)
+    {
+        if (m_channels != channels)
+        {
+            m_channels = channels;
+            m_z1.assign(MAX_NOTCHES * channels, 0.0f);
+            m_z2.assign(MAX_NOTCHES * channels, 0.0f);
+        }
+        if (m_buffer.size() < numFrames * channels)
+        {
+            m_buffer.resize(numFrames * channels);
+        }
+    }
+
+    void publish(size_t slot)
+    {
+        m_publishedFrequency[slot].store(m_tracks[slot].frequency, std::memory_order_relaxed);
+        m_publishedDepth[slot].store(m_tracks[slot].depthDb, std::memory_order_relaxed);
+        m_notchVersion.fetch_add(1, std::memory_order_release);
+    }
+
+    void deployNotch(float frequency)
+    {
+        const float maxDepth = m_maxDepthDb.load(std::memory_order_relaxed);
+
+        // Retune and deepen a notch that is already close
+        for (size_t n = 0; n < MAX_NOTCHES; ++n)
+        {
+            NotchTrack &track = m_tracks[n];
+            if (track.depthDb > 0.0f && std::abs(frequency - track.frequency) < MERGE_RATIO * track.frequency)
+            {
+                track.frequency = frequency;
+                track.depthDb = std::min(track.depthDb + DEPTH_STEP_DB, maxDepth);
+                track.lastTrigger = track.lastRelease = m_hop;
+                publish(n);
+                return;
+            }
+        }
+
+        // Otherwise take a free slot, or the one triggered longest ago
+        size_t slot = 0;
+        for (size_t n = 0; n < MAX_NOTCHES; ++n)
+        {
+            if (m_tracks[n].depthDb <= 0.0f)
+            {
+                slot = n;
+                break;
+            }
+            if (m_tracks[n].lastTrigger < m_tracks[slot].lastTrigger)
+            {
+                slot = n;
+            }
+        }
+        m_tracks[slot].frequency = frequency;
+        m_tracks[slot].depthDb = std::min(INITIAL_DEPTH_DB, maxDepth);
+        m_tracks[slot].lastTrigger = m_tracks[slot].lastRelease = m_hop;
+        publish(slot);
+    }
+
+    void releaseNotches()
+    {
+        for (size_t n = 0; n < MAX_NOTCHES; ++n)
+        {
+            NotchTrack &track = m_tracks[n];
+            if (track.depthDb > 0.0f && m_hop - track.lastTrigger > HOLD_HOPS &&
+                m_hop - track.lastRelease >= RELEASE_INTERVAL_HOPS)
+            {
+                track.depthDb = std::max(track.depthDb - DEPTH_STEP_DB, 0.0f);
+                track.lastRelease = m_hop;
+                publish(n);
+            }
+        }
+    }
+
+    float levelAt(size_t bin) const
+    {
+        return bin < NUM_BINS ? m_levelDb[bin] : -200.0f;
+    }
+
+    void analyze()
+    {
+        float *re = m_re.data();
+        float *im = m_im.data();
+        float *level = m_levelDb.data();
+
+        for (size_t i = 0; i < ANALYSIS_SIZE; ++i)
+        {
+            m_frame[i] *= m_window[i];
+        }
+        m_fft.forward(m_frame.data(), re, im);
+
+        // dBFS: a full-scale sine peaks at ANALYSIS_SIZE / 4 through the Hann window
+        const float reference = 1.0f / (0.25f * ANALYSIS_SIZE * 0.25f * ANALYSIS_SIZE);
+        float meanPower = 0.0f;
+        for (size_t k = 0; k < NUM_BINS; ++k)
+        {
+            const float power = (re[k] * re[k] + im[k] * im[k]) * reference;
+            meanPower += power;
+            level[k] = 10.0f * std::log10(power + 1.0e-20f);
+        }
+        const float meanDb = 10.0f * std::log10(meanPower / NUM_BINS + 1.0e-20f);
+
+        std::swap(m_streak, m_previousStreak);
+        std::swap(m_streakStartDb, m_previousStartDb);
+        for (size_t k = 2; k + 2 < NUM_BINS; ++k)
+        {
+            m_streak[k] = 0;
+            const float peak = level[k];
+            const bool candidate = peak > MIN_LEVEL_DB && peak - meanDb > PAPR_DB &&
+                                   peak > level[k - 1] && peak >= level[k + 1] &&
+                                   peak > level[k - 2] && peak >= level[k + 2] &&
+                                   peak - levelAt(2 * k) > PHPR_DB && peak - levelAt(k / 2) > PHPR_DB;
+            if (!candidate)
+            {
+                continue;
+            }
+
+            // Continue the longest streak of the neighbouring bins, so slow drift is tolerated
+            size_t from = k;
+            for (size_t j = k - 1; j <= k + 1; ++j)
+            {
+                if (m_previousStreak[j] > m_previousStreak[from])
+                {
+                    from = j;
+                }
+            }
+            m_streak[k] = m_previousStreak[from] + 1;
+            m_streakStartDb[k] = m_previousStreak[from] > 0 ? m_previousStartDb[from] : peak;
+
+            const bool growing = m_streak[k] >= MIN_STREAK && peak - m_streakStartDb[k] >= GROWTH_DB;
+            if (growing || m_streak[k] >= PERSISTENT_STREAK)
+            {
+                // Parabolic interpolation of the peak on the dB spectrum
+                const float left = level[k - 1];
+                const float right = level[k + 1];
+                const float denominator = left - 2.0f * peak + right;
+                const float offset = denominator < 0.0f ? 0.5f * (left - right) / denominator : 0.0f;
+                deployNotch((static_cast<float>(k) + offset) * m_sampleRate / ANALYSIS_SIZE);
+
+                // Judge the notched peak afresh
+                m_streak[k] = 0;
+            }
+        }
+    }
+
+    void detectorLoop()
+    {
+        while (m_running.load(std::memory_order_relaxed))
+        {
+            if (m_clearRequested.exchange(false))
+            {
+                for (size_t n = 0; n < MAX_NOTCHES; ++n)
+                {
+                    m_tracks[n] = NotchTrack();
+                    publish(n);
+                }
+            }
+
+            // Take every complete hop off the queue
+            uint64_t read = m_ringRead.load(std::memory_order_relaxed);
+            while (m_ringWritten.load(std::memory_order_acquire) - read >= ANALYSIS_HOP)
+            {
+                std::memmove(m_history.data(), m_history.data() + ANALYSIS_HOP,
+                             (ANALYSIS_SIZE - ANALYSIS_HOP) * sizeof(float));
+                float *tail = m_history.data() + ANALYSIS_SIZE - ANALYSIS_HOP;
+                for (size_t i = 0; i < ANALYSIS_HOP; ++i)
+                {
+                    tail[i] = m_ring[(read + i) & RING_MASK];
+                }
+                read += ANALYSIS_HOP;
+                m_ringRead.store(read, std::memory_order_release);
+                m_historyFilled += ANALYSIS_HOP;
+
+                if (m_historyFilled >= ANALYSIS_SIZE)
+                {
+                    std::copy(m_history.begin(), m_history.end(), m_frame.begin());
+                    ++m_hop;
+                    analyze();
+                    releaseNotches();
+                }
+            }
+
+            while (sem_wait(&m_hopReady) != 0 && errno == EINTR)
+            {
+            }
+        }
+    }
+
+public:
+    explicit FeedbackSuppressorEffect(unsigned int sampleRate)
+        : m_fft(ANALYSIS_SIZE)
+    {
+        m_sampleRate = sampleRate;
+        for (size_t n = 0; n < MAX_NOTCHES; ++n)
+        {
+            m_publishedFrequency[n].store(0.0f);
+            m_publishedDepth[n].store(0.0f);
+        }
+
+        m_window.resize(ANALYSIS_SIZE);
+        for (size_t i = 0; i < ANALYSIS_SIZE; ++i)
+        {
+            m_window[i] = 0.5f - 0.5f * std::cos(2.0f * static_cast<float>(M_PI) * i / ANALYSIS_SIZE);
+        }
+        m_frame.resize(ANALYSIS_SIZE);
+        m_re.resize(NUM_BINS);
+        m_im.resize(NUM_BINS);
+        m_levelDb.resize(NUM_BINS);
+        m_streak.assign(NUM_BINS, 0);
+        m_previousStreak.assign(NUM_BINS, 0);
+        m_streakStartDb.assign(NUM_BINS, 0.0f);
+        m_previousStartDb.assign(NUM_BINS, 0.0f);
+        m_history.assign(ANALYSIS_SIZE, 0.0f);
+        m_ring.assign(RING_SIZE, 0.0f);
+        sem_init(&m_hopReady, 0, 0);
+
+        m_detector = std::thread(&FeedbackSuppressorEffect::detectorLoop, this);
+    }
+
+    ~FeedbackSuppressorEffect() override
+    {
+        m_running.store(false);
+        sem_post(&m_hopReady);
+        if (m_detector.joinable())
+        {
+            m_detector.join();
+        }
+        sem_destroy(&m_hopReady);
+    }
+
+    static constexpr size_t getMaxNotches() { return MAX_NOTCHES; }
+
+    // Deepest cut a notch may reach after repeated detections
+    void setMaxDepth(float depthDb) { m_maxDepthDb.store(std::clamp(depthDb, DEPTH_STEP_DB, 40.0f)); }
+    float getMaxDepth() const { return m_maxDepthDb.load(); }
+
+    // Drop every notch (handled by the detector thread, which owns the bank)
+    void clearNotches()
+    {
+        m_clearRequested.store(true);
+        sem_post(&m_hopReady);
+    }
+
+    size_t getNotchCount() const
+    {
+        size_t count = 0;
+        for (size_t n = 0; n < MAX_NOTCHES; ++n)
+        {
+            if (m_publishedDepth[n].load(std::memory_order_relaxed) > 0.0f)
+                ++count;
+        }
+        return count;
+    }
+
+    // Frequency and depth of notch slot n (depth 0 when the slot is free)
+    std::pair<float, float> getNotch(size_t n) const
+    {
+        if (n >= MAX_NOTCHES)
+            return {0.0f, 0.0f};
+        return {m_publishedFrequency[n].load(std::memory_order_relaxed),
+                m_publishedDepth[n].load(std::memory_order_relaxed)};
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        ensureBuffers(maxFrames, channels);
+    }
+
+    void reset() override
+    {
+        std::fill(m_z1.begin(), m_z1.end(), 0.0f);
+        std::fill(m_z2.begin(), m_z2.end(), 0.0f);
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels == 0)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        ensureBuffers(numSamples, channels);
+        const size_t totalSamples = numSamples * channels;
+
+        // Feed the detector the un-notched input, as much as the queue has room for
+        const uint64_t written = m_ringWritten.load(std::memory_order_relaxed);
+        const uint64_t space = RING_SIZE - (written - m_ringRead.load(std::memory_order_acquire));
+        const size_t queued = static_cast<size_t>(std::min<uint64_t>(numSamples, space));
+        const float downmix = SampleConversion::INT32_TO_FLOAT / channels;
+        for (size_t i = 0; i < queued; ++i)
+        {
+            float sum = 0.0f;
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                sum += static_cast<float>(inputBuffer[i * channels + ch]);
+            }
+            m_ring[(written + i) & RING_MASK] = sum * downmix;
+        }
+        m_ringWritten.store(written + queued, std::memory_order_release);
+        if ((written + queued) / ANALYSIS_HOP != written / ANALYSIS_HOP)
+        {
+            sem_post(&m_hopReady);
+        }
+
+        applyPublishedNotches();
+
+        float *buffer = m_buffer.data();
+        for (size_t i = 0; i < totalSamples; ++i)
+        {
+            buffer[i] = static_cast<float>(inputBuffer[i]) * SampleConversion::INT32_TO_FLOAT;
+        }
+
+        // Transposed direct form II; the channel loop is innermost so the
+        // recursion runs across channels in parallel
+        for (size_t n = 0; n < MAX_NOTCHES; ++n)
+        {
+            if (!m_notchActive[n])
+            {
+                continue;
+            }
+            const NotchCoefficients c = m_coefficients[n];
+            float *z1 = &m_z1[n * channels];
+            float *z2 = &m_z2[n * channels];
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                float *frame = buffer + i * channels;
+                for (unsigned int ch = 0; ch < channels; ++ch)
+                {
+                    const float x = frame[ch];
+                    const float y = c.b0 * x + z1[ch];
+                    z1[ch] = c.b1 * x - c.a1 * y + z2[ch];
+                    z2[ch] = c.b2 * x - c.a2 * y;
+                    frame[ch] = y;
+                }
+            }
+        }
+
+        for (size_t i = 0; i < totalSamples; ++i)
+        {
+            const float scaled = std::clamp(buffer[i] * SampleConversion::FLOAT_TO_INT32,
+                                            -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT);
+            outputBuffer[i] = static_cast<int32_t>(scaled);
+        }
+    }
+};
+
+// BS.1770 K-weighting: the head-shelf pre-filter followed by the RLB
+// high-pass, derived for any sample rate (they reproduce the standard's
+// coefficient tables at 48 kHz). Runs in place on interleaved frames with
+// the channel loop innermost, so the recursion vectorizes across channels.
+class KWeightingFilter
+{
+private:
+    using Biquad = InterleavedBiquad::Coefficients;
+
+    Biquad m_shelf;
+    Biquad m_highPass;
+    std::vector<float> m_shelfState; // z1, z2 per channel
+    std::vector<float> m_highPassState;
+    unsigned int m_channels = 0;
+
+    static void runBiquad(const Biquad &c, float *state, float *buffer, size_t frames, unsigned int channels)
+    {
+        InterleavedBiquad::run(c, state, buffer, frames, channels);
+    }
+
+public:
+    explicit KWeightingFilter(unsigned int sampleRate = 48000)
+    {
+        setSampleRate(sampleRate);
+    }
+
+    void setSampleRate(unsigned int sampleRate)
+    {
+        const double fs = sampleRate;
+        {
+            const double f0 = 1681.974450955533;
+            const double gainDb = 3.999843853973347;
+            const double q = 0.7071752369554196;
+            const double k = std::tan(M_PI * f0 / fs);
+            const double vh = std::pow(10.0, gainDb / 20.0);
+            const double vb = std::pow(vh, 0.4996667741545416);
+            const double a0 = 1.0 + k / q + k * k;
+            m_shelf.b0 = static_cast<float>((vh + vb * k / q + k * k) / a0);
+            m_shelf.b1 = static_cast<float>(2.0 * (k * k - vh) / a0);
+            m_shelf.b2 = static_cast<float>((vh - vb * k / q + k * k) / a0);
+            m_shelf.a1 = static_cast<float>(2.0 * (k * k - 1.0) / a0);
+            m_shelf.a2 = static_cast<float>((1.0 - k / q + k * k) / a0);
+        }
+        {
+            const double f0 = 38.13547087602444;
+            const double q = 0.5003270373238773;
+            const double k = std::tan(M_PI * f0 / fs);
+            const double a0 = 1.0 + k / q + k * k;
+            m_highPass.b0 = 1.0f;
+            m_highPass.b1 = -2.0f;
+            m_highPass.b2 = 1.0f;
+            m_highPass.a1 = static_cast<float>(2.0 * (k * k - 1.0) / a0);
+            m_highPass.a2 = static_cast<float>((1.0 - k / q + k * k) / a0);
+        }
+    }
+
+    void setChannels(unsigned int channels)
+    {
+        m_channels = channels;
+        m_shelfState.assign(2 * channels, 0.0f);
+        m_highPassState.assign(2 * channels, 0.0f);
+    }
+
+    unsigned int getChannels() const { return m_channels; }
+
+    void clear()
+    {
+        std::fill(m_shelfState.begin(), m_shelfState.end(), 0.0f);
+        std::fill(m_highPassState.begin(), m_highPassState.end(), 0.0f);
+    }
+
+    // Both filters' z1/z2 per channel; restored into a filter already set
+    // to the same channel count
+    void saveState(EffectStateWriter &out) const
+    {
+        out.writeArray(m_shelfState);
+        out.writeArray(m_highPassState);
+    }
+
+    bool restoreState(EffectStateReader &in)
+    {
+        return in.readArray(m_shelfState.data(), m_shelfState.size()) &&
+               in.readArray(m_highPassState.data(), m_highPassState.size());
+    }
+
+    void process(float *buffer, size_t numFrames)
+    {
+        runBiquad(m_shelf, m_shelfState.data(), buffer, numFrames, m_channels);
+        runBiquad(m_highPass, m_highPassState.data(), buffer, numFrames, m_channels);
+    }
+};
+
+// ITU-R BS.1770-4 / EBU R128 loudness meter, updated incrementally. Samples
+// are K-weighted and their squares accumulated into 100 ms sub-blocks; momentary
+// (400 ms) and short-term (3 s) loudness are means over the last 4 and 30
+// sub-blocks. Gated measures never keep past blocks: every 400 ms gating
+// block and every short-term value lands in a 0.1 LU histogram that also
+// sums the power per bin, so adding a block is O(1) and integrated loudness
+// and loudness range (EBU Tech 3342) are rebuilt from fixed-size histograms.
+// Results are published through atomics for readers on other threads.
+class LoudnessMeter
+{
+public:
+    static constexpr float SILENCE = -std::numeric_limits<float>::infinity();
+
+private:
+    static constexpr size_t MOMENTARY_SUBBLOCKS = 4;
+    static constexpr size_t SHORT_TERM_SUBBLOCKS = 30;
+    static constexpr float ABSOLUTE_GATE = -70.0f;
+    static constexpr float INTEGRATED_RELATIVE_GATE = -10.0f;
+    static constexpr float RANGE_RELATIVE_GATE = -20.0f;
+    static constexpr float HISTOGRAM_MAX = 10.0f;
+    static constexpr float HISTOGRAM_STEP = 0.1f;
+    static constexpr size_t HISTOGRAM_BINS = static_cast<size_t>((HISTOGRAM_MAX - ABSOLUTE_GATE) / HISTOGRAM_STEP);
+
+    // Blocks above the absolute gate, bucketed by loudness
+    struct Histogram
+    {
+        std::array<uint32_t, HISTOGRAM_BINS> counts{};
+        std::array<double, HISTOGRAM_BINS> power{};
+        uint64_t total = 0;
+        double totalPower = 0.0;
+
+        void add(double blockPower, float loudness)
+        {
+            const size_t bin = std::min(static_cast<size_t>((loudness - ABSOLUTE_GATE) / HISTOGRAM_STEP), HISTOGRAM_BINS - 1);
+            ++counts[bin];
+            power[bin] += blockPower;
+            ++total;
+            totalPower += blockPower;
+        }
+
+        void clear()
+        {
+            counts.fill(0);
+            power.fill(0.0);
+            total = 0;
+            totalPower = 0.0;
+        }
+
+        // First bin whose lower edge is at or above the loudness
+        static size_t binAbove(float loudness)
+        {
+            const float position = std::ceil((loudness - ABSOLUTE_GATE) / HISTOGRAM_STEP);
+            return static_cast<size_t>(std::clamp(position, 0.0f, static_cast<float>(HISTOGRAM_BINS)));
+        }
+
+        static float binCenter(size_t bin) { return ABSOLUTE_GATE + (bin + 0.5f) * HISTOGRAM_STEP; }
+    };
+
+    KWeightingFilter m_filter;
+    std::vector<float> m_weights;
+    std::vector<double> m_channelSums;
+    std::vector<float> m_buffer;
+    unsigned int m_channels = 0;
+
+    size_t m_subBlockLength;
+    size_t m_subBlockFrames = 0;
+    std::array<double, SHORT_TERM_SUBBLOCKS> m_subBlocks{};
+    size_t m_subBlockIndex = 0;
+    size_t m_subBlocksFilled = 0;
+
+    Histogram m_gatingBlocks;
+    Histogram m_shortTermBlocks;
+
+    std::atomic<bool> m_resetRequested{false};
+    std::atomic<float> m_momentary{SILENCE};
+    std::atomic<float> m_shortTerm{SILENCE};
+    std::atomic<float> m_integrated{SILENCE};
+    std::atomic<float> m_range{0.0f};
+    std::atomic<float> m_maxMomentary{SILENCE};
+    std::atomic<float> m_maxShortTerm{SILENCE};
+
+    static float toLoudness(double power)
+    {
+        return power > 0.0 ? static_cast<float>(-0.691 + 10.0 * std::log10(power)) : SILENCE;
+    }
+
+    void configureChannels(unsigned int channels)
+    {
+        m_channels = channels;
+        m_filter.setChannels(channels);
+        m_channelSums.assign(channels, 0.0);
+
+        // 5.1 (L R C LFE Ls Rs): LFE excluded, surrounds +1.5 dB; otherwise unity
+        m_weights.assign(channels, 1.0f);
+        if (channels == 6)
+        {
+            m_weights[3] = 0.0f;
+            m_weights[4] = 1.41f;
+            m_weights[5] = 1.41f;
+        }
+    }
+
+    void clear()
+    {
+        m_filter.clear();
+        std::fill(m_channelSums.begin(), m_channelSums.end(), 0.0);
+        m_subBlockFrames = 0;
+        m_subBlocks.fill(0.0);
+        m_subBlockIndex = 0;
+        m_subBlocksFilled = 0;
+        m_gatingBlocks.clear();
+        m_shortTermBlocks.clear();
+        m_momentary.store(SILENCE);
+        m_shortTerm.store(SILENCE);
+        m_integrated.store(SILENCE);
+        m_range.store(0.0f);
+        m_maxMomentary.store(SILENCE);
+        m_maxShortTerm.store(SILENCE);
+    }
+
+    double meanOfLast(size_t count) const
+    {
+        double sum = 0.0;
+        for (size_t i = 1; i <= count; ++i)
+        {
+            sum += m_subBlocks[(m_subBlockIndex + SHORT_TERM_SUBBLOCKS - i) % SHORT_TERM_SUBBLOCKS];
+        }
+        return sum / count;
+    }
+
+    float integratedLoudness() const
+    {
+        const Histogram &h = m_gatingBlocks;
+        if (h.total == 0)
+        {
+            return SILENCE;
+        }
+
+        const float threshold = toLoudness(h.totalPower / h.total) + INTEGRATED_RELATIVE_GATE;
+        uint64_t count = 0;
+        double power = 0.0;
+        for (size_t b = Histogram::binAbove(threshold); b < HISTOGRAM_BINS; ++b)
+        {
+            count += h.counts[b];
+            power += h.power[b];
+        }
+        return count > 0 ? toLoudness(power / count) : SILENCE;
+    }
+
+    // EBU Tech 3342: spread between the 10th and 95th percentiles of the
+    // relative-gated short-term loudness distribution
+    float loudnessRange() const
+    {
+        const Histogram &h = m_shortTermBlocks;
+        if (h.total == 0)
+        {
+            return 0.0f;
+        }
+
+        const size_t first = Histogram::binAbove(toLoudness(h.totalPower / h.total) + RANGE_RELATIVE_GATE);
+        uint64_t count = 0;
+        for (size_t b = first; b < HISTOGRAM_BINS; ++b)
+        {
+            count += h.counts[b];
+        }
+        if (count == 0)
+        {
+            return 0.0f;
+        }
+
+        const double lowRank = 0.10 * (count - 1);
+        const double highRank = 0.95 * (count - 1);
+        float low = 0.0f;
+        float high = 0.0f;
+        uint64_t cumulative = 0;
+        bool lowFound = false;
+        for (size_t b = first; b < HISTOGRAM_BINS; ++b)
+        {
+            if (h.counts[b] == 0)
+                continue;
+            cumulative += h.counts[b];
+            if (!lowFound && cumulative > lowRank)
+            {
+                low = Histogram::binCenter(b);
+                lowFound = true;
+            }
+            if (cumulative > highRank)
+            {
+                high = Histogram::binCenter(b);
+                break;
+            }
+        }
+        return high - low;
+    }
+
+    void finishSubBlock()
+    {
+        double power = 0.0;
+        for (unsigned int ch = 0; ch < m_channels; ++ch)
+        {
+            power += m_weights[ch] * m_channelSums[ch];
+            m_channelSums[ch] = 0.0;
+        }
+        power /= static_cast<double>(m_subBlockLength);
+
+        m_subBlocks[m_subBlockIndex] = power;
+        m_subBlockIndex = (m_subBlockIndex + 1) % SHORT_TERM_SUBBLOCKS;
+        ++m_subBlocksFilled;
+        m_subBlockFrames = 0;
+
+        if (m_subBlocksFilled >= MOMENTARY_SUBBLOCKS)
+        {
+            // Each 400 ms momentary window, stepped by 100 ms, is a gating block (75% overlap)
+            const double momentaryPower = meanOfLast(MOMENTARY_SUBBLOCKS);
+            const float momentary = toLoudness(momentaryPower);
+            m_momentary.store(momentary, std::memory_order_relaxed);
+            m_maxMomentary.store(std::max(m_maxMomentary.load(std::memory_order_relaxed), momentary), std::memory_order_relaxed);
+            if (momentary > ABSOLUTE_GATE)
+            {
+                m_gatingBlocks.add(momentaryPower, momentary);
+            }
+            m_integrated.store(integratedLoudness(), std::memory_order_relaxed);
+        }
+
+        const double shortTermPower = meanOfLast(std::min(m_subBlocksFilled, SHORT_TERM_SUBBLOCKS));
+        const float shortTerm = toLoudness(shortTermPower);
+        m_shortTerm.store(shortTerm, std::memory_order_relaxed);
+        if (m_subBlocksFilled >= SHORT_TERM_SUBBLOCKS)
+        {
+            m_maxShortTerm.store(std::max(m_maxShortTerm.load(std::memory_order_relaxed), shortTerm), std::memory_order_relaxed);
+            if (shortTerm > ABSOLUTE_GATE)
+            {
+                m_shortTermBlocks.add(shortTermPower, shortTerm);
+            }
+            m_range.store(loudnessRange(), std::memory_order_relaxed);
+        }
+    }
+
+public:
+    explicit LoudnessMeter(unsigned int sampleRate = 48000)
+        : m_filter(sampleRate), m_subBlockLength(sampleRate / 10)
+    {
+    }
+
+    // Feed interleaved output frames (processing thread)
+    void process(const int32_t *buffer, size_t numFrames, unsigned int channels)
+    {
+        if (channels == 0)
+        {
+            return;
+        }
+        if (channels != m_channels)
+        {
+            configureChannels(channels);
+            clear();
+        }
+        if (m_resetRequested.exchange(false))
+        {
+            clear();
+        }
+
+        size_t done = 0;
+        while (done < numFrames)
+        {
+            const size_t count = std::min(numFrames - done, m_subBlockLength - m_subBlockFrames);
+            const size_t samples = count * channels;
+            if (m_buffer.size() < samples)
+            {
+                m_buffer.resize(samples);
+            }
+
+            float *data = m_buffer.data();
+            const int32_t *input = buffer + done * channels;
+            for (size_t i = 0; i < samples; ++i)
+            {
+                data[i] = static_cast<float>(input[i]) * SampleConversion::INT32_TO_FLOAT;
+            }
+            m_filter.process(data, count);
+
+            for (unsigned int ch = 0; ch < channels; ++ch)
+            {
+                float sum = 0.0f;
+                for (size_t i = 0; i < count; ++i)
+                {
+                    const float y = data[i * channels + ch];
+                    sum += y * y;
+                }
+                m_channelSums[ch] += sum;
+            }
+
+            m_subBlockFrames += count;
+            done += count;
+            if (m_subBlockFrames == m_subBlockLength)
+            {
+                finishSubBlock();
+            }
+        }
+    }
+
+    // Start a new measurement; safe from any thread, applied on the next process()
+    void reset() { m_resetRequested.store(true); }
+
+    float getMomentary() const { return m_momentary.load(std::memory_order_relaxed); }
+    float getShortTerm() const { return m_shortTerm.load(std::memory_order_relaxed); }
+    float getIntegrated() const { return m_integrated.load(std::memory_order_relaxed); }
+    float getLoudnessRange() const { return m_range.load(std::memory_order_relaxed); }
+    float getMaxMomentary() const { return m_maxMomentary.load(std::memory_order_relaxed); }
+    float getMaxShortTerm() const { return m_maxShortTerm.load(std::memory_order_relaxed); }
+};
+
+// Automatic gain control that brings the input to a target loudness so the
+// downstream effects always see a predictable level. The level is measured
+// per 10 ms block: K-weighted mean square, smoothed in the power domain over
+// ~400 ms (the momentary loudness window), so there is one log10 and one
+// pow per block and none per sample. The block's gain target is limited by
+// separate boost and cut slew rates and gated below GATE_LOUDNESS so pauses
+// don't pump the noise floor up. Each sample gets a linear ramp from the
+// previous block's gain, a contiguous multiply that vectorizes.
+class AgcEffect : public AudioEffect
+{
+private:
+    static constexpr float BLOCK_SECONDS = 0.01f;
+    static constexpr float ENVELOPE_SECONDS = 0.4f;
+    static constexpr float GATE_LOUDNESS = -50.0f;   // LUFS below which the gain holds
+    static constexpr float BOOST_RATE_DB = 6.0f;     // Per second
+    static constexpr float CUT_RATE_DB = 30.0f;      // Per second
+
+    KWeightingFilter m_filter;
+    size_t m_blockLength;
+    size_t m_blockPosition = 0;
+    double m_blockPower = 0.0;
+    float m_envelopeCoeff;
+    float m_gatePower;
+    float m_power = 0.0f;
+    bool m_primed = false;
+
+    float m_targetLoudness;
+    float m_maxBoost;
+    float m_maxCut;
+
+    float m_gainDb = 0.0f;
+    float m_gain = 1.0f;     // Linear gain at the current ramp position
+    float m_targetGain = 1.0f; // Linear gain at the end of the current block
+    float m_gainStep = 0.0f; // Per-frame increment across the current block
+    std::atomic<float> m_reportedGainDb{0.0f};
+
+    std::vector<std::vector<float>> m_planar;
+    std::vector<float> m_weighted;
+    std::vector<float> m_ramp;
+
+    void configure(unsigned int sampleRate)
+    {
+        m_filter.setSampleRate(sampleRate);
+        m_blockLength = std::max<size_t>(1, static_cast<size_t>(sampleRate * BLOCK_SECONDS));
+        m_envelopeCoeff = 1.0f - std::exp(-BLOCK_SECONDS / ENVELOPE_SECONDS);
+        m_gatePower = std::pow(10.0f, (GATE_LOUDNESS + 0.691f) / 10.0f);
+    }
+
+    // Called at each block boundary: new gain target, ramped over the next block
+    void updateGain()
+    {
+        // Channel powers add, as in BS.1770
+        const float blockPower = static_cast<float>(m_blockPower / m_blockLength);
+        m_blockPower = 0.0;
+
+        // Seed the envelope with the first block so startup doesn't ramp in from silence
+        m_power = m_primed ? m_power + m_envelopeCoeff * (blockPower - m_power) : blockPower;
+        m_primed = true;
+
+        // Gate on the block itself too, so the decay into a pause doesn't
+        // read as a quiet passage worth boosting
+        if (blockPower > m_gatePower && m_power > m_gatePower)
+        {
+            const float loudness = -0.691f + 10.0f * std::log10(m_power);
+            const float wanted = std::clamp(m_targetLoudness - loudness, -m_maxCut, m_maxBoost);
+            const float maxRise = BOOST_RATE_DB * BLOCK_SECONDS;
+            const float maxFall = CUT_RATE_DB * BLOCK_SECONDS;
+            m_gainDb += std::clamp(wanted - m_gainDb, -maxFall, maxRise);
+        }
+        // A lowered maximum applies even while gated
+        m_gainDb = std::clamp(m_gainDb, -m_maxCut, m_maxBoost);
+        m_reportedGainDb.store(m_gainDb, std::memory_order_relaxed);
+
+        m_targetGain = std::pow(10.0f, m_gainDb / 20.0f);
+        m_gainStep = (m_targetGain - m_gain) / static_cast<float>(m_blockLength);
+    }
+
+    void setChannels(unsigned int channels)
+    {
+        m_filter.setChannels(channels);
+        m_planar.assign(channels, std::vector<float>(m_ramp.size()));
+        m_weighted.resize(m_ramp.size() * channels);
+    }
+
+    void ensureScratch(size_t numFrames, unsigned int channels)
+    {
+        if (m_filter.getChannels() != channels)
+        {
+            setChannels(channels);
+        }
+        if (m_ramp.size() < numFrames)
+        {
+            m_ramp.resize(numFrames);
+            m_weighted.resize(numFrames * channels);
+            for (auto &buffer : m_planar)
+            {
+                buffer.resize(numFrames);
+            }
+        }
+    }
+
+public:
+    AgcEffect(unsigned int sampleRate, float targetLoudness = -23.0f,
+              float maxBoostDb = 24.0f, float maxCutDb = 12.0f)
+        : m_filter(sampleRate)
+    {
+        m_sampleRate = sampleRate;
+        configure(sampleRate);
+        setTargetLoudness(targetLoudness);
+        setMaxBoost(maxBoostDb);
+        setMaxCut(maxCutDb);
+    }
+
+    void setTargetLoudness(float lufs) { m_targetLoudness = std::clamp(lufs, -40.0f, -6.0f); }
+    void setMaxBoost(float db) { m_maxBoost = std::clamp(db, 0.0f, 40.0f); }
+    void setMaxCut(float db) { m_maxCut = std::clamp(db, 0.0f, 40.0f); }
+
+    float getTargetLoudness() const { return m_targetLoudness; }
+    float getMaxBoost() const { return m_maxBoost; }
+    float getMaxCut() const { return m_maxCut; }
+
+    // Gain currently being applied (dB); safe from any thread
+    float getGain() const { return m_reportedGainDb.load(std::memory_order_relaxed); }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        AudioEffect::setSampleRate(sampleRate);
+        configure(sampleRate);
+        reset();
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        ensureScratch(maxFrames, channels);
+    }
+
+    void reset() override
+    {
+        m_filter.clear();
+        m_blockPosition = 0;
+        m_blockPower = 0.0;
+        m_power = 0.0f;
+        m_primed = false;
+        m_gainDb = 0.0f;
+        m_gain = 1.0f;
+        m_targetGain = 1.0f;
+        m_gainStep = 0.0f;
+        m_reportedGainDb.store(0.0f, std::memory_order_relaxed);
+    }
+
+    // Targets, the gain trajectory and the measurement in progress, so a
+    // restart resumes at the level it left off instead of ramping from unity
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(m_filter.getChannels());
+        m_filter.saveState(out);
+        out.write(m_targetLoudness);
+        out.write(m_maxBoost);
+        out.write(m_maxCut);
+        out.write(m_blockPosition);
+        out.write(m_blockPower);
+        out.write(m_power);
+        out.write(m_primed);
+        out.write(m_gainDb);
+        out.write(m_gain);
+        out.write(m_targetGain);
+        out.write(m_gainStep);
+    }
+
+    // The filter state is read in place (a failed restore resets it); the
+    // layout goes back and nothing else changes unless the whole record reads
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        unsigned int channels = 0;
+        float targetLoudness = 0.0f;
+        float maxBoost = 0.0f;
+        float maxCut = 0.0f;
+        size_t blockPosition = 0;
+        double blockPower = 0.0;
+        float power = 0.0f;
+        bool primed = false;
+        float gainDb = 0.0f;
+        float gain = 0.0f;
+        float targetGain = 0.0f;
+        float gainStep = 0.0f;
+        if (!in.read(enabled) || !in.read(channels) || channels > MAX_SNAPSHOT_CHANNELS)
+            return false;
+        const unsigned int previousChannels = m_filter.getChannels();
+        if (channels != previousChannels)
+        {
+            setChannels(channels);
+        }
+        if (!m_filter.restoreState(in) || !in.read(targetLoudness) || !in.read(maxBoost) ||
+            !in.read(maxCut) || !in.read(blockPosition) || !in.read(blockPower) || !in.read(power) ||
+            !in.read(primed) || !in.read(gainDb) || !in.read(gain) || !in.read(targetGain) ||
+            !in.read(gainStep) || blockPosition >= m_blockLength)
+        {
+            if (channels != previousChannels)
+            {
+                setChannels(previousChannels);
+            }
+            return false;
+        }
+        m_enabled = enabled;
+        setTargetLoudness(targetLoudness);
+        setMaxBoost(maxBoost);
+        setMaxCut(maxCut);
+        m_blockPosition = blockPosition;
+        m_blockPower = blockPower;
+        m_power = power;
+        m_primed = primed;
+        m_gainDb = gainDb;
+        m_gain = gain;
+        m_targetGain = targetGain;
+        m_gainStep = gainStep;
+        m_reportedGainDb.store(m_gainDb, std::memory_order_relaxed);
+        return true;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels == 0)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        ensureScratch(numSamples, channels);
+
+        // Level detection on a K-weighted copy
+        float *weighted = m_weighted.data();
+        for (size_t i = 0; i < numSamples * channels; ++i)
+        {
+            weighted[i] = static_cast<float>(inputBuffer[i]) * SampleConversion::INT32_TO_FLOAT;
+        }
+        m_filter.process(weighted, numSamples);
+
+        // Gain ramp, one segment per block; detection lags by one block
+        float *ramp = m_ramp.data();
+        size_t done = 0;
+        while (done < numSamples)
+        {
+            const size_t count = std::min(m_blockLength - m_blockPosition, numSamples - done);
+
+            float power = 0.0f;
+            const float *block = weighted + done * channels;
+            for (size_t i = 0; i < count * channels; ++i)
+            {
+                power += block[i] * block[i];
+            }
+            m_blockPower += power;
+
+            const float start = m_gain;
+            const float step = m_gainStep;
+            for (size_t i = 0; i < count; ++i)
+            {
+                ramp[done + i] = start + step * static_cast<float>(i + 1);
+            }
+            m_gain = start + step * static_cast<float>(count);
+
+            m_blockPosition += count;
+            done += count;
+            if (m_blockPosition == m_blockLength)
+            {
+                // Land exactly on the target so rounding doesn't accumulate
+                m_gain = m_targetGain;
+                m_blockPosition = 0;
+                updateGain();
+            }
+        }
+
+        for (unsigned int ch = 0; ch < channels; ++ch)
+        {
+            float *samples = m_planar[ch].data();
+            SampleConversion::deinterleave(inputBuffer, samples, numSamples, channels, ch);
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                samples[i] *= ramp[i];
+            }
+            SampleConversion::interleave(samples, outputBuffer, numSamples, channels, ch);
+        }
+    }
+};
+
+// Mid/side conversion of interleaved stereo int32, in place or between
+// buffers. The int64 intermediates keep M = (L + R) / 2 and S = (L - R) / 2
+// from overflowing. The halving floors, so when L + R is odd both drop their
+// low bit and a round trip returns L one LSB low (R is exact). The loops are
+// branch-free so they vectorize.
+namespace MidSide
+{
+    inline void encode(const int32_t *input, int32_t *output, size_t numFrames)
+    {
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+            const int64_t left = input[2 * i];
+            const int64_t right = input[2 * i + 1];
+            output[2 * i] = static_cast<int32_t>((left + right) >> 1);
+            output[2 * i + 1] = static_cast<int32_t>((left - right) >> 1);
+        }
+    }
+
+    inline void decode(int32_t *buffer, size_t numFrames)
+    {
+        constexpr int64_t MIN = std::numeric_limits<int32_t>::min();
+        constexpr int64_t MAX = std::numeric_limits<int32_t>::max();
+        for (size_t i = 0; i < numFrames; ++i)
+        {
+            const int64_t mid = buffer[2 * i];
+            const int64_t side = buffer[2 * i + 1];
+            buffer[2 * i] = static_cast<int32_t>(std::clamp(mid + side, MIN, MAX));
+            buffer[2 * i + 1] = static_cast<int32_t>(std::clamp(mid - side, MIN, MAX));
+        }
+    }
+}
+
+// Stereo width: scales the side signal (0 = mono, 1 = unchanged, 2 = wide).
+// Inside a mid/side span this is a single multiply on the side channel;
+// on left/right buffers it converts on the fly.
+class StereoWidthEffect : public AudioEffect
+{
+private:
+    float m_width;
+
+public:
+    explicit StereoWidthEffect(float width = 1.0f)
+    {
+        setWidth(width);
+    }
+
+    void setWidth(float width) { m_width = std::clamp(width, 0.0f, 2.0f); }
+    float getWidth() const { return m_width; }
+
+    void reset() override {}
+
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(m_width);
+    }
+
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        float width = 1.0f;
+        if (!in.read(enabled) || !in.read(width))
+            return false;
+        m_enabled = enabled;
+        setWidth(width);
+        return true;
+    }
+
+    // Unity width is skipped by the chain rather than rounded through float
+    bool isBypassed(unsigned int channels) const override
+    {
+        return !m_enabled || channels != 2 || m_width == 1.0f;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels != 2)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        const float width = m_width;
+        if (m_channelDomain == ChannelDomain::MID_SIDE)
+        {
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                const float side = static_cast<float>(inputBuffer[2 * i + 1]) * width;
+                outputBuffer[2 * i] = inputBuffer[2 * i];
+                outputBuffer[2 * i + 1] = static_cast<int32_t>(std::clamp(side, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT));
+            }
+            return;
+        }
+
+        // L' = M + wS, R' = M - wS
+        const float direct = 0.5f * (1.0f + width);
+        const float cross = 0.5f * (1.0f - width);
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            const float left = static_cast<float>(inputBuffer[2 * i]);
+            const float right = static_cast<float>(inputBuffer[2 * i + 1]);
+            const float newLeft = direct * left + cross * right;
+            const float newRight = cross * left + direct * right;
+            outputBuffer[2 * i] = static_cast<int32_t>(std::clamp(newLeft, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT));
+            outputBuffer[2 * i + 1] = static_cast<int32_t>(std::clamp(newRight, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT));
+        }
+    }
+};
+
+// Headphone crossfeed: each ear also hears the other channel low-passed and
+// delayed by about the interaural time, while its own lows are reduced by
+// the same amount so centred content keeps unity gain:
+//   L' = L - g LP(L) + g D(LP(R))
+// In mid/side that separates into M' = M + g (D(LP(M)) - LP(M)) and
+// S' = S - g (D(LP(S)) + LP(S)), so the effect always works on planar M/S,
+// read straight from the buffer inside a mid/side span or converted here.
+class CrossfeedEffect : public AudioEffect
+{
+private:
+    static constexpr float DELAY_MS = 0.3f;
+    static constexpr float MIN_FEED_DB = -20.0f;
+    static constexpr float MAX_FEED_DB = -3.0f;
+
+    float m_cutoffHz;
+    float m_feed;
+    float m_lowPassCoeff;
+    size_t m_delay;
+    std::array<float, 2> m_lowPassState{};
+    std::array<std::vector<float>, 2> m_lowPassed; // m_delay samples of history, then the block
+    std::array<std::vector<float>, 2> m_planar;
+
+    static float feedFromDb(float feedDb)
+    {
+        const float ratio = std::pow(10.0f, feedDb / 20.0f);
+        return ratio / (1.0f + ratio);
+    }
+
+    void updateLowPass()
+    {
+        m_lowPassCoeff = 1.0f - std::exp(-2.0f * static_cast<float>(M_PI) * m_cutoffHz / m_sampleRate);
+    }
+
+    void updateCoefficients()
+    {
+        updateLowPass();
+        m_delay = std::max<size_t>(1, static_cast<size_t>(DELAY_MS * m_sampleRate / 1000.0f + 0.5f));
+        // Keep room for the largest block seen so far after the new history
+        for (auto &history : m_lowPassed)
+        {
+            history.assign(m_delay + m_planar[0].size(), 0.0f);
+        }
+    }
+
+    void ensureScratch(size_t numFrames)
+    {
+        for (size_t c = 0; c < 2; ++c)
+        {
+            if (m_planar[c].size() < numFrames)
+            {
+                m_planar[c].resize(numFrames);
+            }
+            if (m_lowPassed[c].size() < m_delay + numFrames)
+            {
+                m_lowPassed[c].resize(m_delay + numFrames);
+            }
+        }
+    }
+
+public:
+    CrossfeedEffect(unsigned int sampleRate, float cutoffHz = 700.0f, float feedDb = -8.0f)
+        : m_cutoffHz(cutoffHz)
+    {
+        m_sampleRate = sampleRate;
+        setFeed(feedDb);
+        setCutoff(cutoffHz);
+    }
+
+    // Level of the opposite channel's lows relative to the direct ones; at
+    // low frequencies the direct path is 1 - g and the crossed one g
+    void setFeed(float feedDb)
+    {
+        m_feed = feedFromDb(std::clamp(feedDb, MIN_FEED_DB, MAX_FEED_DB));
+    }
+    void setCutoff(float cutoffHz)
+    {
+        m_cutoffHz = std::clamp(cutoffHz, 300.0f, 2000.0f);
+        updateCoefficients();
+    }
+
+    float getFeed() const { return 20.0f * std::log10(m_feed / (1.0f - m_feed)); }
+    float getCutoff() const { return m_cutoffHz; }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        AudioEffect::setSampleRate(sampleRate);
+        updateCoefficients();
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        if (channels == 2)
+        {
+            ensureScratch(maxFrames);
+        }
+    }
+
+    void reset() override
+    {
+        m_lowPassState.fill(0.0f);
+        for (auto &history : m_lowPassed)
+        {
+            std::fill(history.begin(), history.end(), 0.0f);
+        }
+    }
+
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write(m_cutoffHz);
+        out.write(m_feed);
+        out.write(m_lowPassState);
+        for (const auto &history : m_lowPassed)
+        {
+            out.writeArray(history.data(), m_delay);
+        }
+    }
+
+    // The history length follows the sample rate alone, so it is read in
+    // place; the rest is committed once it has read
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        float cutoffHz = 0.0f;
+        float feed = 0.0f;
+        std::array<float, 2> lowPassState{};
+        if (!in.read(enabled) || !in.read(cutoffHz) || !in.read(feed) || !in.read(lowPassState))
+            return false;
+        // A feed setFeed() could not produce is rejected, not clamped
+        if (!(feed >= feedFromDb(MIN_FEED_DB) && feed <= feedFromDb(MAX_FEED_DB)))
+            return false;
+        for (auto &history : m_lowPassed)
+        {
+            if (!in.readArray(history.data(), m_delay))
+                return false;
+        }
+        m_enabled = enabled;
+        m_cutoffHz = std::clamp(cutoffHz, 300.0f, 2000.0f);
+        updateLowPass();
+        m_feed = feed;
+        m_lowPassState = lowPassState;
+        return true;
+    }
+
+    bool isBypassed(unsigned int channels) const override
+    {
+        return !m_enabled || channels != 2;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled || channels != 2)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        ensureScratch(numSamples);
+
+        float *mid = m_planar[0].data();
+        float *side = m_planar[1].data();
+        const bool midSide = m_channelDomain == ChannelDomain::MID_SIDE;
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            const float a = static_cast<float>(inputBuffer[2 * i]) * SampleConversion::INT32_TO_FLOAT;
+            const float b = static_cast<float>(inputBuffer[2 * i + 1]) * SampleConversion::INT32_TO_FLOAT;
+            mid[i] = midSide ? a : 0.5f * (a + b);
+            side[i] = midSide ? b : 0.5f * (a - b);
+        }
+
+        // One-pole low-pass of both signals, written after the delay history
+        for (size_t c = 0; c < 2; ++c)
+        {
+            const float *input = m_planar[c].data();
+            float *lowPassed = m_lowPassed[c].data() + m_delay;
+            float state = m_lowPassState[c];
+            for (size_t i = 0; i < numSamples; ++i)
+            {
+                state += m_lowPassCoeff * (input[i] - state);
+                lowPassed[i] = state;
+            }
+            m_lowPassState[c] = state;
+        }
+
+        const float feed = m_feed;
+        const float *midLow = m_lowPassed[0].data();
+        const float *sideLow = m_lowPassed[1].data();
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            mid[i] += feed * (midLow[i] - midLow[i + m_delay]);
+            side[i] -= feed * (sideLow[i] + sideLow[i + m_delay]);
+        }
+
+        for (size_t c = 0; c < 2; ++c)
+        {
+            float *lowPassed = m_lowPassed[c].data();
+            std::copy(lowPassed + numSamples, lowPassed + numSamples + m_delay, lowPassed);
+        }
+
+        for (size_t i = 0; i < numSamples; ++i)
+        {
+            const float a = midSide ? mid[i] : mid[i] + side[i];
+            const float b = midSide ? side[i] : mid[i] - side[i];
+            outputBuffer[2 * i] = static_cast<int32_t>(std::clamp(a * SampleConversion::FLOAT_TO_INT32, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT));
+            outputBuffer[2 * i + 1] = static_cast<int32_t>(std::clamp(b * SampleConversion::FLOAT_TO_INT32, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT));
+        }
+    }
+};
+
+// Linkwitz-Riley (LR4) band splitter. Each crossover is a pair of cascaded
+// Butterworth biquads per side; the input is split at the lowest crossover
+// first and the high side is split again at the next one. Bands that skip
+// the later crossovers get the matching LR4 allpass (LP4 + HP4 of that
+// crossover) instead, so all bands share the same phase response and their
+// sum has a flat magnitude. Filters run on interleaved float frames with the
+// channel loop innermost, so the recursions vectorize across channels.
+class MultibandSplitter
+{
+private:
+    using Biquad = InterleavedBiquad::Coefficients;
+
+    struct Crossover
+    {
+        float frequency;
+        Biquad lowPass;
+        Biquad highPass;
+        Biquad allPass;
+    };
+
+    unsigned int m_sampleRate;
+    unsigned int m_channels = 0;
+    std::vector<Crossover> m_crossovers;
+
+    // Filter state, z1 and z2 per channel per section:
+    //   m_lowState[k]:  the two low-pass sections of band k
+    //   m_highState[k]: the two high-pass sections of the remainder at crossover k
+    //   m_allPassState[k][j]: band k's allpass for crossover j > k
+    std::vector<std::vector<float>> m_lowState;
+    std::vector<std::vector<float>> m_highState;
+    std::vector<std::vector<std::vector<float>>> m_allPassState;
+
+    std::vector<float> m_remainder;
+    std::vector<float> m_work;
+    std::vector<std::vector<int32_t>> m_bands;
+
+    static void runBiquad(const Biquad &c, float *state, float *buffer, size_t frames, unsigned int channels)
+    {
+        InterleavedBiquad::run(c, state, buffer, frames, channels);
+    }
+
+    void updateCrossover(Crossover &crossover)
+    {
+        // Butterworth sections, Q = 1/sqrt(2)
+        const double w0 = 2.0 * M_PI * crossover.frequency / m_sampleRate;
+        const double cosW = std::cos(w0);
+        const double alpha = std::sin(w0) / std::sqrt(2.0);
+        const double a0 = 1.0 + alpha;
+        const float a1 = static_cast<float>(-2.0 * cosW / a0);
+        const float a2 = static_cast<float>((1.0 - alpha) / a0);
+
+        const float low = static_cast<float>((1.0 - cosW) / 2.0 / a0);
+        crossover.lowPass = {low, 2.0f * low, low, a1, a2};
+        const float high = static_cast<float>((1.0 + cosW) / 2.0 / a0);
+        crossover.highPass = {high, -2.0f * high, high, a1, a2};
+        crossover.allPass = {a2, a1, 1.0f, a1, a2};
+    }
+
+    void allocateState()
+    {
+        const size_t numCrossovers = m_crossovers.size();
+        const size_t sectionState = 2 * m_channels;
+        m_lowState.assign(numCrossovers, std::vector<float>(2 * sectionState, 0.0f));
+        m_highState.assign(numCrossovers, std::vector<float>(2 * sectionState, 0.0f));
+        m_allPassState.assign(numCrossovers, std::vector<std::vector<float>>(numCrossovers, std::vector<float>(sectionState, 0.0f)));
+    }
+
+    void reserveBuffers(size_t totalSamples)
+    {
+        if (m_remainder.size() < totalSamples)
+        {
+            m_remainder.resize(totalSamples);
+            m_work.resize(totalSamples);
+            for (auto &band : m_bands)
+            {
+                band.resize(totalSamples);
+            }
+        }
+    }
+
+    void writeBand(size_t band, const float *samples, size_t totalSamples)
+    {
+        int32_t *output = m_bands[band].data();
+        for (size_t i = 0; i < totalSamples; ++i)
+        {
+            const float scaled = std::clamp(samples[i] * SampleConversion::FLOAT_TO_INT32, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT);
+            output[i] = static_cast<int32_t>(scaled);
+        }
+    }
+
+public:
+    // crossoverHz must be ascending; N crossovers give N + 1 bands
+    MultibandSplitter(unsigned int sampleRate, const std::vector<float> &crossoverHz)
+        : m_sampleRate(sampleRate)
+    {
+        for (float frequency : crossoverHz)
+        {
+            Crossover crossover{};
+            crossover.frequency = frequency;
+            m_crossovers.push_back(crossover);
+        }
+        m_bands.resize(m_crossovers.size() + 1);
+        setSampleRate(sampleRate);
+    }
+
+    size_t getBandCount() const { return m_bands.size(); }
+
+    void setSampleRate(unsigned int sampleRate)
+    {
+        m_sampleRate = sampleRate;
+        for (size_t k = 0; k < m_crossovers.size(); ++k)
+        {
+            setCrossover(k, m_crossovers[k].frequency);
+        }
+    }
+
+    // Kept between the neighbouring crossovers so the band order holds
+    void setCrossover(size_t index, float frequency)
+    {
+        if (index >= m_crossovers.size())
+            return;
+
+        const float lower = (index > 0) ? m_crossovers[index - 1].frequency : 20.0f;
+        const float upper = (index + 1 < m_crossovers.size()) ? m_crossovers[index + 1].frequency
+                                                               : 0.45f * m_sampleRate;
+        m_crossovers[index].frequency = std::clamp(frequency, lower, upper);
+        updateCrossover(m_crossovers[index]);
+    }
+
+    float getCrossover(size_t index) const
+    {
+        return (index < m_crossovers.size()) ? m_crossovers[index].frequency : 0.0f;
+    }
+
+    // Size the filter state and band buffers up front, so split() doesn't
+    // allocate for blocks of up to maxFrames
+    void prepare(size_t maxFrames, unsigned int channels)
+    {
+        if (channels != m_channels)
+        {
+            m_channels = channels;
+            allocateState();
+        }
+        reserveBuffers(maxFrames * channels);
+    }
+
+    // Zeroes the filter state in place
+    void reset()
+    {
+        for (auto &state : m_lowState)
+            std::fill(state.begin(), state.end(), 0.0f);
+        for (auto &state : m_highState)
+            std::fill(state.begin(), state.end(), 0.0f);
+        for (auto &band : m_allPassState)
+        {
+            for (auto &state : band)
+                std::fill(state.begin(), state.end(), 0.0f);
+        }
+    }
+
+    // Crossover frequencies and the filter state; restored into a splitter
+    // with the same number of crossovers and channels
+    void saveState(EffectStateWriter &out) const
+    {
+        out.write(m_channels);
+        for (const Crossover &crossover : m_crossovers)
+        {
+            out.write(crossover.frequency);
+        }
+        for (const auto *states : {&m_lowState, &m_highState})
+        {
+            for (const auto &state : *states)
+                out.writeArray(state);
+        }
+        for (const auto &band : m_allPassState)
+        {
+            for (const auto &state : band)
+                out.writeArray(state);
+        }
+    }
+
+    // The filter state is read in place; the frequencies are set once the
+    // whole state has read
+    bool restoreState(EffectStateReader &in)
+    {
+        unsigned int channels = 0;
+        if (!in.read(channels) || channels != m_channels)
+            return false;
+        std::vector<float> frequencies(m_crossovers.size());
+        for (float &frequency : frequencies)
+        {
+            if (!in.read(frequency))
+                return false;
+        }
+        for (auto *states : {&m_lowState, &m_highState})
+        {
+            for (auto &state : *states)
+            {
+                if (!in.readArray(state.data(), state.size()))
+                    return false;
+            }
+        }
+        for (auto &band : m_allPassState)
+        {
+            for (auto &state : band)
+            {
+                if (!in.readArray(state.data(), state.size()))
+                    return false;
+            }
+        }
+        // All frequencies first, so each is kept between its new neighbours
+        for (size_t k = 0; k < frequencies.size(); ++k)
+        {
+            m_crossovers[k].frequency = frequencies[k];
+        }
+        for (size_t k = 0; k < frequencies.size(); ++k)
+        {
+            setCrossover(k, frequencies[k]);
+        }
+        return true;
+    }
+
+    // Split one block into getBandCount() interleaved buffers of the same
+    // layout as the input
+    void split(const int32_t *input, size_t numSamples, unsigned int channels)
+    {
+        if (channels != m_channels)
+        {
+            m_channels = channels;
+            allocateState();
+        }
+
+        const size_t totalSamples = numSamples * channels;
+        reserveBuffers(totalSamples);
+
+        for (size_t i = 0; i < totalSamples; ++i)
+        {
+            m_remainder[i] = static_cast<float>(input[i]) * SampleConversion::INT32_TO_FLOAT;
+        }
+
+        const size_t sectionState = 2 * channels;
+        for (size_t k = 0; k < m_crossovers.size(); ++k)
+        {
+            const Crossover &crossover = m_crossovers[k];
+
+            std::copy(m_remainder.begin(), m_remainder.begin() + totalSamples, m_work.begin());
+            runBiquad(crossover.lowPass, m_lowState[k].data(), m_work.data(), numSamples, channels);
+            runBiquad(crossover.lowPass, m_lowState[k].data() + sectionState, m_work.data(), numSamples, channels);
+            for (size_t j = k + 1; j < m_crossovers.size(); ++j)
+            {
+                runBiquad(m_crossovers[j].allPass, m_allPassState[k][j].data(), m_work.data(), numSamples, channels);
+            }
+            writeBand(k, m_work.data(), totalSamples);
+
+            runBiquad(crossover.highPass, m_highState[k].data(), m_remainder.data(), numSamples, channels);
+            runBiquad(crossover.highPass, m_highState[k].data() + sectionState, m_remainder.data(), numSamples, channels);
+        }
+        writeBand(m_crossovers.size(), m_remainder.data(), totalSamples);
+    }
+
+    int32_t *getBand(size_t band) { return m_bands[band].data(); }
+    const int32_t *getBand(size_t band) const { return m_bands[band].data(); }
+};
+
+// Channel routing and mixing matrix: output channel j receives the sum over
+// input channels i of gain(j, i) * input i, for any input and output channel
+// counts. Matrix changes are posted from the control thread and picked up at
+// the next block, where the gains ramp linearly to the new values. Outside a
+// ramp the matrix is classified once and processed by the cheapest kernel
+// that reproduces it:
+//   IDENTITY     same channel count, output j = input j (a memcpy)
+//   PERMUTATION  every output copies one input (or is silent), unit gain
+//   DIAGONAL     every output is one input (or silent) times a gain
+//   DENSE        anything else: planar float multiply-adds over the block
+// Input and output buffers must not overlap.
+class ChannelMatrix
+{
+public:
+    enum Kernel
+    {
+        IDENTITY,
+        PERMUTATION,
+        DIAGONAL,
+        DENSE
+    };
+
+private:
+    unsigned int m_inputs;
+    unsigned int m_outputs;
+
+    // Gains in output-major order, [out * m_inputs + in]
+    std::vector<float> m_current;
+    std::vector<float> m_target;
+    std::vector<float> m_step;
+    size_t m_rampFrames;
+    size_t m_rampRemaining = 0;
+
+    // Classification of m_current, valid outside ramps. Written by the audio
+    // thread, atomic so status output can read it
+    std::atomic<Kernel> m_kernel{IDENTITY};
+    std::vector<int> m_source; // Input feeding each output, -1 for silence
+    std::vector<float> m_sourceGain;
+
+    // Control side: the latest posted matrix
+    std::mutex m_pendingMutex;
+    std::vector<float> m_pending;
+    std::atomic<bool> m_changed{false};
+
+    std::vector<std::vector<float>> m_planarInput;
+    std::vector<float> m_accumulator;
+
+    void classify()
+    {
+        bool unitGains = true;
+        bool identity = m_inputs == m_outputs;
+        for (unsigned int out = 0; out < m_outputs; ++out)
+        {
+            int source = -1;
+            for (unsigned int in = 0; in < m_inputs; ++in)
+            {
+                if (m_current[out * m_inputs + in] == 0.0f)
+                    continue;
+                if (source >= 0)
+                {
+                    m_kernel.store(DENSE, std::memory_order_relaxed);
+                    return;
+                }
+                source = static_cast<int>(in);
+            }
+
+            m_source[out] = source;
+            m_sourceGain[out] = (source >= 0) ? m_current[out * m_inputs + source] : 0.0f;
+            unitGains = unitGains && (source < 0 || m_sourceGain[out] == 1.0f);
+            identity = identity && source == static_cast<int>(out) && m_sourceGain[out] == 1.0f;
+        }
+
+        m_kernel.store(identity ? IDENTITY : (unitGains ? PERMUTATION : DIAGONAL), std::memory_order_relaxed);
+    }
+
+    void acceptPending()
+    {
+        if (!m_changed.load(std::memory_order_acquire) || !m_pendingMutex.try_lock())
+            return;
+
+        m_target = m_pending;
+        m_changed.store(false, std::memory_order_relaxed);
+        m_pendingMutex.unlock();
+
+        if (m_rampFrames == 0)
+        {
+            m_current = m_target;
+            m_rampRemaining = 0;
+            classify();
+            return;
+        }
+
+        for (size_t n = 0; n < m_target.size(); ++n)
+        {
+            m_step[n] = (m_target[n] - m_current[n]) / static_cast<float>(m_rampFrames);
+        }
+        m_rampRemaining = m_rampFrames;
+    }
+
+    void reserveScratch(size_t numFrames)
+    {
+        if (m_accumulator.size() < numFrames)
+        {
+            m_accumulator.resize(numFrames);
+            for (auto &channel : m_planarInput)
+            {
+                channel.resize(numFrames);
+            }
+        }
+    }
+
+    // Planar multiply-add of every nonzero gain; with ramping, gain n moves
+    // by m_step[n] per frame and m_current is advanced past the block
+    void mixDense(const int32_t *input, int32_t *output, size_t numFrames, bool ramping)
+    {
+        for (unsigned int in = 0; in < m_inputs; ++in)
+        {
+            SampleConversion::deinterleave(input, m_planarInput[in].data(), numFrames, m_inputs, in);
+        }
+
+        float *acc = m_accumulator.data();
+        for (unsigned int out = 0; out < m_outputs; ++out)
+        {
+            std::fill(acc, acc + numFrames, 0.0f);
+            for (unsigned int in = 0; in < m_inputs; ++in)
+            {
+                const size_t n = out * m_inputs + in;
+                const float gain = m_current[n];
+                const float step = ramping ? m_step[n] : 0.0f;
+                if (gain == 0.0f && step == 0.0f)
+                    continue;
+
+                const float *x = m_planarInput[in].data();
+                for (size_t i = 0; i < numFrames; ++i)
+                {
+                    acc[i] += (gain + step * static_cast<float>(i)) * x[i];
+                }
+            }
+            SampleConversion::interleave(acc, output, numFrames, m_outputs, out);
+        }
+
+        if (ramping)
+        {
+            for (size_t n = 0; n < m_current.size(); ++n)
+            {
+                m_current[n] += m_step[n] * static_cast<float>(numFrames);
+            }
+        }
+    }
+
+    void mixStatic(const int32_t *input, int32_t *output, size_t numFrames)
+    {
+        const Kernel kernel = m_kernel.load(std::memory_order_relaxed);
+        switch (kernel)
+        {
+        case IDENTITY:
+            std::memcpy(output, input, numFrames * m_inputs * sizeof(int32_t));
+            break;
+
+        case PERMUTATION:
+        case DIAGONAL:
+        {
+            // One strided column per output, so the frame loops are branch-free.
+            // Strides live in locals: int32_t stores may alias unsigned members
+            const size_t inStride = m_inputs;
+            const size_t outStride = m_outputs;
+            for (size_t out = 0; out < outStride; ++out)
+            {
+                int32_t *column = output + out;
+                if (m_source[out] < 0)
+                {
+                    for (size_t i = 0; i < numFrames; ++i)
+                    {
+                        column[i * outStride] = 0;
+                    }
+                    continue;
+                }
+
+                const int32_t *source = input + m_source[out];
+                if (kernel == PERMUTATION)
+                {
+                    for (size_t i = 0; i < numFrames; ++i)
+                    {
+                        column[i * outStride] = source[i * inStride];
+                    }
+                }
+                else
+                {
+                    const float gain = m_sourceGain[out];
+                    for (size_t i = 0; i < numFrames; ++i)
+                    {
+                        const float scaled = static_cast<float>(source[i * inStride]) * gain;
+                        column[i * outStride] = static_cast<int32_t>(std::clamp(scaled, -SampleConversion::FLOAT_TO_INT32, SampleConversion::INT32_MAX_AS_FLOAT));
+                    }
+                }
+            }
+        }
+        break;
+
+        case DENSE:
+            mixDense(input, output, numFrames, false);
+            break;
+        }
+    }
+
+public:
+    // Starts as the identity on the shared channels; rampFrames of 0 makes
+    // changes instant
+    ChannelMatrix(unsigned int inputs, unsigned int outputs, size_t rampFrames = 480)
+        : m_inputs(inputs), m_outputs(outputs),
+          m_current(inputs * outputs, 0.0f), m_step(inputs * outputs, 0.0f),
+          m_rampFrames(rampFrames), m_source(outputs, -1), m_sourceGain(outputs, 0.0f),
+          m_planarInput(inputs)
+    {
+        for (unsigned int ch = 0; ch < std::min(inputs, outputs); ++ch)
+        {
+            m_current[ch * inputs + ch] = 1.0f;
+        }
+        m_target = m_current;
+        m_pending = m_current;
+        classify();
+    }
+
+    unsigned int getInputChannels() const { return m_inputs; }
+    unsigned int getOutputChannels() const { return m_outputs; }
+    Kernel getKernel() const { return m_kernel.load(std::memory_order_relaxed); }
+
+    static const char *getKernelName(Kernel kernel)
+    {
+        static const char *const names[] = {"identity", "permutation", "diagonal", "dense"};
+        return names[kernel];
+    }
+
+    void setRampLength(size_t frames) { m_rampFrames = frames; }
+
+    // Size the planar scratch for blocks of up to maxFrames, so neither a
+    // ramp nor the dense kernel allocates on the audio thread
+    void prepare(size_t maxFrames) { reserveScratch(maxFrames); }
+
+    void setGain(unsigned int out, unsigned int in, float gain)
+    {
+        if (out >= m_outputs || in >= m_inputs)
+            return;
+
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending[out * m_inputs + in] = gain;
+        m_changed.store(true, std::memory_order_release);
+    }
+
+    float getGain(unsigned int out, unsigned int in)
+    {
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        return (out < m_outputs && in < m_inputs) ? m_pending[out * m_inputs + in] : 0.0f;
+    }
+
+    // Replace the whole matrix, output-major (outputs rows of inputs gains)
+    bool setMatrix(const std::vector<float> &gains)
+    {
+        if (gains.size() != m_pending.size())
+            return false;
+
+        std::lock_guard<std::mutex> lock(m_pendingMutex);
+        m_pending = gains;
+        m_changed.store(true, std::memory_order_release);
+        return true;
+    }
+
+    // Output j = input j on the shared channels, silence elsewhere
+    void setIdentity()
+    {
+        std::vector<float> gains(m_inputs * m_outputs, 0.0f);
+        for (unsigned int ch = 0; ch < std::min(m_inputs, m_outputs); ++ch)
+        {
+            gains[ch * m_inputs + ch] = 1.0f;
+        }
+        setMatrix(gains);
+    }
+
+    // ITU-R BS.775 5.1 (L, R, C, LFE, Ls, Rs) to stereo; the LFE is dropped
+    bool setDownmix51()
+    {
+        if (m_inputs != 6 || m_outputs != 2)
+            return false;
+
+        constexpr float g = 0.70710678f;
+        return setMatrix({1.0f, 0.0f, g, 0.0f, g, 0.0f,
+                          0.0f, 1.0f, g, 0.0f, 0.0f, g});
+    }
+
+    // Clears any ramp and jumps to the posted matrix
+    void reset()
+    {
+        {
+            std::lock_guard<std::mutex> lock(m_pendingMutex);
+            m_current = m_pending;
+            m_target = m_pending;
+            m_changed.store(false, std::memory_order_relaxed);
+        }
+        m_rampRemaining = 0;
+        classify();
+    }
+
+    // input holds numFrames frames of getInputChannels(), output receives
+    // numFrames frames of getOutputChannels()
+    void process(const int32_t *input, int32_t *output, size_t numFrames)
+    {
+        acceptPending();
+
+        if (m_rampRemaining > 0)
+        {
+            reserveScratch(numFrames);
+            const size_t rampFrames = std::min(numFrames, m_rampRemaining);
+            mixDense(input, output, rampFrames, true);
+            m_rampRemaining -= rampFrames;
+            if (m_rampRemaining > 0)
+                return;
+
+            m_current = m_target;
+            classify();
+            input += rampFrames * m_inputs;
+            output += rampFrames * m_outputs;
+            numFrames -= rampFrames;
+        }
+
+        if (m_kernel.load(std::memory_order_relaxed) == DENSE)
+        {
+            reserveScratch(numFrames);
+        }
+        mixStatic(input, output, numFrames);
+    }
+};
+
+// Effect chain manager
+class AudioEffectChain
+{
+private:
+    std::vector<std::unique_ptr<AudioEffect>> m_effects;
+
+    // Block size passed to prepare(), forwarded to effects added later
+    size_t m_preparedFrames = 0;
+    unsigned int m_preparedChannels = 0;
+
+    // Buffer plan: the steps one block takes through the chain, rebuilt only
+    // when an effect's bypass state, the channel count or input/output
+    // aliasing change. Bypassed effects get no step, so they cost no copy.
+    enum StepKind : uint8_t
+    {
+        RUN_EFFECT,
+        ENCODE_MID_SIDE,
+        DECODE_MID_SIDE,
+        COPY
+    };
+    enum Slot : uint8_t
+    {
+        SLOT_INPUT,
+        SLOT_OUTPUT
+    };
+    struct Step
+    {
+        StepKind kind;
+        Slot from;
+        Slot to;
+        AudioEffect *effect;
+    };
+    std::vector<Step> m_plan;            // Capacity reserved when effects change
+    std::vector<uint8_t> m_planBypassed; // Bypass states the plan was built for
+    unsigned int m_planChannels = 0;
+    bool m_planAliased = false;
+    bool m_planValid = false;
+
+    // Effects [m_midSideBegin, m_midSideEnd) run on mid/side stereo
+    size_t m_midSideBegin = 0;
+    size_t m_midSideEnd = 0;
+    bool m_midSideActive = false;
+
+    // The span only converts when the block is stereo and one of its effects
+    // is not bypassed; its effects are told which layout they will receive.
+    bool updateMidSideSpan(unsigned int channels)
+    {
+        bool active = false;
+        if (channels == 2)
+        {
+            for (size_t i = m_midSideBegin; i < m_midSideEnd; ++i)
+            {
+                active = active || !m_planBypassed[i];
+            }
+        }
+
+        if (active != m_midSideActive)
+        {
+            const auto domain = active ? AudioEffect::ChannelDomain::MID_SIDE
+                                       : AudioEffect::ChannelDomain::LEFT_RIGHT;
+            for (size_t i = m_midSideBegin; i < m_midSideEnd; ++i)
+            {
+                m_effects[i]->setChannelDomain(domain);
+            }
+            m_midSideActive = active;
+        }
+        return active;
+    }
+
+    bool planMatches(unsigned int channels, bool aliased) const
+    {
+        if (!m_planValid || channels != m_planChannels || aliased != m_planAliased)
+            return false;
+        for (size_t i = 0; i < m_effects.size(); ++i)
+        {
+            if (m_effects[i]->isBypassed(channels) != static_cast<bool>(m_planBypassed[i]))
+                return false;
+        }
+        return true;
+    }
+
+    // Walks the effects once, tracking which buffer holds the signal. The
+    // first step reads the input buffer and every step writes the output
+    // buffer, so later effects run in place. Runs on the audio thread;
+    // m_plan and m_planBypassed have their capacity already, so it does not
+    // allocate.
+    void buildPlan(unsigned int channels, bool aliased)
+    {
+        for (size_t i = 0; i < m_effects.size(); ++i)
+        {
+            m_planBypassed[i] = m_effects[i]->isBypassed(channels);
+        }
+        const bool midSide = updateMidSideSpan(channels);
+
+        m_plan.clear();
+        Slot at = aliased ? SLOT_OUTPUT : SLOT_INPUT;
+        for (size_t i = 0; i < m_effects.size(); ++i)
+        {
+            if (midSide && i == m_midSideBegin)
+            {
+                m_plan.push_back({ENCODE_MID_SIDE, at, SLOT_OUTPUT, nullptr});
+                at = SLOT_OUTPUT;
+            }
+
+            if (!m_planBypassed[i])
+            {
+                m_plan.push_back({RUN_EFFECT, at, SLOT_OUTPUT, m_effects[i].get()});
+                at = SLOT_OUTPUT;
+            }
+
+            if (midSide && i + 1 == m_midSideEnd)
+            {
+                m_plan.push_back({DECODE_MID_SIDE, at, at, nullptr});
+            }
+        }
+        if (at != SLOT_OUTPUT)
+        {
+            m_plan.push_back({COPY, at, SLOT_OUTPUT, nullptr});
+        }
+
+        m_planChannels = channels;
+        m_planAliased = aliased;
+        m_planValid = true;
+    }
+
+    void runPlan(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels)
+    {
+        int32_t *const targets[] = {nullptr, outputBuffer};
+        const int32_t *const sources[] = {inputBuffer, outputBuffer};
+        for (const Step &step : m_plan)
+        {
+            switch (step.kind)
+            {
+            case RUN_EFFECT:
+                step.effect->process(sources[step.from], targets[step.to], numSamples, channels);
+                break;
+            case ENCODE_MID_SIDE:
+                MidSide::encode(sources[step.from], targets[step.to], numSamples);
+                break;
+            case DECODE_MID_SIDE:
+                MidSide::decode(targets[step.to], numSamples);
+                break;
+            case COPY:
+                std::memcpy(targets[step.to], sources[step.from], numSamples * channels * sizeof(int32_t));
+                break;
+            }
+        }
+    }
+
+    // Called whenever the effect list changes (never from process())
+    void effectsChanged()
+    {
+        m_plan.reserve(m_effects.size() * 2 + 3);
+        m_planBypassed.resize(m_effects.size());
+        m_planValid = false;
+    }
+
+public:
+    void addEffect(std::unique_ptr<AudioEffect> effect)
+    {
+        if (m_preparedFrames > 0)
+        {
+            effect->prepare(m_preparedFrames, m_preparedChannels);
+        }
+        m_effects.push_back(std::move(effect));
+        effectsChanged();
+    }
+
+    void removeEffect(size_t index)
+    {
+        if (index < m_effects.size())
+        {
+            clearMidSideSpan();
+            m_effects.erase(m_effects.begin() + index);
+            effectsChanged();
+        }
+    }
+
+    void clearEffects()
+    {
+        clearMidSideSpan();
+        m_effects.clear();
+        effectsChanged();
+    }
+
+    // Largest block and the channel count process() will see; sizes every
+    // effect's scratch up front so the audio thread never allocates
+    void prepare(size_t maxFrames, unsigned int channels)
+    {
+        m_preparedFrames = maxFrames;
+        m_preparedChannels = channels;
+        for (auto &effect : m_effects)
+        {
+            effect->prepare(maxFrames, channels);
+        }
+        effectsChanged();
+    }
+
+    // Builds every effect's deferred state; safe to run on another thread
+    // while process() is running
+    void prepareEffectStates()
+    {
+        for (const auto &effect : m_effects)
+        {
+            effect->prepareState();
+        }
+    }
+
+    // One record per effect, tagged with its type, in chain order
+    void saveStates(EffectStateWriter &out) const
+    {
+        out.write<uint64_t>(m_effects.size());
+        for (const auto &effect : m_effects)
+        {
+            AudioEffect::saveTagged(out, *effect);
+        }
+    }
+
+    // Effects whose record is missing, of another type or unreadable are
+    // reset instead. Returns how many were restored; none when the snapshot
+    // holds a different number of effects.
+    size_t restoreStates(EffectStateReader &in)
+    {
+        uint64_t count = 0;
+        if (!in.read(count) || count != m_effects.size())
+            return 0;
+
+        size_t restored = 0;
+        for (const auto &effect : m_effects)
+        {
+            if (AudioEffect::restoreTagged(in, *effect))
+            {
+                ++restored;
+            }
+            else
+            {
+                effect->reset();
+            }
+        }
+        effectsChanged();
+        return restored;
+    }
+
+    // Run effects [first, first + count) on mid/side instead of left/right.
+    // Encoding and decoding happen once at the edges of the span, so every
+    // effect inside it must handle ChannelDomain::MID_SIDE.
+    bool setMidSideSpan(size_t first, size_t count)
+    {
+        if (count == 0 || first + count > m_effects.size())
+            return false;
+
+        clearMidSideSpan();
+        m_midSideBegin = first;
+        m_midSideEnd = first + count;
+        m_planValid = false;
+        return true;
+    }
+
+    void clearMidSideSpan()
+    {
+        for (size_t i = m_midSideBegin; i < m_midSideEnd; ++i)
+        {
+            m_effects[i]->setChannelDomain(AudioEffect::ChannelDomain::LEFT_RIGHT);
+        }
+        m_midSideBegin = m_midSideEnd = 0;
+        m_midSideActive = false;
+        m_planValid = false;
+    }
+
+    AudioEffect *getEffect(size_t index)
+    {
+        return (index < m_effects.size()) ? m_effects[index].get() : nullptr;
+    }
+
+    const AudioEffect *getEffect(size_t index) const
+    {
+        return (index < m_effects.size()) ? m_effects[index].get() : nullptr;
+    }
+
+    size_t getEffectCount() const
+    {
+        return m_effects.size();
+    }
+
+    // First effect of the given type, or nullptr
+    template <typename T>
+    T *findEffect()
+    {
+        for (auto &effect : m_effects)
+        {
+            if (auto *typed = dynamic_cast<T *>(effect.get()))
+                return typed;
+        }
+        return nullptr;
+    }
+
+    template <typename T>
+    const T *findEffect() const
+    {
+        for (const auto &effect : m_effects)
+        {
+            if (const auto *typed = dynamic_cast<const T *>(effect.get()))
+                return typed;
+        }
+        return nullptr;
+    }
+
+    void setSampleRate(unsigned int sampleRate)
+    {
+        for (auto &effect : m_effects)
+        {
+            effect->setSampleRate(sampleRate);
+        }
+    }
+
+    void reset()
+    {
+        for (auto &effect : m_effects)
+        {
+            effect->reset();
+        }
+    }
+
+    // Total latency of the enabled effects, in frames
+    size_t getLatency() const
+    {
+        size_t latency = 0;
+        for (const auto &effect : m_effects)
+        {
+            if (effect->isEnabled())
+                latency += effect->getLatency();
+        }
+        return latency;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels)
+    {
+        const bool aliased = inputBuffer == outputBuffer;
+        if (!planMatches(channels, aliased))
+        {
+            buildPlan(channels, aliased);
+        }
+        runPlan(inputBuffer, outputBuffer, numSamples, channels);
+    }
+};
+
+// Multiband compositor: splits its input with a MultibandSplitter, runs each
+// band through its own effect chain and sums the bands back together. Bands
+// other than the first are handed to one worker thread each, while the
+// audio thread processes band 0; it then waits for the workers (which only
+// run a bounded block of work) and recombines. The handoff takes no locks:
+// the block is published through an atomic generation and each worker is
+// woken by its own semaphore; the last worker to finish posts the audio
+// thread's. Bands whose chains have only bypassed effects are not
+// dispatched. The chains should add equal latency,
+// otherwise the bands no longer sum flat.
+class MultibandEffect : public AudioEffect
+{
+private:
+    MultibandSplitter m_splitter;
+    std::vector<AudioEffectChain> m_bandChains;
+
+    // Worker pool, one thread per band above the first (none on a single
+    // core). A band only goes to its worker while its chain costs more per
+    // block than waking the worker does; cheap bands run inline.
+    std::vector<std::thread> m_workers;
+    std::unique_ptr<sem_t[]> m_workReady; // Per band; posted only for dispatched bands
+    sem_t m_workDone;                     // Posted by the last worker of a block
+    std::atomic<uint64_t> m_generation{0};
+    std::atomic<bool> m_running{true};
+    size_t m_blockSamples = 0;        // Published by m_generation
+    unsigned int m_blockChannels = 0; // Published by m_generation
+    std::vector<uint8_t> m_requested; // Audio thread only
+    std::vector<int64_t> m_bandCostNs; // Smoothed per-block cost; written by whoever ran the band
+    int64_t m_dispatchNs = DEFAULT_DISPATCH_NS;
+    std::atomic<size_t> m_pending{0};
+
+
+    static void waitFor(sem_t &semaphore)
+    {
+        while (sem_wait(&semaphore) != 0 && errno == EINTR)
+        {
+        }
+    }
+
+    void workerLoop(size_t band)
+    {
+        while (true)
+        {
+            waitFor(m_workReady[band]);
+            if (!m_running.load(std::memory_order_acquire))
+                return;
+
+            // Pairs with the audio thread's release, making the block parameters visible
+            m_generation.load(std::memory_order_acquire);
+            processBand(band, m_blockSamples, m_blockChannels);
+            if (m_pending.fetch_sub(1, std::memory_order_acq_rel) == 1)
+            {
+                sem_post(&m_workDone);
+            }
+        }
+    }
+
+    // Runs one band chain in place and folds its time into m_bandCostNs
+    void processBand(size_t band, size_t numSamples, unsigned int channels)
+    {
+        const auto start = std::chrono::steady_clock::now();
+        int32_t *buffer = m_splitter.getBand(band);
+        m_bandChains[band].process(buffer, buffer, numSamples, channels);
+        const auto elapsed = std::chrono::steady_clock::now() - start;
+        const int64_t ns = std::chrono::duration_cast<std::chrono::nanoseconds>(elapsed).count();
+        m_bandCostNs[band] += (ns - m_bandCostNs[band]) / 8;
+    }
+
+    static bool hasActiveEffect(const AudioEffectChain &chain, unsigned int channels)
+    {
+        for (size_t i = 0; i < chain.getEffectCount(); ++i)
+        {
+            if (!chain.getEffect(i)->isBypassed(channels))
+                return true;
+        }
+        return false;
+    }
+
+    // Dispatched bands stay on their worker until they cost half the
+    // threshold, so a band near it does not flip every block
+    bool shouldDispatch(size_t band, unsigned int channels) const
+    {
+        if (m_workers.empty() || !hasActiveEffect(m_bandChains[band], channels))
+            return false;
+        const int64_t threshold = m_requested[band] ? m_dispatchNs / 2 : m_dispatchNs;
+        return m_bandCostNs[band] > threshold;
+    }
+
+public:
+    // About what a semaphore handoff to a sleeping worker and back costs;
+    // below it a band is cheaper to run on the audio thread
+    static constexpr int64_t DEFAULT_DISPATCH_NS = 20000;
+
+    MultibandEffect(unsigned int sampleRate, const std::vector<float> &crossoverHz)
+        : m_splitter(sampleRate, crossoverHz),
+          m_bandChains(crossoverHz.size() + 1),
+          m_workReady(new sem_t[crossoverHz.size() + 1]),
+          m_requested(crossoverHz.size() + 1, 0),
+          m_bandCostNs(crossoverHz.size() + 1, 0)
+    {
+        m_sampleRate = sampleRate;
+        sem_init(&m_workDone, 0, 0);
+        for (size_t band = 0; band < m_bandChains.size(); ++band)
+        {
+            sem_init(&m_workReady[band], 0, 0);
+        }
+        if (std::thread::hardware_concurrency() > 1)
+        {
+            for (size_t band = 1; band < m_bandChains.size(); ++band)
+            {
+                m_workers.emplace_back(&MultibandEffect::workerLoop, this, band);
+            }
+        }
+    }
+
+    ~MultibandEffect() override
+    {
+        m_running.store(false, std::memory_order_release);
+        for (size_t band = 1; band <= m_workers.size(); ++band)
+        {
+            sem_post(&m_workReady[band]);
+        }
+        for (auto &worker : m_workers)
+        {
+            worker.join();
+        }
+        for (size_t band = 0; band < m_bandChains.size(); ++band)
+        {
+            sem_destroy(&m_workReady[band]);
+        }
+        sem_destroy(&m_workDone);
+    }
+
+    size_t getBandCount() const { return m_bandChains.size(); }
+
+    // Effects for one band; configure them before processing starts
+    AudioEffectChain &getBandChain(size_t band) { return m_bandChains[band]; }
+
+    MultibandSplitter &getSplitter() { return m_splitter; }
+
+    // Per-block band cost above which a band runs on its worker; 0 sends
+    // every active band there. Set it before processing starts.
+    void setDispatchThreshold(std::chrono::nanoseconds threshold) { m_dispatchNs = threshold.count(); }
+    bool hasWorkers() const { return !m_workers.empty(); }
+    // Bands the last block ran on workers
+    size_t getDispatchedBands() const
+    {
+        return static_cast<size_t>(std::count(m_requested.begin(), m_requested.end(), 1));
+    }
+
+    void prepare(size_t maxFrames, unsigned int channels) override
+    {
+        m_splitter.prepare(maxFrames, channels);
+        for (auto &chain : m_bandChains)
+        {
+            chain.prepare(maxFrames, channels);
+        }
+    }
+
+    void prepareState() override
+    {
+        AudioEffect::prepareState();
+        for (auto &chain : m_bandChains)
+        {
+            chain.prepareEffectStates();
+        }
+    }
+
+    void setSampleRate(unsigned int sampleRate) override
+    {
+        AudioEffect::setSampleRate(sampleRate);
+        m_splitter.setSampleRate(sampleRate);
+        for (auto &chain : m_bandChains)
+        {
+            chain.setSampleRate(sampleRate);
+        }
+    }
+
+    size_t getLatency() const override
+    {
+        size_t latency = 0;
+        for (const auto &chain : m_bandChains)
+        {
+            latency = std::max(latency, chain.getLatency());
+        }
+        return latency;
+    }
+
+    void reset() override
+    {
+        m_splitter.reset();
+        for (auto &chain : m_bandChains)
+        {
+            chain.reset();
+        }
+    }
+
+    // Each band chain as AudioEffectChain stores it, then the splitter.
+    // A band's effects restore or reset one by one, as in the main chain;
+    // the splitter and the enabled flag only change once everything has read.
+    void saveState(EffectStateWriter &out) const override
+    {
+        AudioEffect::saveState(out);
+        out.write<uint64_t>(m_bandChains.size());
+        for (const auto &chain : m_bandChains)
+        {
+            chain.saveStates(out);
+        }
+        m_splitter.saveState(out);
+    }
+
+    bool restoreState(EffectStateReader &in) override
+    {
+        bool enabled = false;
+        uint64_t bands = 0;
+        if (!in.read(enabled) || !in.read(bands) || bands != m_bandChains.size())
+            return false;
+        for (auto &chain : m_bandChains)
+        {
+            chain.restoreStates(in);
+        }
+        if (!in.ok() || !m_splitter.restoreState(in))
+            return false;
+        m_enabled = enabled;
+        return true;
+    }
+
+    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
+                 size_t numSamples, unsigned int channels) override
+    {
+        if (!m_enabled)
+        {
+            // Pass through
+            if (inputBuffer != outputBuffer)
+            {
+                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
+            }
+            return;
+        }
+
+        m_splitter.split(inputBuffer, numSamples, channels);
+
+        size_t dispatched = 0;
+        for (size_t band = 1; band < m_bandChains.size(); ++band)
+        {
+            m_requested[band] = shouldDispatch(band, channels);
+            dispatched += m_requested[band];
+        }
+
+        if (dispatched > 0)
+        {
+            m_pending.store(dispatched, std::memory_order_relaxed);
+            m_blockSamples = numSamples;
+            m_blockChannels = channels;
+            m_generation.fetch_add(1, std::memory_order_release);
+            for (size_t band = 1; band < m_bandChains.size(); ++band)
+            {
+                if (m_requested[band])
+                    sem_post(&m_workReady[band]);
+            }
+        }
+
+        for (size_t band = 0; band < m_bandChains.size(); ++band)
+        {
+            if (!m_requested[band])
+                processBand(band, numSamples, channels);
+        }
+
+        // The workers run at most one block each, so this wait is bounded by
+        // the slowest band chain; it sleeps instead of spinning
+        if (dispatched > 0)
+        {
+            waitFor(m_workDone);
+        }
+
+        // Recombine
+        constexpr int64_t MIN = std::numeric_limits<int32_t>::min();
+        constexpr int64_t MAX = std::numeric_limits<int32_t>::max();
+        const size_t totalSamples = numSamples * channels;
+        const size_t numBands = m_bandChains.size();
+        for (size_t i = 0; i < totalSamples; ++i)
+        {
+            int64_t sum = 0;
+            for (size_t band = 0; band < numBands; ++band)
+            {
+                sum += m_splitter.getBand(band)[i];
+            }
+            outputBuffer[i] = static_cast<int32_t>(std::clamp(sum, MIN, MAX));
+        }
+    }
+};
+
+// Cost of a 4-band split per stereo period, bare and with a reverb on every
+// band, against the same four reverbs run back to back. The reverbs run with
+// the default dispatch threshold and with every band forced onto a worker,
+// at a short period (inline pays) and a long one (workers pay).
+void runMultibandBenchmark()
+{
+    constexpr unsigned int SAMPLE_RATE = 48000;
+    constexpr unsigned int CHANNELS = 2;
+    constexpr size_t SAMPLES_PER_RUN = 480000;
+    const std::vector<float> crossovers = {200.0f, 1000.0f, 5000.0f};
+    const size_t maxFrames = 1024;
+
+    std::cout << "\nMultibandEffect (4 bands, stereo, 48 kHz, "
+              << std::thread::hardware_concurrency() << " cores)" << std::endl;
+    std::cout << "  " << std::left << std::setw(36) << "variant" << std::right
+              << std::setw(14) << "us/period" << std::setw(14) << "% realtime"
+              << std::setw(12) << "on workers" << std::endl;
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int32_t> noise(-(1 << 24), 1 << 24);
+    std::vector<int32_t> input(maxFrames * CHANNELS);
+    for (auto &sample : input)
+    {
+        sample = noise(rng);
+    }
+    std::vector<int32_t> output(input.size());
+
+    auto report = [&](const std::string &name, size_t frames, const Benchmark::Result &result, size_t dispatched)
+    {
+        const double usPerPeriod = result.nsPerSample * frames / 1000.0;
+        const double periodUs = 1.0e6 * frames / SAMPLE_RATE;
+        std::cout << "  " << std::left << std::setw(36) << name << std::right
+                  << std::fixed << std::setprecision(2) << std::setw(14) << usPerPeriod
+                  << std::setw(14) << 100.0 * usPerPeriod / periodUs
+                  << std::setw(12) << dispatched << std::defaultfloat << std::endl;
+    };
+
+    auto runMultiband = [&](const std::string &name, size_t frames, bool reverbs, std::chrono::nanoseconds threshold)
+    {
+        MultibandEffect multiband(SAMPLE_RATE, crossovers);
+        for (size_t band = 0; reverbs && band < multiband.getBandCount(); ++band)
+        {
+            multiband.getBandChain(band).addEffect(std::make_unique<ReverbEffect>(SAMPLE_RATE, CHANNELS, ReverbEffect::LARGE_HALL));
+        }
+        multiband.setDispatchThreshold(threshold);
+        multiband.prepare(frames, CHANNELS);
+        const auto result = Benchmark::measure([&]()
+                                               { multiband.process(input.data(), output.data(), frames, CHANNELS); },
+                                               frames, static_cast<int>(SAMPLES_PER_RUN / frames));
+        report(name, frames, result, multiband.getDispatchedBands());
+    };
+
+    const std::chrono::nanoseconds byDefault(MultibandEffect::DEFAULT_DISPATCH_NS);
+    for (size_t frames : {size_t{120}, maxFrames})
+    {
+        const std::string period = std::to_string(frames) + " frames: ";
+        if (frames == 120)
+        {
+            runMultiband(period + "split + recombine", frames, false, byDefault);
+        }
+        runMultiband(period + "reverb per band", frames, true, byDefault);
+        runMultiband(period + "reverb per band, workers", frames, true, std::chrono::nanoseconds(0));
+
+        AudioEffectChain serial;
+        for (size_t band = 0; band <= crossovers.size(); ++band)
+        {
+            serial.addEffect(std::make_unique<ReverbEffect>(SAMPLE_RATE, CHANNELS, ReverbEffect::LARGE_HALL));
+        }
+        serial.prepare(frames, CHANNELS);
+        report(period + "4 reverbs, one thread", frames,
+               Benchmark::measure([&]()
+                                  { serial.process(input.data(), output.data(), frames, CHANNELS); },
+                                  frames, static_cast<int>(SAMPLES_PER_RUN / frames)),
+               0);
+    }
+}
+
+// Cost of each ChannelMatrix kernel per 120-frame period, against memcpy
+void runChannelMatrixBenchmark()
+{
+    constexpr size_t FRAMES = 120;
+    constexpr int PERIODS = 20000;
+
+    std::cout << "\nChannelMatrix (" << FRAMES << "-frame periods)" << std::endl;
+    std::cout << "  " << std::left << std::setw(28) << "routing" << std::right
+              << std::setw(14) << "ns/period" << std::setw(14) << "kernel" << std::endl;
+
+    std::mt19937 rng(1234);
+    std::uniform_int_distribution<int32_t> noise(-(1 << 24), 1 << 24);
+    std::vector<int32_t> input(FRAMES * 6);
+    for (auto &sample : input)
+    {
+        sample = noise(rng);
+    }
+    std::vector<int32_t> output(FRAMES * 6);
+
+    auto report = [&](const char *name, const Benchmark::Result &result, const char *kernel)
+    {
+        std::cout << "  " << std::left << std::setw(28) << name << std::right
+                  << std::fixed << std::setprecision(1) << std::setw(14) << result.nsPerSample * FRAMES
+                  << std::setw(14) << kernel << std::defaultfloat << std::endl;
+    };
+
+    report("memcpy 2 ch", Benchmark::measure([&]()
+                                             { std::memcpy(output.data(), input.data(), FRAMES * 2 * sizeof(int32_t)); },
+                                             FRAMES, PERIODS),
+           "-");
+
+    auto run = [&](const char *name, ChannelMatrix &matrix)
+    {
+        matrix.reset();
+        const auto result = Benchmark::measure([&]()
+                                               { matrix.process(input.data(), output.data(), FRAMES); },
+                                               FRAMES, PERIODS);
+        report(name, result, ChannelMatrix::getKernelName(matrix.getKernel()));
+    };
+
+    ChannelMatrix stereo(2, 2);
+    run("stereo passthrough", stereo);
+
+    ChannelMatrix swapped(2, 2);
+    swapped.setMatrix({0.0f, 1.0f, 1.0f, 0.0f});
+    run("stereo swap", swapped);
+
+    ChannelMatrix pick(4, 2);
+    pick.setMatrix({0.0f, 0.0f, 1.0f, 0.0f,
+                    0.0f, 0.0f, 0.0f, 1.0f});
+    run("4 ch, take 3-4", pick);
+
+    ChannelMatrix trim(2, 2);
+    trim.setMatrix({0.5f, 0.0f, 0.0f, 0.5f});
+    run("stereo -6 dB", trim);
+
+    ChannelMatrix downmix(6, 2);
+    downmix.setDownmix51();
+    run("5.1 to stereo", downmix);
+}
+
+class AudioProcessor
+{
+private:
+    ALSADevice captureDevice;
+    ALSADevice playbackDevice;
+    ALSADevice standbyDevice; // Optional warm backup for playbackDevice
+    std::unique_ptr<BatchCircularBuffer> firstBuffer;
+    std::unique_ptr<BatchCircularBuffer> secondBuffer;
+    std::vector<std::unique_ptr<DelayLine>> delayBuffers;
+
+    std::atomic<bool>
+        running;
+    std::thread captureThread;
+    std::thread processingThread;
+    std::thread playbackThread;
+
+    AudioEffectChain m_effectChain;
+    std::unique_ptr<ReverbEffect> m_reverbEffect;
+    std::unique_ptr<DelayEffect> m_delayEffect;
+    EchoCancellerEffect *m_echoCanceller = nullptr; // Owned by m_effectChain
+    LoudnessMeter m_loudnessMeter{SAMPLE_RATE};
+    ChannelMatrix m_inputRouting{CHANNELS, CHANNELS}; // Capture channels into the chain
+
+    // Device delays in frames, sampled by the capture and playback threads
+    std::atomic<snd_pcm_sframes_t> m_captureDelay{0};
+    std::atomic<snd_pcm_sframes_t> m_playbackDelay{0};
+
+    // Catch-up statistics from the processing thread: blocks that took more
+    // than one period, the extra periods they absorbed, and the largest one
+    std::atomic<uint64_t> m_catchUpBlocks{0};
+    std::atomic<uint64_t> m_catchUpPeriods{0};
+    std::atomic<size_t> m_largestCatchUp{0};
+
+    // Xrun recovery. The playback thread restarts both streams; the capture
+    // thread flags its errors and picks up the concealment it owes from the
+    // new stream epoch.
+    std::atomic<bool> m_streamsLinked{false}; // Read by printStatus without the lock
+    mutable std::mutex m_recoveryMutex; // Also held while reading the PCM handles from other threads
+    std::condition_variable m_recoveryDone;
+    std::atomic<uint64_t> m_streamEpoch{0};
+    std::atomic<bool> m_captureXrun{false};
+    std::atomic<bool> m_restarting{false};      // Set while the playback thread swaps streams
+    std::atomic<bool> m_captureInDevice{false}; // Capture thread is inside captureDevice.read()
+    size_t m_captureConcealFrames = 0; // Guarded by m_recoveryMutex
+    const std::vector<int32_t> m_silence = std::vector<int32_t>(PERIOD_SAMPLES, 0);
+    std::atomic<uint64_t> m_xrunCount{0};
+    std::atomic<uint64_t> m_recoveryNsTotal{0};
+    std::atomic<uint64_t> m_recoveryNsMax{0};
+    std::atomic<uint64_t> m_concealedFrames{0};
+
+    // Hot-plug supervision. The supervisor thread watches the cards behind
+    // the configured PCMs and raises these; the playback thread acts on them.
+    std::thread m_supervisorThread;
+    std::thread m_effectStateThread; // Zeroes deferred effect state at startup
+
+    // Warm-restart snapshot of the effect chain: written by stop(), mapped
+    // and restored by initialize(). An empty path turns it off.
+    std::string m_snapshotPath = "audio_processor.state";
+    std::atomic<bool> m_deviceLost{false};
+    std::atomic<bool> m_deviceReturned{false};
+    std::atomic<bool> m_detached{false}; // Running on the null backend
+    std::atomic<uint64_t> m_reattachCount{0};
+
+    // Warm standby. standbyDevice runs non-blocking alongside the primary,
+    // fed a copy of each period (or silence), and takes over playback when
+    // the primary errors, keeps xrunning or stalls.
+    std::atomic<bool> m_standbyActive{false};
+    std::atomic<bool> m_standbyMirror{true};
+    std::atomic<uint64_t> m_standbyXruns{0};
+    std::atomic<uint64_t> m_failoverCount{0};
+
+public:
+    // Audio parameters
+    static constexpr unsigned int SAMPLE_RATE = 48000;
+    static constexpr unsigned int CHANNELS = 2;
+    static constexpr snd_pcm_format_t FORMAT = SND_PCM_FORMAT_S32_LE;
+    static constexpr snd_pcm_uframes_t PERIOD_SIZE = 120;
+    static constexpr snd_pcm_uframes_t BUFFER_SIZE = PERIOD_SIZE * 2;
 
-    // Convert int32_t to float for processing
-    static constexpr float INT32_TO_FLOAT = 1.0f / 2147483648.0f;
-    static constexpr float FLOAT_TO_INT32 = 2147483648.0f;
+    // Buffer parameters (BatchCircularBuffer sizes are in samples)
+    static constexpr size_t FRAME_SIZE = CHANNELS * sizeof(int32_t);
+    static constexpr size_t PERIOD_SAMPLES = PERIOD_SIZE * CHANNELS;
+    static constexpr size_t AUDIO_BUFFER_SIZE = PERIOD_SAMPLES * 32; // 80ms buffer
+
+    // When the processing thread falls behind it takes up to this many queued
+    // periods as one block (20ms, within the effects' preallocated scratch)
+    static constexpr size_t MAX_CATCH_UP_PERIODS = 8;
+
+    // Silence queued on the playback device at start; after an xrun it is
+    // restarted with a single period instead
+    static constexpr size_t PLAYBACK_PREFILL_PERIODS = 2;
+
+    // Hot-plug polling: card presence while detached, control events otherwise.
+    // PCMs not named after a card (e.g. "default") are retried less often.
+    static constexpr int SUPERVISOR_POLL_MS = 20;
+    static constexpr int SUPERVISOR_RETRY_MS = 500;
+
+    // Failover criteria for the primary playback device: this many xruns
+    // within the window, or no room freed for this many periods. A healthy
+    // device frees room at its next period boundary, which can be a whole
+    // period after the previous write, so the stall wait is that period
+    // plus one: the standby takes over one period after a missed boundary.
+    static constexpr unsigned STANDBY_XRUN_LIMIT = 3;
+    static constexpr auto STANDBY_XRUN_WINDOW = std::chrono::seconds(5);
+    static constexpr size_t STANDBY_STALL_PERIODS = 2;
+    static constexpr int STANDBY_STALL_MS = static_cast<int>(PERIOD_SIZE * STANDBY_STALL_PERIODS * 1000 / SAMPLE_RATE);
+
+    // Effect state snapshot header ("APST", little-endian)
+    static constexpr uint32_t SNAPSHOT_MAGIC = 0x54535041;
+    static constexpr uint32_t SNAPSHOT_VERSION = 1;
+
+    // Echo canceller alignment: the measured delay is shortened by this margin
+    // so timing jitter keeps the echo inside the causal part of the filter
+    static constexpr snd_pcm_sframes_t ECHO_DELAY_MARGIN = PERIOD_SIZE;
+    static constexpr float ECHO_DELAY_SMOOTHING = 0.01f;
 
-    inline float int32ToFloat(int32_t sample) const
+    size_t getAudioBufferSize() const
     {
-        return static_cast<float>(sample) * INT32_TO_FLOAT;
+        return AUDIO_BUFFER_SIZE;
     }
 
-    inline int32_t floatToInt32(float sample) const
+    size_t getSampleRate() const
     {
-        sample = std::clamp(sample, -1.0f, 1.0f);
-        return static_cast<int32_t>(sample * FLOAT_TO_INT32);
+        return SAMPLE_RATE;
     }
 
-public:
-    ReverbEffect(size_t sampleRate, size_t channels, RoomType roomType = MEDIUM_ROOM)
-        : m_sampleRate(sampleRate), m_channels(channels), m_roomType(roomType)
+    size_t getChannels() const
     {
+        return CHANNELS;
+    }
 
-        initializeParameters();
-        createFilters();
+    AudioProcessor() : running(false)
+    {
+        firstBuffer = std::make_unique<BatchCircularBuffer>(getAudioBufferSize());
+        secondBuffer = std::make_unique<BatchCircularBuffer>(getAudioBufferSize());
     }
 
-    void process(int32_t *samples, size_t numFrames, size_t channels) override
+    ~AudioProcessor()
     {
-        if (!m_enabled || channels != m_channels)
+        stop();
+        if (m_effectStateThread.joinable())
         {
-            return;
+            m_effectStateThread.join();
         }
+    }
 
-        for (size_t frame = 0; frame < numFrames; ++frame)
+    bool initialize(const std::string &captureDeviceName = "default",
+                    const std::string &playbackDeviceName = "default",
+                    const std::string &standbyDeviceName = "")
+    {
+
+        std::cout << "Initializing audio processor..." << std::endl;
+
+        // Devices open and configure concurrently (each can take hundreds of
+        // milliseconds on USB) while this thread builds the effect chain.
+        // Zeroing the effects' large buffers continues in the background
+        // past start(); those effects pass audio through until it is done.
+        using Clock = std::chrono::steady_clock;
+        struct StartupStep
+        {
+            const char *name;
+            Clock::time_point begin, end;
+        };
+        // Each device's messages are collected and printed after the join,
+        // so the concurrent opens do not interleave their output
+        struct DeviceLog
+        {
+            std::ostringstream out, err;
+        };
+        DeviceLog captureLog, playbackLog, standbyLog;
+        const Clock::time_point began = Clock::now();
+        StartupStep captureStep{"capture device", began, began};
+        StartupStep playbackStep{"playback device", began, began};
+        StartupStep standbyStep{"standby device", began, began};
+        StartupStep chainStep{"effect chain", began, began};
+        StartupStep restoreStep{"state restore", began, began};
+        StartupStep linkStep{"stream link", began, began};
+
+        auto openDevice = [](ALSADevice &device, const std::string &name, snd_pcm_stream_t stream,
+                             StartupStep &step, DeviceLog &log)
+        {
+            step.begin = Clock::now();
+            device.setLog(log.out, log.err);
+            const bool ok = device.open(name, stream) &&
+                            device.configure(SAMPLE_RATE, CHANNELS, FORMAT, BUFFER_SIZE, PERIOD_SIZE);
+            device.setLog(std::cout, std::cerr);
+            step.end = Clock::now();
+            return ok;
+        };
+        auto printLog = [](const DeviceLog &log)
         {
-            if (channels == 1)
+            std::cout << log.out.str() << std::flush;
+            std::cerr << log.err.str() << std::flush;
+        };
+        std::future<bool> capture = std::async(std::launch::async, [&]()
+                                               { return openDevice(captureDevice, captureDeviceName, SND_PCM_STREAM_CAPTURE, captureStep, captureLog); });
+        std::future<bool> playback = std::async(std::launch::async, [&]()
+                                                { return openDevice(playbackDevice, playbackDeviceName, SND_PCM_STREAM_PLAYBACK, playbackStep, playbackLog); });
+        // The standby is optional: without it, playback failures fall back
+        // to the null backend as before
+        std::future<bool> standby;
+        if (!standbyDeviceName.empty())
+        {
+            standby = std::async(std::launch::async, [&]()
+                                 { return openDevice(standbyDevice, standbyDeviceName, SND_PCM_STREAM_PLAYBACK, standbyStep, standbyLog) &&
+                                          standbyDevice.setNonBlocking(true); });
+        }
+
+        chainStep.begin = Clock::now();
+        buildEffectChain();
+        chainStep.end = Clock::now();
+        restoreStep.begin = Clock::now();
+        restoreEffectState();
+        restoreStep.end = Clock::now();
+        m_effectStateThread = std::thread([this, began]()
+                                          {
+            m_effectChain.prepareEffectStates();
+            const auto ready = std::chrono::duration_cast<std::chrono::microseconds>(Clock::now() - began);
+            // One write, so it cannot split another thread's line
+            std::cout << ("Startup: effect state ready at " + std::to_string(ready.count()) + " us\n") << std::flush; });
+
+        const bool captureOpened = capture.get();
+        const bool playbackOpened = playback.get();
+        printLog(captureLog);
+        printLog(playbackLog);
+        if (standby.valid())
+        {
+            m_standbyActive.store(standby.get());
+            printLog(standbyLog);
+            if (!m_standbyActive.load())
             {
-                // Mono processing
-                float input = int32ToFloat(samples[frame]);
-                float output = processMono(input);
-                float mixed = input * (1.0f - m_mix) + output * m_mix;
-                samples[frame] = floatToInt32(mixed);
+                standbyDevice.close();
+                std::cerr << "Warning: standby playback device " << standbyDeviceName
+                          << " unavailable, continuing without failover" << std::endl;
             }
-            else if (channels == 2)
-            {
-                // Stereo processing
-                float inputL = int32ToFloat(samples[frame * 2]);
-                float inputR = int32ToFloat(samples[frame * 2 + 1]);
-
-                auto [outputL, outputR] = processStereo(inputL, inputR);
+        }
+        if (!captureOpened || !playbackOpened)
+        {
+            return false;
+        }
 
-                float mixedL = inputL * (1.0f - m_mix) + outputL * m_mix;
-                float mixedR = inputR * (1.0f - m_mix) + outputR * m_mix;
+        // Linked streams start, stop and recover as one (not possible across
+        // every pair of devices; unlinked ones are restarted back to back)
+        linkStep.begin = Clock::now();
+        m_streamsLinked = captureDevice.link(playbackDevice);
+        linkStep.end = Clock::now();
 
-                samples[frame * 2] = floatToInt32(mixedL);
-                samples[frame * 2 + 1] = floatToInt32(mixedR);
-            }
+        std::cout << "Startup timing (ms from initialize):" << std::fixed << std::setprecision(1) << std::endl;
+        for (const StartupStep &step : {captureStep, playbackStep, standbyStep, chainStep, restoreStep, linkStep})
+        {
+            if (step.end == began)
+                continue; // Not run
+            const auto from = std::chrono::duration<double, std::milli>(step.begin - began);
+            const auto to = std::chrono::duration<double, std::milli>(step.end - began);
+            std::cout << "  " << std::left << std::setw(16) << step.name << std::right << std::setw(8) << from.count()
+                      << " -> " << std::setw(8) << to.count() << "  (" << (to - from).count() << ")" << std::endl;
         }
+        std::cout << "  total           " << std::setw(8)
+                  << std::chrono::duration<double, std::milli>(Clock::now() - began).count()
+                  << std::defaultfloat << std::endl;
+
+        std::cout << "Audio processor initialized successfully" << std::endl;
+        return true;
     }
 
-    void reset() override
+    // Offline render: runs a raw interleaved S32_LE file at SAMPLE_RATE and
+    // CHANNELS through the same chain as the live path, then reports loudness
+    bool renderFile(const std::string &inputPath, const std::string &outputPath)
     {
-        for (auto &comb : m_combFiltersL)
+        std::ifstream input(inputPath, std::ios::binary);
+        if (!input)
         {
-            if (comb)
-                comb->clear();
+            std::cerr << "Error opening render input " << inputPath << std::endl;
+            return false;
         }
-        for (auto &comb : m_combFiltersR)
+
+        std::ofstream output;
+        if (!outputPath.empty())
         {
-            if (comb)
-                comb->clear();
+            output.open(outputPath, std::ios::binary);
+            if (!output)
+            {
+                std::cerr << "Error opening render output " << outputPath << std::endl;
+                return false;
+            }
         }
-        for (auto &allpass : m_allPassFiltersL)
+
+        if (m_effectChain.getEffectCount() == 0)
         {
-            if (allpass)
-                allpass->clear();
+            buildEffectChain();
         }
-        for (auto &allpass : m_allPassFiltersR)
+        m_loudnessMeter.reset();
+
+        std::vector<int32_t> buffer(PERIOD_SAMPLES);
+        std::vector<int32_t> routed(PERIOD_SAMPLES);
+        size_t totalFrames = 0;
+        while (input)
         {
-            if (allpass)
-                allpass->clear();
+            input.read(reinterpret_cast<char *>(buffer.data()), buffer.size() * sizeof(int32_t));
+            const size_t frames = static_cast<size_t>(input.gcount()) / FRAME_SIZE;
+            if (frames == 0)
+            {
+                break;
+            }
+
+            m_inputRouting.process(buffer.data(), routed.data(), frames);
+            m_effectChain.process(routed.data(), buffer.data(), frames, CHANNELS);
+            m_loudnessMeter.process(buffer.data(), frames, CHANNELS);
+            if (output.is_open())
+            {
+                output.write(reinterpret_cast<const char *>(buffer.data()), frames * FRAME_SIZE);
+            }
+            totalFrames += frames;
         }
-        if (m_earlyReflectionsL)
-            m_earlyReflectionsL->clear();
-        if (m_earlyReflectionsR)
-            m_earlyReflectionsR->clear();
-    }
 
-    // Room type presets
-    void setRoomType(RoomType roomType)
-    {
-        m_roomType = roomType;
-        initializeParameters();
-        createFilters();
+        std::cout << "Rendered " << totalFrames << " frames ("
+                  << static_cast<double>(totalFrames) / SAMPLE_RATE << " s)" << std::endl;
+        printLoudness();
+        return true;
     }
 
-    RoomType getRoomType() const { return m_roomType; }
-
-    // Parameter controls
-    void setRoomSize(float size)
+    void printLoudness() const
     {
-        m_roomSize = std::clamp(size, 0.1f, 3.0f);
-        if (m_roomType == CUSTOM)
-        {
-            createFilters();
-        }
+        std::cout << std::fixed << std::setprecision(1)
+                  << "Loudness: integrated " << m_loudnessMeter.getIntegrated() << " LUFS"
+                  << ", range " << m_loudnessMeter.getLoudnessRange() << " LU" << std::endl
+                  << "  momentary " << m_loudnessMeter.getMomentary() << " LUFS (max " << m_loudnessMeter.getMaxMomentary() << ")"
+                  << ", short-term " << m_loudnessMeter.getShortTerm() << " LUFS (max " << m_loudnessMeter.getMaxShortTerm() << ")"
+                  << std::defaultfloat << std::endl;
     }
 
-    void setDecay(float decay)
+private:
+    void buildEffectChain()
     {
-        m_decay = std::clamp(decay, 0.1f, 0.99f);
-        updateCombFeedback();
-    }
+        // Echo cancellation sees the raw capture, ahead of every nonlinear stage
+        // (off until toggled; the reference is fed from processingLoop)
+        auto echoCanceller = std::make_unique<EchoCancellerEffect>(SAMPLE_RATE);
+        echoCanceller->setEnabled(false);
+        m_echoCanceller = echoCanceller.get();
+        m_effectChain.addEffect(std::move(echoCanceller));
+
+        // Level normalization ahead of everything level-dependent; only the echo
+        // canceller precedes it, since a varying gain would look like a
+        // changing echo path (off until toggled)
+        auto agc = std::make_unique<AgcEffect>(SAMPLE_RATE);
+        agc->setEnabled(false);
+        m_effectChain.addEffect(std::move(agc));
+
+        // Background noise removal first, so the reverb tail doesn't amplify it
+        // (off until toggled; adds two periods of latency)
+        auto noiseSuppression = std::make_unique<NoiseSuppressionEffect>();
+        noiseSuppression->setEnabled(false);
+        m_effectChain.addEffect(std::move(noiseSuppression));
+
+        // Tape-style saturation ahead of the reverb (off until toggled)
+        auto saturation = std::make_unique<SaturationEffect>(SaturationEffect::ASYMMETRIC, 6.0f);
+        saturation->setEnabled(false);
+        m_effectChain.addEffect(std::move(saturation));
+
+        // Feedback notches ahead of the reverb and delay, which would otherwise
+        // sustain a howl (off until toggled; detection runs on its own thread)
+        auto feedbackSuppressor = std::make_unique<FeedbackSuppressorEffect>(SAMPLE_RATE);
+        feedbackSuppressor->setEnabled(false);
+        m_effectChain.addEffect(std::move(feedbackSuppressor));
 
-    void setDamping(float damping)
-    {
-        m_damping = std::clamp(damping, 0.0f, 1.0f);
-        updateCombDamping();
-    }
+        // Agregar reverb
+        m_reverbEffect = std::make_unique<ReverbEffect>(SAMPLE_RATE, CHANNELS, ReverbEffect::MEDIUM_ROOM);
+        m_reverbEffect->setMix(0.3f); // 30% wet
+        m_reverbEffect->setTrueStereo(true);
+        m_effectChain.addEffect(std::move(m_reverbEffect));
 
-    void setDiffusion(float diffusion)
-    {
-        m_diffusion = std::clamp(diffusion, 0.0f, 1.0f);
-        updateAllPassGain();
-    }
+        // Initialize effect chain (add this at the end of the method)
+        // 250ms delay, 30% feedback, 40% wet signal; set through the
+        // constructor so the line is sized once and zeroed in the background
+        m_delayEffect = std::make_unique<DelayEffect>(250.0f, 0.3f, 0.4f, 0.6f);
+        m_effectChain.addEffect(std::move(m_delayEffect));
 
-    void setEarlyReflectionLevel(float level)
-    {
-        m_earlyReflectionLevel = std::clamp(level, 0.0f, 1.0f);
+        // Stereo image and headphone crossfeed share one mid/side span at the
+        // end of the chain (both off until set; the span costs nothing then)
+        auto width = std::make_unique<StereoWidthEffect>();
+        width->setEnabled(false);
+        m_effectChain.addEffect(std::move(width));
+
+        auto crossfeed = std::make_unique<CrossfeedEffect>(SAMPLE_RATE);
+        crossfeed->setEnabled(false);
+        m_effectChain.addEffect(std::move(crossfeed));
+        m_effectChain.setMidSideSpan(m_effectChain.getEffectCount() - 2, 2);
+        m_effectChain.prepare(PERIOD_SIZE * MAX_CATCH_UP_PERIODS, CHANNELS);
+        m_inputRouting.prepare(PERIOD_SIZE * MAX_CATCH_UP_PERIODS);
     }
 
-    // Getters
-    float getRoomSize() const { return m_roomSize; }
-    float getDecay() const { return m_decay; }
-    float getDamping() const { return m_damping; }
-    float getDiffusion() const { return m_diffusion; }
-    float getEarlyReflectionLevel() const { return m_earlyReflectionLevel; }
+public:
 
-private:
-    void initializeParameters()
+    bool start()
     {
-        switch (m_roomType)
+        if (running.load())
         {
-        case SMALL_ROOM:
-            m_roomSize = 0.3f;
-            m_decay = 0.5f;
-            m_damping = 0.3f;
-            m_diffusion = 0.6f;
-            m_earlyReflectionLevel = 0.4f;
-            break;
-
-        case MEDIUM_ROOM:
-            m_roomSize = 0.7f;
-            m_decay = 0.7f;
-            m_damping = 0.2f;
-            m_diffusion = 0.7f;
-            m_earlyReflectionLevel = 0.3f;
-            break;
-
-        case LARGE_HALL:
-            m_roomSize = 1.5f;
-            m_decay = 0.85f;
-            m_damping = 0.15f;
-            m_diffusion = 0.8f;
-            m_earlyReflectionLevel = 0.2f;
-            break;
+            std::cout << "Audio processor already running" << std::endl;
+            return false;
+        }
 
-        case CATHEDRAL:
-            m_roomSize = 2.5f;
-            m_decay = 0.92f;
-            m_damping = 0.1f;
-            m_diffusion = 0.9f;
-            m_earlyReflectionLevel = 0.15f;
-            break;
+        // Prepare devices
+        if (!captureDevice.prepare() || !playbackDevice.prepare())
+        {
+            return false;
+        }
 
-        case PLATE:
-            m_roomSize = 0.8f;
-            m_decay = 0.8f;
-            m_damping = 0.05f;
-            m_diffusion = 0.95f;
-            m_earlyReflectionLevel = 0.1f;
-            break;
+        // Pre-fill playback with silence to avoid underruns, then start both
+        // streams together
+        for (size_t i = 0; i < PLAYBACK_PREFILL_PERIODS; ++i)
+        {
+            playbackDevice.write(m_silence.data(), PERIOD_SIZE);
+        }
+        if (!startStreams())
+        {
+            return false;
+        }
+        if (m_standbyActive.load())
+        {
+            restartStandby();
+        }
 
-        case SPRING:
-            m_roomSize = 0.4f;
-            m_decay = 0.6f;
-            m_damping = 0.4f;
-            m_diffusion = 0.5f;
-            m_earlyReflectionLevel = 0.5f;
-            break;
+        running.store(true);
 
-        case CUSTOM:
-            // Keep current values
-            break;
-        }
+        // Start threads
+        processingThread = std::thread(&AudioProcessor::processingLoop, this);
+        captureThread = std::thread(&AudioProcessor::captureLoop, this);
+        playbackThread = std::thread(&AudioProcessor::playbackLoop, this);
+        m_supervisorThread = std::thread(&AudioProcessor::supervisorLoop, this);
 
-        setMix(0.3f); // Default 30% wet
+        std::cout << "Audio processing started" << std::endl;
+        return true;
     }
 
-    void createFilters()
+    void stop()
     {
-        // Comb filter delays based on room size (in samples)
-        float baseDelay = m_roomSize * m_sampleRate * 0.03f; // 30ms base for room size 1.0
+        if (!running.load())
+            return;
 
-        // Left channel comb delays (prime numbers scaled by room size)
-        std::array<float, NUM_COMBS> combDelaysL = {
-            baseDelay * 1.0f,
-            baseDelay * 1.13f,
-            baseDelay * 1.27f,
-            baseDelay * 1.41f};
+        std::cout << "Stopping audio processor..." << std::endl;
+        running.store(false);
+        m_recoveryDone.notify_all();
 
-        // Right channel comb delays (slightly different for stereo width)
-        std::array<float, NUM_COMBS> combDelaysR = {
-            baseDelay * 1.05f,
-            baseDelay * 1.18f,
-            baseDelay * 1.32f,
-            baseDelay * 1.46f};
+        // Wake up threads
+        firstBuffer->clear();
+        secondBuffer->clear();
 
-        // Create comb filters
-        for (int i = 0; i < NUM_COMBS; ++i)
+        // Wait for threads to finish
+        if (captureThread.joinable())
         {
-            m_combFiltersL[i] = std::make_unique<CombFilter>(
-                static_cast<size_t>(combDelaysL[i]), m_decay, m_damping);
-            m_combFiltersR[i] = std::make_unique<CombFilter>(
-                static_cast<size_t>(combDelaysR[i]), m_decay, m_damping);
+            captureThread.join();
         }
-
-        // All-pass filter delays
-        float allpassBase = m_roomSize * m_sampleRate * 0.005f; // 5ms base
-        std::array<float, NUM_ALLPASS> allpassDelaysL = {
-            allpassBase * 1.0f,
-            allpassBase * 2.1f,
-            allpassBase * 3.7f};
-
-        std::array<float, NUM_ALLPASS> allpassDelaysR = {
-            allpassBase * 1.1f,
-            allpassBase * 2.3f,
-            allpassBase * 3.9f};
-
-        // Create all-pass filters
-        for (int i = 0; i < NUM_ALLPASS; ++i)
+        std::cout << "Prueba de flujo..." << std::endl;
+        // Wait for threads to finish
+        if (processingThread.joinable())
         {
-            m_allPassFiltersL[i] = std::make_unique<AllPassFilter>(
-                static_cast<size_t>(allpassDelaysL[i]), m_diffusion * 0.7f);
-            m_allPassFiltersR[i] = std::make_unique<AllPassFilter>(
-                static_cast<size_t>(allpassDelaysR[i]), m_diffusion * 0.7f);
+            processingThread.join();
         }
 
-        // Create early reflections
-        m_earlyReflectionsL = std::make_unique<EarlyReflections>(m_sampleRate, m_roomSize);
-        m_earlyReflectionsR = std::make_unique<EarlyReflections>(m_sampleRate, m_roomSize * 1.05f);
-    }
-
-    void updateCombFeedback()
-    {
-        for (auto &comb : m_combFiltersL)
-        {
-            if (comb)
-                comb->setFeedback(m_decay);
-        }
-        for (auto &comb : m_combFiltersR)
+        if (playbackThread.joinable())
         {
-            if (comb)
-                comb->setFeedback(m_decay);
+            playbackThread.join();
         }
-    }
 
-    void updateCombDamping()
-    {
-        for (auto &comb : m_combFiltersL)
+        if (m_supervisorThread.joinable())
         {
-            if (comb)
-                comb->setDamping(m_damping);
+            m_supervisorThread.join();
         }
-        for (auto &comb : m_combFiltersR)
+
+        // Nothing is processing now: keep the tails for the next start
+        if (m_effectStateThread.joinable())
         {
-            if (comb)
-                comb->setDamping(m_damping);
+            m_effectStateThread.join();
         }
+        saveEffectState();
+
+        // Stop and drop devices
+        captureDevice.drop();
+        playbackDevice.drop();
+        standbyDevice.drop();
+
+        std::cout << "Audio processor stopped" << std::endl;
     }
 
-    void updateAllPassGain()
+    void printStatus() const
     {
-        float gain = m_diffusion * 0.7f;
-        for (auto &allpass : m_allPassFiltersL)
+        std::cout << "\n=== Audio Processor Status ===" << std::endl;
+        std::cout << "Running: " << (running.load() ? "Yes" : "No") << std::endl;
+        std::cout << "First buffer usage: " << firstBuffer->availableForRead()
+                  << " / " << getAudioBufferSize() << " samples" << std::endl;
+        std::cout << "Second buffer usage: " << secondBuffer->availableForRead()
+                  << " / " << getAudioBufferSize() << " samples" << std::endl;
+        std::cout << "Catch-up blocks: " << m_catchUpBlocks.load() << " (" << m_catchUpPeriods.load()
+                  << " extra periods, largest " << m_largestCatchUp.load() << ")" << std::endl;
+        const uint64_t xruns = m_xrunCount.load();
+        std::cout << "Xruns: " << xruns;
+        if (xruns > 0)
         {
-            if (allpass)
-                allpass->setGain(gain);
+            std::cout << " (recovery avg " << m_recoveryNsTotal.load() / xruns / 1000 << " us, max "
+                      << m_recoveryNsMax.load() / 1000 << " us; " << m_concealedFrames.load() << " frames concealed)";
         }
-        for (auto &allpass : m_allPassFiltersR)
+        std::cout << (m_streamsLinked.load() ? ", streams linked" : "") << std::endl;
+        if (m_detached.load())
         {
-            if (allpass)
-                allpass->setGain(gain);
+            std::cout << "Audio device: absent, running on the null backend" << std::endl;
         }
-    }
-
-    float processMono(float input)
-    {
-        // Early reflections
-        float early = m_earlyReflectionsL->process(input) * m_earlyReflectionLevel;
-
-        // Comb filters (parallel)
-        float combOut = 0.0f;
-        for (auto &comb : m_combFiltersL)
+        else if (m_reattachCount.load() > 0)
         {
-            combOut += comb->process(input);
+            std::cout << "Audio device: reattached " << m_reattachCount.load() << " time(s)" << std::endl;
         }
-        combOut *= 0.25f; // Scale for 4 combs
-
-        // All-pass filters (series)
-        float allpassOut = combOut;
-        for (auto &allpass : m_allPassFiltersL)
+        if (m_standbyActive.load() || m_failoverCount.load() > 0)
         {
-            allpassOut = allpass->process(allpassOut);
+            std::cout << "Standby playback: " << (m_standbyActive.load() ? "ready" : "none")
+                      << (m_standbyMirror.load() ? ", mirrored" : ", silent")
+                      << ", " << m_standbyXruns.load() << " xruns, "
+                      << m_failoverCount.load() << " failover(s)" << std::endl;
         }
-
-        return early + allpassOut * 0.7f;
-    }
-
-    std::pair<float, float> processStereo(float inputL, float inputR)
-    {
-        // Mono sum for reverb input
-        float monoInput = (inputL + inputR) * 0.5f;
-
-        // Early reflections
-        float earlyL = m_earlyReflectionsL->process(monoInput) * m_earlyReflectionLevel;
-        float earlyR = m_earlyReflectionsR->process(monoInput) * m_earlyReflectionLevel;
-
-        // Comb filters (parallel) - separate L/R
-        float combOutL = 0.0f;
-        float combOutR = 0.0f;
-
-        for (auto &comb : m_combFiltersL)
+        printLoudness();
+        snd_pcm_state_t captureState;
+        snd_pcm_state_t playbackState;
         {
-            combOutL += comb->process(monoInput);
+            // The playback thread closes and swaps handles under this lock
+            std::lock_guard<std::mutex> lock(m_recoveryMutex);
+            captureState = captureDevice.getState();
+            playbackState = playbackDevice.getState();
         }
-        for (auto &comb : m_combFiltersR)
+        std::cout << "Capture state: " << snd_pcm_state_name(captureState) << std::endl;
+        std::cout << "Playback state: " << snd_pcm_state_name(playbackState) << std::endl;
+        if (m_echoCanceller && m_echoCanceller->isEnabled())
         {
-            combOutR += comb->process(monoInput);
+            std::cout << "Echo canceller: delay " << m_echoCanceller->getReferenceDelay()
+                      << " frames, ERLE " << m_echoCanceller->getErle() << " dB" << std::endl;
         }
-
-        combOutL *= 0.25f;
-        combOutR *= 0.25f;
-
-        // All-pass filters (series)
-        float allpassOutL = combOutL;
-        float allpassOutR = combOutR;
-
-        for (auto &allpass : m_allPassFiltersL)
+        std::cout << "Input routing: " << ChannelMatrix::getKernelName(m_inputRouting.getKernel()) << std::endl;
+        const auto *agc = m_effectChain.findEffect<AgcEffect>();
+        if (agc && agc->isEnabled())
         {
-            allpassOutL = allpass->process(allpassOutL);
+            std::cout << "AGC: gain " << agc->getGain() << " dB, target "
+                      << agc->getTargetLoudness() << " LUFS" << std::endl;
         }
-        for (auto &allpass : m_allPassFiltersR)
+        if (auto *suppressor = m_effectChain.findEffect<FeedbackSuppressorEffect>())
         {
-            allpassOutR = allpass->process(allpassOutR);
+            std::cout << "Feedback notches: " << suppressor->getNotchCount() << std::endl;
+            for (size_t n = 0; n < FeedbackSuppressorEffect::getMaxNotches(); ++n)
+            {
+                const auto notch = suppressor->getNotch(n);
+                if (notch.second > 0.0f)
+                {
+                    std::cout << "  " << notch.first << " Hz, -" << notch.second << " dB" << std::endl;
+                }
+            }
         }
-
-        return {earlyL + allpassOutL * 0.7f, earlyR + allpassOutR * 0.7f};
+        std::cout << "===============================" << std::endl;
     }
-};
-
-// Delay effect implementation
-class DelayEffect : public AudioEffect
-{
-private:
-    std::vector<std::vector<int32_t>> m_delayBuffers; // One buffer per channel
-    std::vector<size_t> m_writeIndices;               // Write position for each channel
-    size_t m_bufferSize;
-    size_t m_delaySamples;
-    float m_feedback;
-    float m_wetLevel;
-    float m_dryLevel;
-
-public:
-    DelayEffect(float delayTimeMs = 250.0f, float feedback = 0.3f,
-                float wetLevel = 0.3f, float dryLevel = 0.7f)
-        : m_feedback(feedback), m_wetLevel(wetLevel), m_dryLevel(dryLevel)
+    // Effect control methods
+    void setDelayEnabled(bool enabled)
     {
-        setDelayTime(delayTimeMs);
+        if (auto *delay = m_effectChain.findEffect<DelayEffect>())
+        {
+            delay->setEnabled(enabled);
+        }
     }
 
-    void setDelayTime(float delayTimeMs)
+    void setDelayTime(float delayMs)
     {
-        m_delaySamples = static_cast<size_t>((delayTimeMs / 1000.0f) * m_sampleRate);
-        // Add some extra buffer space to prevent overflow
-        m_bufferSize = m_delaySamples + 1024;
-        reset();
+        if (auto *delay = m_effectChain.findEffect<DelayEffect>())
+        {
+            delay->setDelayTime(delayMs);
+        }
     }
 
-    void setFeedback(float feedback)
+    void setDelayFeedback(float feedback)
     {
-        // Prevent runaway feedback
-        m_feedback = std::max(0.0f, std::min(0.95f, feedback));
+        if (auto *delay = m_effectChain.findEffect<DelayEffect>())
+        {
+            delay->setFeedback(feedback);
+        }
     }
 
-    void setWetLevel(float wetLevel)
+    void setDelayMix(float wetLevel, float dryLevel)
     {
-        m_wetLevel = std::max(0.0f, std::min(1.0f, wetLevel));
+        if (auto *delay = m_effectChain.findEffect<DelayEffect>())
+        {
+            delay->setMix(wetLevel, dryLevel);
+        }
     }
 
-    void setDryLevel(float dryLevel)
+    void setSaturationEnabled(bool enabled)
     {
-        m_dryLevel = std::max(0.0f, std::min(1.0f, dryLevel));
+        if (auto *saturation = m_effectChain.findEffect<SaturationEffect>())
+        {
+            saturation->setEnabled(enabled);
+        }
     }
 
-    void setMix(float wetLevel, float dryLevel)
+    void setSaturationDrive(float driveDb)
     {
-        setWetLevel(wetLevel);
-        setDryLevel(dryLevel);
+        if (auto *saturation = m_effectChain.findEffect<SaturationEffect>())
+        {
+            saturation->setDrive(driveDb);
+        }
     }
 
-    // Getters
-    float getDelayTimeMs() const
+    void setNoiseSuppressionEnabled(bool enabled)
     {
-        return (static_cast<float>(m_delaySamples) / m_sampleRate) * 1000.0f;
+        if (auto *suppressor = m_effectChain.findEffect<NoiseSuppressionEffect>())
+        {
+            suppressor->setEnabled(enabled);
+        }
     }
 
-    float getFeedback() const { return m_feedback; }
-    float getWetLevel() const { return m_wetLevel; }
-    float getDryLevel() const { return m_dryLevel; }
-
-    void setSampleRate(unsigned int sampleRate) override
+    void setEchoCancellationEnabled(bool enabled)
     {
-        float currentDelayMs = getDelayTimeMs();
-        AudioEffect::setSampleRate(sampleRate);
-        setDelayTime(currentDelayMs); // Recalculate delay samples for new sample rate
+        if (m_echoCanceller)
+        {
+            m_echoCanceller->setEnabled(enabled);
+        }
     }
 
-    void reset() override
+    void setAgcEnabled(bool enabled)
     {
-        // Initialize delay buffers for each channel
-        const size_t maxChannels = 8; // Support up to 8 channels
-        m_delayBuffers.resize(maxChannels);
-        m_writeIndices.resize(maxChannels);
-
-        for (auto &buffer : m_delayBuffers)
+        if (auto *agc = m_effectChain.findEffect<AgcEffect>())
         {
-            buffer.clear();
-            buffer.resize(m_bufferSize, 0);
+            agc->setEnabled(enabled);
         }
-
-        std::fill(m_writeIndices.begin(), m_writeIndices.end(), 0);
     }
 
-    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
-                 size_t numSamples, unsigned int channels) override
+    void setAgcTarget(float lufs)
     {
-        if (!m_enabled || channels == 0)
+        if (auto *agc = m_effectChain.findEffect<AgcEffect>())
         {
-            // Pass through
-            if (inputBuffer != outputBuffer)
-            {
-                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
-            }
-            return;
+            agc->setTargetLoudness(lufs);
         }
+    }
 
-        // Ensure we have enough delay buffers
-        if (m_delayBuffers.size() < channels)
+    void setReverbRoom(int roomType)
+    {
+        if (auto *reverb = m_effectChain.findEffect<ReverbEffect>())
         {
-            m_delayBuffers.resize(channels);
-            m_writeIndices.resize(channels);
-            for (size_t i = 0; i < channels; ++i)
-            {
-                if (m_delayBuffers[i].size() != m_bufferSize)
-                {
-                    m_delayBuffers[i].clear();
-                    m_delayBuffers[i].resize(m_bufferSize, 0);
-                    m_writeIndices[i] = 0;
-                }
-            }
+            reverb->setRoomType(static_cast<ReverbEffect::RoomType>(std::clamp(roomType, 0, static_cast<int>(ReverbEffect::SPRING))));
         }
+    }
 
-        for (size_t sample = 0; sample < numSamples; ++sample)
+    // Capture-to-chain routing presets (0 = stereo, 1 = swapped, 2 = mono
+    // sum, 3 = left only); gains ramp over 10 ms
+    void setInputRouting(int mode)
+    {
+        switch (mode)
         {
-            for (unsigned int ch = 0; ch < channels; ++ch)
-            {
-                const size_t bufferIndex = sample * channels + ch;
-                const int32_t inputSample = inputBuffer[bufferIndex];
-
-                // Calculate read position (delay samples behind write position)
-                const size_t readIndex = (m_writeIndices[ch] + m_bufferSize - m_delaySamples) % m_bufferSize;
-
-                // Get delayed sample
-                const int32_t delayedSample = m_delayBuffers[ch][readIndex];
-
-                // Calculate feedback sample (delayed sample * feedback)
-                const int64_t feedbackSample = static_cast<int64_t>(delayedSample * m_feedback);
-
-                // Write to delay buffer (input + feedback)
-                const int64_t bufferInput = static_cast<int64_t>(inputSample) + feedbackSample;
-
-                // Clamp to prevent overflow
-                m_delayBuffers[ch][m_writeIndices[ch]] = static_cast<int32_t>(
-                    std::max(static_cast<int64_t>(INT32_MIN), std::min(static_cast<int64_t>(INT32_MAX), bufferInput)));
-
-                // Mix dry and wet signals
-                const int64_t drySignal = static_cast<int64_t>(inputSample * m_dryLevel);
-                const int64_t wetSignal = static_cast<int64_t>(delayedSample * m_wetLevel);
-                const int64_t mixedSignal = drySignal + wetSignal;
-
-                // Clamp and store output
-                outputBuffer[bufferIndex] = static_cast<int32_t>(
-                    std::max(static_cast<int64_t>(INT32_MIN), std::min(static_cast<int64_t>(INT32_MAX), mixedSignal)));
-
-                // Advance write position
-                m_writeIndices[ch] = (m_writeIndices[ch] + 1) % m_bufferSize;
-            }
+        case 1:
+            m_inputRouting.setMatrix({0.0f, 1.0f,
+                                      1.0f, 0.0f});
+            break;
+        case 2:
+            m_inputRouting.setMatrix({0.5f, 0.5f,
+                                      0.5f, 0.5f});
+            break;
+        case 3:
+            m_inputRouting.setMatrix({1.0f, 0.0f,
+                                      1.0f, 0.0f});
+            break;
+        default:
+            m_inputRouting.setIdentity();
+            break;
         }
     }
-};
-
-// Effect chain manager
-class AudioEffectChain
-{
-private:
-    std::vector<std::unique_ptr<AudioEffect>> m_effects;
-    std::vector<int32_t> m_tempBuffer;
 
-public:
-    void addEffect(std::unique_ptr<AudioEffect> effect)
+    // Width 1 disables the effect, which also lets the chain skip the M/S span
+    void setStereoWidth(float width)
     {
-        m_effects.push_back(std::move(effect));
+        if (auto *stereoWidth = m_effectChain.findEffect<StereoWidthEffect>())
+        {
+            stereoWidth->setWidth(width);
+            stereoWidth->setEnabled(stereoWidth->getWidth() != 1.0f);
+        }
     }
 
-    void removeEffect(size_t index)
+    void setCrossfeedEnabled(bool enabled)
     {
-        if (index < m_effects.size())
+        if (auto *crossfeed = m_effectChain.findEffect<CrossfeedEffect>())
         {
-            m_effects.erase(m_effects.begin() + index);
+            crossfeed->setEnabled(enabled);
         }
     }
 
-    void clearEffects()
+    // Where stop() saves and initialize() restores effect state; empty
+    // disables warm restarts
+    void setStateSnapshotPath(const std::string &path)
     {
-        m_effects.clear();
+        m_snapshotPath = path;
     }
 
-    AudioEffect *getEffect(size_t index)
+    // Restored snapshots can start effects enabled, so toggles ask first
+    template <typename T>
+    bool isEffectEnabled() const
     {
-        return (index < m_effects.size()) ? m_effects[index].get() : nullptr;
+        const T *effect = m_effectChain.findEffect<T>();
+        return effect && effect->isEnabled();
     }
 
-    size_t getEffectCount() const
+    // Mirrored, the standby takes over mid-programme; silent, it costs
+    // nothing but the keep-alive writes
+    void setStandbyMirrored(bool mirrored)
     {
-        return m_effects.size();
+        m_standbyMirror.store(mirrored);
     }
 
-    void setSampleRate(unsigned int sampleRate)
+    bool isStandbyMirrored() const
     {
-        for (auto &effect : m_effects)
-        {
-            effect->setSampleRate(sampleRate);
-        }
+        return m_standbyMirror.load();
     }
 
-    void reset()
+    void setFeedbackSuppressionEnabled(bool enabled)
     {
-        for (auto &effect : m_effects)
+        if (auto *suppressor = m_effectChain.findEffect<FeedbackSuppressorEffect>())
         {
-            effect->reset();
+            suppressor->setEnabled(enabled);
         }
     }
 
-    void process(const int32_t *inputBuffer, int32_t *outputBuffer,
-                 size_t numSamples, unsigned int channels)
+    void resetEffects()
     {
-        if (m_effects.empty())
-        {
-            // No effects, just copy input to output
-            if (inputBuffer != outputBuffer)
-            {
-                std::memcpy(outputBuffer, inputBuffer, numSamples * channels * sizeof(int32_t));
-            }
-            return;
-        }
+        m_effectChain.reset();
+        m_loudnessMeter.reset();
+    }
 
-        // Ensure temp buffer is large enough
-        const size_t totalSamples = numSamples * channels;
-        if (m_tempBuffer.size() < totalSamples)
-        {
-            m_tempBuffer.resize(totalSamples);
-        }
+private:
+    // Starts both streams; linked ones start from a single call
+    bool startStreams()
+    {
+        if (!captureDevice.start())
+            return false;
+        return m_streamsLinked.load() || playbackDevice.start();
+    }
 
-        // Process through effect chain
-        const int32_t *currentInput = inputBuffer;
-        int32_t *currentOutput = (m_effects.size() == 1) ? outputBuffer : m_tempBuffer.data();
+    // Drops up to frames of pending output, always leaving one period queued
+    // so skipping never causes an underrun. Returns the frames dropped.
+    size_t discardPlayback(size_t frames)
+    {
+        const size_t queued = secondBuffer->availableForRead() / CHANNELS;
+        if (queued <= PERIOD_SIZE)
+            return 0;
+        return secondBuffer->discard(std::min(frames, queued - PERIOD_SIZE) * CHANNELS) / CHANNELS;
+    }
 
-        for (size_t i = 0; i < m_effects.size(); ++i)
+    // Stands in for frames of lost capture ahead of next, the first period
+    // read after a restart: silence, then next mirrored in time under a
+    // raised-cosine fade-in, so the gap keeps its exact length and joins
+    // the live signal without a step
+    void writeConcealment(const std::vector<int32_t> &next, std::vector<int32_t> &scratch, size_t frames)
+    {
+        const size_t fadeStart = frames > PERIOD_SIZE ? frames - PERIOD_SIZE : 0;
+        const size_t fadeLength = frames - fadeStart;
+        for (size_t done = 0; done < frames;)
         {
-            // For the last effect, output directly to the final output buffer
-            if (i == m_effects.size() - 1)
+            const size_t count = std::min<size_t>(PERIOD_SIZE, frames - done);
+            for (size_t i = 0; i < count; ++i)
             {
-                currentOutput = outputBuffer;
+                const size_t frame = done + i;
+                if (frame < fadeStart)
+                {
+                    std::fill_n(scratch.begin() + i * CHANNELS, CHANNELS, 0);
+                    continue;
+                }
+                // Frame frames - 1 - k mirrors next[k]
+                const size_t k = frames - 1 - frame;
+                const float gain = 0.5f - 0.5f * std::cos(static_cast<float>(M_PI) * (frame - fadeStart + 1) / (fadeLength + 1));
+                for (unsigned int ch = 0; ch < CHANNELS; ++ch)
+                {
+                    scratch[i * CHANNELS + ch] = static_cast<int32_t>(gain * static_cast<float>(next[k * CHANNELS + ch]));
+                }
             }
-
-            m_effects[i]->process(currentInput, currentOutput, numSamples, channels);
-
-            // For next iteration, current output becomes input
-            if (i < m_effects.size() - 1)
+            if (!firstBuffer->write(scratch.data(), count * CHANNELS, false))
             {
-                currentInput = currentOutput;
-                // Alternate between temp buffer and output buffer for ping-pong processing
-                currentOutput = (currentInput == m_tempBuffer.data()) ? outputBuffer : m_tempBuffer.data();
+                std::cout << "Audio buffer overflow, dropping concealment" << std::endl;
+                break;
             }
+            done += count;
         }
+        m_concealedFrames.fetch_add(frames, std::memory_order_relaxed);
     }
-};
-
-class AudioProcessor
-{
-private:
-    ALSADevice captureDevice;
-    ALSADevice playbackDevice;
-    std::unique_ptr<BatchCircularBuffer> firstBuffer;
-    std::unique_ptr<BatchCircularBuffer> secondBuffer;
-    std::vector<std::unique_ptr<DelayLine>> delayBuffers;
-
-    std::atomic<bool>
-        running;
-    std::thread captureThread;
-    std::thread processingThread;
-    std::thread playbackThread;
-
-    AudioEffectChain m_effectChain;
-    std::unique_ptr<ReverbEffect> m_reverbEffect;
-    std::unique_ptr<DelayEffect> m_delayEffect;
-
-public:
-    // Audio parameters
-    static constexpr unsigned int SAMPLE_RATE = 48000;
-    static constexpr unsigned int CHANNELS = 2;
-    static constexpr snd_pcm_format_t FORMAT = SND_PCM_FORMAT_S32_LE;
-    static constexpr snd_pcm_uframes_t PERIOD_SIZE = 120;
-    static constexpr snd_pcm_uframes_t BUFFER_SIZE = PERIOD_SIZE * 2;
 
-    // Buffer parameters
-    static constexpr size_t FRAME_SIZE = CHANNELS * sizeof(int32_t);
-    static constexpr size_t AUDIO_BUFFER_SIZE = FRAME_SIZE * PERIOD_SIZE * 8; // ~92ms buffer
-
-    size_t getAudioBufferSize() const
+    static void writeSnapshotHeader(EffectStateWriter &out)
     {
-        return AUDIO_BUFFER_SIZE;
+        out.write(SNAPSHOT_MAGIC);
+        out.write(SNAPSHOT_VERSION);
+        out.write(SAMPLE_RATE);
+        out.write(CHANNELS);
+        const char *engine = typeid(DspEngine).name();
+        out.writeArray(engine, std::strlen(engine));
     }
 
-    size_t getSampleRate() const
+    // Snapshots only restore into the configuration that wrote them
+    static bool readSnapshotHeader(EffectStateReader &in)
     {
-        return SAMPLE_RATE;
+        uint32_t magic = 0;
+        uint32_t version = 0;
+        unsigned int sampleRate = 0;
+        unsigned int channels = 0;
+        std::vector<char> engine;
+        const char *expected = typeid(DspEngine).name();
+        return in.read(magic) && in.read(version) && in.read(sampleRate) && in.read(channels) &&
+               in.readArray(engine) && magic == SNAPSHOT_MAGIC && version == SNAPSHOT_VERSION &&
+               sampleRate == SAMPLE_RATE && channels == CHANNELS &&
+               engine.size() == std::strlen(expected) && std::equal(engine.begin(), engine.end(), expected);
     }
 
-    size_t getChannels() const
+    // Written aside and renamed into place, so an interrupted save never
+    // leaves half a snapshot behind
+    void saveEffectState()
     {
-        return CHANNELS;
-    }
+        if (m_snapshotPath.empty())
+            return;
 
-    AudioProcessor() : running(false)
-    {
-        firstBuffer = std::make_unique<BatchCircularBuffer>(getAudioBufferSize());
-        secondBuffer = std::make_unique<BatchCircularBuffer>(getAudioBufferSize());
-    }
+        std::vector<uint8_t> blob;
+        EffectStateWriter out(blob);
+        writeSnapshotHeader(out);
+        m_effectChain.saveStates(out);
 
-    ~AudioProcessor()
-    {
-        stop();
+        const std::string temporary = m_snapshotPath + ".tmp";
+        {
+            std::ofstream file(temporary, std::ios::binary | std::ios::trunc);
+            file.write(reinterpret_cast<const char *>(blob.data()), static_cast<std::streamsize>(blob.size()));
+            if (!file)
+            {
+                std::cerr << "Error writing effect state to " << temporary << std::endl;
+                return;
+            }
+        }
+        if (std::rename(temporary.c_str(), m_snapshotPath.c_str()) != 0)
+        {
+            std::cerr << "Error saving effect state to " << m_snapshotPath << std::endl;
+            return;
+        }
+        std::cout << "Effect state saved to " << m_snapshotPath << " (" << blob.size() << " bytes)" << std::endl;
     }
 
-    bool initialize(const std::string &captureDeviceName = "default",
-                    const std::string &playbackDeviceName = "default")
+    // Maps the snapshot and restores the built chain from it. Deferred
+    // state (the delay line) is claimed and filled straight from the
+    // mapping, so the background zeroing never runs; lines the effects
+    // allocate up front are overwritten in place. A missing or foreign
+    // snapshot is a cold start.
+    bool restoreEffectState()
     {
+        if (m_snapshotPath.empty())
+            return false;
 
-        std::cout << "Initializing audio processor..." << std::endl;
+        const int fd = ::open(m_snapshotPath.c_str(), O_RDONLY | O_CLOEXEC);
+        if (fd < 0)
+            return false; // First start
 
-        // Open and configure capture device
-        if (!captureDevice.open(captureDeviceName, SND_PCM_STREAM_CAPTURE))
+        struct stat info;
+        void *mapped = MAP_FAILED;
+        if (fstat(fd, &info) == 0 && info.st_size > 0)
         {
-            return false;
+            mapped = mmap(nullptr, static_cast<size_t>(info.st_size), PROT_READ, MAP_PRIVATE | MAP_POPULATE, fd, 0);
         }
-
-        if (!captureDevice.configure(SAMPLE_RATE, CHANNELS, FORMAT, BUFFER_SIZE, PERIOD_SIZE))
+        ::close(fd);
+        if (mapped == MAP_FAILED)
         {
+            std::cerr << "Error mapping effect state " << m_snapshotPath << std::endl;
             return false;
         }
 
-        // Open and configure playback device
-        if (!playbackDevice.open(playbackDeviceName, SND_PCM_STREAM_PLAYBACK))
+        EffectStateReader in(static_cast<const uint8_t *>(mapped), static_cast<size_t>(info.st_size));
+        const bool compatible = readSnapshotHeader(in);
+        const size_t restored = compatible ? m_effectChain.restoreStates(in) : 0;
+        munmap(mapped, static_cast<size_t>(info.st_size));
+
+        if (!compatible)
         {
+            std::cout << "Effect state in " << m_snapshotPath << " is from another configuration, starting cold" << std::endl;
             return false;
         }
+        std::cout << "Restored " << restored << " of " << m_effectChain.getEffectCount()
+                  << " effects from " << m_snapshotPath << std::endl;
+        return restored > 0;
+    }
 
-        if (!playbackDevice.configure(SAMPLE_RATE, CHANNELS, FORMAT, BUFFER_SIZE, PERIOD_SIZE))
+    // With m_restarting set, the capture thread either sees it or is already
+    // in read(), which the dropped or vanished device ends quickly
+    void waitForCaptureOutOfDevice()
+    {
+        while (m_captureInDevice.load())
         {
-            return false;
+            std::this_thread::yield();
         }
+    }
 
-        // Agregar reverb
-        m_reverbEffect = std::make_unique<ReverbEffect>(SAMPLE_RATE, CHANNELS, ReverbEffect::MEDIUM_ROOM);
-        m_reverbEffect->setMix(0.3f); // 30% wet
-        m_effectChain.addEffect(std::move(m_reverbEffect));
-
-        // Initialize effect chain (add this at the end of the method)
-        m_delayEffect = std::make_unique<DelayEffect>(getSampleRate(), getChannels());
-        m_delayEffect->setDelayTime(250.0f); // 250ms delay
-        m_delayEffect->setFeedback(0.3f);    // 30% feedback
-        m_delayEffect->setMix(0.4f, 0.6f);   // 40% wet signal
-        m_effectChain.addEffect(std::move(m_delayEffect));
+    // Card id behind a PCM name ("hw:1,0", "plughw:CARD=USB,DEV=0" -> "1",
+    // "USB"), or empty when the name does not identify a card
+    static std::string cardOfDevice(const std::string &pcm)
+    {
+        const size_t colon = pcm.find(':');
+        if (colon == std::string::npos || (pcm.compare(0, colon, "hw") != 0 && pcm.compare(0, colon, "plughw") != 0))
+            return "";
+        std::string card = pcm.substr(colon + 1);
+        if (card.compare(0, 5, "CARD=") == 0)
+            card = card.substr(5);
+        return card.substr(0, card.find(','));
+    }
 
-        std::cout << "Audio processor initialized successfully" << std::endl;
-        return true;
+    // Playback thread, from a failed restart or a supervisor report: drop the
+    // hardware and keep every thread and the effect chain running on the
+    // null backend until the device returns
+    void detachDevices()
+    {
+        std::lock_guard<std::mutex> lock(m_recoveryMutex);
+        m_restarting.store(true);
+        captureDevice.drop();
+        playbackDevice.drop();
+        waitForCaptureOutOfDevice();
+        captureDevice.detach();
+        playbackDevice.detach();
+        m_streamsLinked = false;
+        m_detached.store(true);
+        m_captureXrun.store(false);
+        m_restarting.store(false);
+        m_streamEpoch.fetch_add(1, std::memory_order_release);
+        m_recoveryDone.notify_all();
+        std::cout << "Audio device lost; running on the null backend until it returns" << std::endl;
     }
 
-    bool start()
+    // Playback thread, once the supervisor sees the card again: reopen and
+    // reconfigure both PCMs and restart them with a single period queued.
+    // On failure the null backend stays in place for the next attempt.
+    void reattachDevices()
     {
-        if (running.load())
+        const auto began = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_recoveryMutex);
+        m_restarting.store(true);
+        waitForCaptureOutOfDevice();
+
+        const bool opened = captureDevice.open(captureDevice.getName(), SND_PCM_STREAM_CAPTURE) &&
+                            captureDevice.configure(SAMPLE_RATE, CHANNELS, FORMAT, BUFFER_SIZE, PERIOD_SIZE) &&
+                            playbackDevice.open(playbackDevice.getName(), SND_PCM_STREAM_PLAYBACK) &&
+                            playbackDevice.configure(SAMPLE_RATE, CHANNELS, FORMAT, BUFFER_SIZE, PERIOD_SIZE);
+        if (opened)
         {
-            std::cout << "Audio processor already running" << std::endl;
-            return false;
+            m_streamsLinked = captureDevice.link(playbackDevice);
         }
-
-        // Prepare devices
-        if (!captureDevice.prepare() || !playbackDevice.prepare())
+        const bool started = opened && captureDevice.prepare() && playbackDevice.prepare() &&
+                             playbackDevice.write(m_silence.data(), PERIOD_SIZE) >= 0 && startStreams();
+        if (!started)
         {
-            return false;
+            captureDevice.detach();
+            playbackDevice.detach();
         }
+        else
+        {
+            playbackDevice.markTransfer();
+            m_detached.store(false);
+            m_reattachCount.fetch_add(1, std::memory_order_relaxed);
+            m_streamEpoch.fetch_add(1, std::memory_order_release);
+        }
+        m_restarting.store(false);
+        m_recoveryDone.notify_all();
 
-        running.store(true);
-
-        // Start threads
-        processingThread = std::thread(&AudioProcessor::processingLoop, this);
-        captureThread = std::thread(&AudioProcessor::captureLoop, this);
-        playbackThread = std::thread(&AudioProcessor::playbackLoop, this);
-
-        std::cout << "Audio processing started" << std::endl;
-        return true;
+        if (started)
+        {
+            const auto elapsed = std::chrono::duration_cast<std::chrono::microseconds>(
+                std::chrono::steady_clock::now() - began);
+            std::cout << "Audio device back; streams running again after " << elapsed.count() << " us" << std::endl;
+        }
     }
 
-    void stop()
+    // Watches the configured cards. While attached, a control handle per
+    // card is read for events; the read failing means the card has gone.
+    // While detached, card presence is polled so the device is reopened as
+    // soon as it re-enumerates.
+    void supervisorLoop()
     {
-        if (!running.load())
-            return;
+        std::vector<std::string> cards;
+        bool named = true;
+        uint64_t failovers = ~uint64_t{0};
+
+        std::vector<snd_ctl_t *> controls;
+        snd_ctl_event_t *event = nullptr;
+        snd_ctl_event_malloc(&event);
+        auto closeControls = [&]()
+        {
+            for (snd_ctl_t *control : controls)
+                snd_ctl_close(control);
+            controls.clear();
+        };
 
-        std::cout << "Stopping audio processor..." << std::endl;
-        running.store(false);
+        while (running.load())
+        {
+            if (failovers != m_failoverCount.load(std::memory_order_acquire))
+            {
+                // Playback moved to another PCM: watch its card instead
+                closeControls();
+                cards.clear();
+                named = true;
+                std::lock_guard<std::mutex> lock(m_recoveryMutex);
+                failovers = m_failoverCount.load();
+                for (const std::string &pcm : {captureDevice.getName(), playbackDevice.getName()})
+                {
+                    const std::string card = cardOfDevice(pcm);
+                    named = named && !card.empty();
+                    if (!card.empty() && std::find(cards.begin(), cards.end(), card) == cards.end())
+                        cards.push_back(card);
+                }
+            }
 
-        // Wake up threads
-        firstBuffer->clear();
-        secondBuffer->clear();
+            if (m_detached.load())
+            {
+                closeControls();
+                const bool present = std::all_of(cards.begin(), cards.end(), [](const std::string &card)
+                                                 { return snd_card_get_index(card.c_str()) >= 0; });
+                if (present && !m_deviceReturned.load())
+                {
+                    m_deviceReturned.store(true);
+                }
+                std::this_thread::sleep_for(std::chrono::milliseconds(named ? SUPERVISOR_POLL_MS : SUPERVISOR_RETRY_MS));
+                continue;
+            }
 
-        // Wait for threads to finish
-        if (captureThread.joinable())
-        {
-            captureThread.join();
-        }
-        std::cout << "Prueba de flujo..." << std::endl;
-        // Wait for threads to finish
-        if (processingThread.joinable())
-        {
-            processingThread.join();
-        }
+            if (controls.size() != cards.size())
+            {
+                closeControls();
+                for (const std::string &card : cards)
+                {
+                    snd_ctl_t *control = nullptr;
+                    const std::string name = "hw:" + card;
+                    if (snd_ctl_open(&control, name.c_str(), SND_CTL_NONBLOCK) < 0)
+                        break;
+                    snd_ctl_subscribe_events(control, 1);
+                    controls.push_back(control);
+                }
+                if (controls.size() != cards.size())
+                {
+                    // Not watchable (yet); stream errors still detach
+                    std::this_thread::sleep_for(std::chrono::milliseconds(SUPERVISOR_RETRY_MS));
+                    continue;
+                }
+            }
+            if (controls.empty())
+            {
+                std::this_thread::sleep_for(std::chrono::milliseconds(SUPERVISOR_RETRY_MS));
+                continue;
+            }
 
-        if (playbackThread.joinable())
-        {
-            playbackThread.join();
+            bool lost = false;
+            for (snd_ctl_t *control : controls)
+            {
+                const int ready = snd_ctl_wait(control, SUPERVISOR_POLL_MS);
+                int err = ready < 0 ? ready : 0;
+                while (ready > 0 && (err = snd_ctl_read(control, event)) > 0)
+                {
+                }
+                lost = lost || (err < 0 && err != -EAGAIN);
+            }
+            if (lost)
+            {
+                closeControls();
+                m_deviceLost.store(true);
+            }
         }
 
-        // Stop and drop devices
-        captureDevice.drop();
-        playbackDevice.drop();
-
-        std::cout << "Audio processor stopped" << std::endl;
+        closeControls();
+        snd_ctl_event_free(event);
     }
 
-    void printStatus() const
+    static bool cardPresent(const std::string &pcm)
     {
-        std::cout << "\n=== Audio Processor Status ===" << std::endl;
-        std::cout << "Running: " << (running.load() ? "Yes" : "No") << std::endl;
-        std::cout << "First buffer usage: " << firstBuffer->availableForRead()
-                  << " / " << getAudioBufferSize() << " bytes" << std::endl;
-        std::cout << "Second buffer usage: " << secondBuffer->availableForRead()
-                  << " / " << getAudioBufferSize() << " bytes" << std::endl;
-        std::cout << "Capture state: " << snd_pcm_state_name(captureDevice.getState()) << std::endl;
-        std::cout << "Playback state: " << snd_pcm_state_name(playbackDevice.getState()) << std::endl;
-        std::cout << "===============================" << std::endl;
+        const std::string card = cardOfDevice(pcm);
+        return card.empty() || snd_card_get_index(card.c_str()) >= 0;
     }
-    // Effect control methods
-    void setDelayEnabled(bool enabled)
+
+    // Refills the standby with the start-up silence; it starts on its own
+    // once a period is queued
+    void restartStandby()
     {
-        if (auto *delay = dynamic_cast<DelayEffect *>(m_effectChain.getEffect(0)))
+        if (!standbyDevice.prepare())
+            return;
+        for (size_t i = 0; i < PLAYBACK_PREFILL_PERIODS; ++i)
         {
-            delay->setEnabled(enabled);
+            standbyDevice.write(m_silence.data(), PERIOD_SIZE);
         }
     }
 
-    void setDelayTime(float delayMs)
+    // Keeps the standby level with the primary without ever waiting on it:
+    // output that does not fit is dropped, an underrun restarts it behind
+    // fresh silence, and any other error retires it
+    void feedStandby(const std::vector<int32_t> &period)
     {
-        if (auto *delay = dynamic_cast<DelayEffect *>(m_effectChain.getEffect(0)))
+        const snd_pcm_sframes_t written =
+            standbyDevice.write(m_standbyMirror.load(std::memory_order_relaxed) ? period.data() : m_silence.data(), PERIOD_SIZE);
+        if (written >= 0 || written == -EAGAIN)
+            return;
+        if (written == -EPIPE || written == -ESTRPIPE)
         {
-            delay->setDelayTime(delayMs);
+            m_standbyXruns.fetch_add(1, std::memory_order_relaxed);
+            restartStandby();
+            return;
         }
+        std::cerr << "Standby playback error: " << snd_strerror(written) << ", failover disabled" << std::endl;
+        std::lock_guard<std::mutex> lock(m_recoveryMutex);
+        standbyDevice.close();
+        m_standbyActive.store(false);
     }
 
-    void setDelayFeedback(float feedback)
+    // Playback thread: hands output to the standby, which is already running
+    // with the same audio queued, so only what the primary had buffered is
+    // lost. The failed device is closed and not retried.
+    bool failOverToStandby(const char *reason)
     {
-        if (auto *delay = dynamic_cast<DelayEffect *>(m_effectChain.getEffect(0)))
+        if (!m_standbyActive.load())
+            return false;
+
+        std::lock_guard<std::mutex> lock(m_recoveryMutex);
+        if (m_streamsLinked.load())
         {
-            delay->setFeedback(feedback);
+            playbackDevice.unlink();
+            m_streamsLinked = false;
         }
+        playbackDevice.close();
+        playbackDevice.swap(standbyDevice);
+        playbackDevice.setNonBlocking(false);
+        m_standbyActive.store(false);
+        m_failoverCount.fetch_add(1, std::memory_order_release);
+        std::cout << "Playback failed over to " << playbackDevice.getName() << " (" << reason << ")" << std::endl;
+        return true;
     }
 
-    void setDelayMix(float wetLevel, float dryLevel)
+    // Restarts both streams after an xrun on either, from the playback
+    // thread. Frames lost are measured from each stream's timestamps:
+    // capture owes that much concealment ahead of its next period, playback
+    // skips the output that fell due while it was stopped (or pads with
+    // silence if it restarts early), so the capture-to-playback latency is
+    // the same afterwards. Playback comes back with one period queued.
+    // pending says period holds output whose write failed; it goes first.
+    bool recoverStreams(std::vector<int32_t> &period, bool pending, size_t &skipFrames)
     {
-        if (auto *delay = dynamic_cast<DelayEffect *>(m_effectChain.getEffect(0)))
+        const auto began = std::chrono::steady_clock::now();
+        std::lock_guard<std::mutex> lock(m_recoveryMutex);
+        m_restarting.store(true);
+
+        captureDevice.drop();
+        playbackDevice.drop();
+        waitForCaptureOutOfDevice();
+        if (!captureDevice.prepare() || !playbackDevice.prepare())
         {
-            delay->setMix(wetLevel, dryLevel);
+            m_restarting.store(false);
+            return false;
         }
-    }
 
-    void resetEffects()
-    {
-        m_effectChain.reset();
+        const int64_t now = ALSADevice::monotonicNow();
+        const snd_pcm_sframes_t maxFrames = AUDIO_BUFFER_SIZE / CHANNELS;
+        const snd_pcm_sframes_t captureLost = std::clamp<snd_pcm_sframes_t>(captureDevice.getFramesLate(now), 0, maxFrames);
+        const snd_pcm_sframes_t playbackLate = std::clamp<snd_pcm_sframes_t>(playbackDevice.getFramesLate(now), -maxFrames, maxFrames);
+
+        // Output that fell due while stopped is skipped now, or as it arrives
+        skipFrames += static_cast<size_t>(std::max<snd_pcm_sframes_t>(playbackLate, 0));
+        if (pending && skipFrames >= PERIOD_SIZE)
+        {
+            skipFrames -= PERIOD_SIZE;
+            pending = false;
+        }
+        skipFrames -= discardPlayback(skipFrames);
+
+        // Early restart: pad so the next output still plays on schedule
+        for (snd_pcm_sframes_t pad = std::min<snd_pcm_sframes_t>(-playbackLate, BUFFER_SIZE - PERIOD_SIZE); pad > 0;)
+        {
+            const snd_pcm_sframes_t count = std::min<snd_pcm_sframes_t>(pad, PERIOD_SIZE);
+            playbackDevice.write(m_silence.data(), count);
+            pad -= count;
+        }
+
+        // One period to come back on: the next output if ready, else silence
+        if (!pending && !secondBuffer->read(period.data(), PERIOD_SAMPLES, false))
+        {
+            std::fill(period.begin(), period.end(), 0);
+        }
+        const bool started = playbackDevice.write(period.data(), PERIOD_SIZE) >= 0 && startStreams();
+        m_restarting.store(false);
+        if (!started)
+        {
+            return false;
+        }
+        playbackDevice.markTransfer();
+
+        m_captureConcealFrames += static_cast<size_t>(captureLost);
+        m_captureXrun.store(false);
+        m_streamEpoch.fetch_add(1, std::memory_order_release);
+        m_recoveryDone.notify_all();
+
+        const uint64_t elapsed = std::chrono::duration_cast<std::chrono::nanoseconds>(
+                                     std::chrono::steady_clock::now() - began)
+                                     .count();
+        m_xrunCount.fetch_add(1, std::memory_order_relaxed);
+        m_recoveryNsTotal.fetch_add(elapsed, std::memory_order_relaxed);
+        if (elapsed > m_recoveryNsMax.load(std::memory_order_relaxed))
+        {
+            m_recoveryNsMax.store(elapsed, std::memory_order_relaxed);
+        }
+        std::cout << "Streams restarted in " << elapsed / 1000 << " us: " << captureLost
+                  << " capture frames concealed, playback " << playbackLate << " frames late" << std::endl;
+        return true;
     }
 
-private:
     void captureLoop()
     {
         std::vector<int32_t> captureBuffer(PERIOD_SIZE * CHANNELS);
+        std::vector<int32_t> concealBuffer(PERIOD_SIZE * CHANNELS);
+        uint64_t epoch = m_streamEpoch.load();
 
         std::cout << "Capture thread started" << std::endl;
 
-        // Start capture device
-        if (!captureDevice.start())
-        {
-            running.store(false);
-            return;
-        }
-
         // Pre-fill playback buffer with silence to avoid underruns
         std::fill(captureBuffer.begin(), captureBuffer.end(), 0);
         for (int i = 0; i < 5; ++i)
         {
-            secondBuffer->write(captureBuffer.data(), PERIOD_SIZE * FRAME_SIZE);
+            secondBuffer->write(captureBuffer.data(), PERIOD_SAMPLES);
         }
 
         while (running.load())
         {
+            // Stay out of the device while the playback thread swaps streams:
+            // a read could start prepared streams early, or use a closed handle
+            m_captureInDevice.store(true);
+            if (m_restarting.load())
+            {
+                m_captureInDevice.store(false);
+                std::lock_guard<std::mutex> wait(m_recoveryMutex);
+                continue;
+            }
             snd_pcm_sframes_t framesRead = captureDevice.read(captureBuffer.data(), PERIOD_SIZE);
+            m_captureInDevice.store(false);
 
             if (framesRead < 0)
             {
@@ -1479,26 +10233,44 @@ private:
 
                 std::cerr << "Capture error: " << snd_strerror(framesRead) << std::endl;
 
-                if (!captureDevice.recover(framesRead))
+                // The playback thread restarts both streams
+                std::unique_lock<std::mutex> lock(m_recoveryMutex);
+                if (m_streamEpoch.load() == epoch)
                 {
-                    std::cerr << "Failed to recover capture device" << std::endl;
-                    running.store(false);
-                    break;
+                    m_captureXrun.store(true);
+                    m_recoveryDone.wait(lock, [&]()
+                                        { return !running.load() || m_streamEpoch.load() != epoch; });
                 }
                 continue;
             }
 
+            captureDevice.markTransfer();
+            if (m_streamEpoch.load(std::memory_order_acquire) != epoch)
+            {
+                // Streams were restarted: fill the gap ahead of the first new period
+                size_t concealFrames;
+                {
+                    std::lock_guard<std::mutex> lock(m_recoveryMutex);
+                    epoch = m_streamEpoch.load();
+                    concealFrames = m_captureConcealFrames;
+                    m_captureConcealFrames = 0;
+                }
+                writeConcealment(captureBuffer, concealBuffer, concealFrames);
+            }
+
             if (framesRead != PERIOD_SIZE)
             {
                 std::cout << "Capture: expected " << PERIOD_SIZE
                           << " frames, got " << framesRead << std::endl;
             }
 
-            size_t bytesToWrite = framesRead * FRAME_SIZE;
+            m_captureDelay.store(captureDevice.getDelay(), std::memory_order_relaxed);
+
+            size_t samplesToWrite = framesRead * CHANNELS;
 
             // Write to circular buffer
             const int32_t *data = reinterpret_cast<const int32_t *>(captureBuffer.data());
-            if (!firstBuffer->write(data, bytesToWrite, false))
+            if (!firstBuffer->write(data, samplesToWrite, false))
             {
                 // Buffer overflow - skip this frame
                 std::cout << "Audio buffer overflow, dropping captured frame" << std::endl;
@@ -1509,7 +10281,9 @@ private:
 
     void processingLoop()
     {
-        std::vector<int32_t> processingBuffer(PERIOD_SIZE * CHANNELS);
+        std::vector<int32_t> processingBuffer(PERIOD_SAMPLES * MAX_CATCH_UP_PERIODS);
+        std::vector<int32_t> routedBuffer(PERIOD_SAMPLES * MAX_CATCH_UP_PERIODS);
+        float echoDelay = -1.0f;
 
         std::cout << "Processing thread started" << std::endl;
 
@@ -1518,17 +10292,53 @@ private:
             // Read from circular buffer
             int32_t *data = processingBuffer.data();
 
-            if (!firstBuffer->read(data, PERIOD_SIZE * FRAME_SIZE, true))
+            // Normally one period; after a stall, everything queued (up to
+            // MAX_CATCH_UP_PERIODS) as one block, as long as the playback
+            // side has room for the result
+            const size_t queued = firstBuffer->availableForRead() / PERIOD_SAMPLES;
+            const size_t room = secondBuffer->availableForWrite() / PERIOD_SAMPLES;
+            const size_t periods = std::clamp<size_t>(std::min(queued, room), 1, MAX_CATCH_UP_PERIODS);
+            const size_t frames = periods * PERIOD_SIZE;
+            const size_t samples = periods * PERIOD_SAMPLES;
+
+            if (!firstBuffer->read(data, samples, true))
             {
                 // Not enough data available - play silence
                 // std::fill(processingBuffer.begin(), processingBuffer.end(), 0);
                 std::cout << "Processing buffer underrun, playing silence" << std::endl;
             }
 
-            //
-            m_effectChain.process(data, data, PERIOD_SIZE, CHANNELS);
+            if (periods > 1)
+            {
+                m_catchUpBlocks.fetch_add(1, std::memory_order_relaxed);
+                m_catchUpPeriods.fetch_add(periods - 1, std::memory_order_relaxed);
+                if (periods > m_largestCatchUp.load(std::memory_order_relaxed))
+                {
+                    m_largestCatchUp.store(periods, std::memory_order_relaxed);
+                }
+            }
+
+            m_inputRouting.process(data, routedBuffer.data(), frames);
+            m_effectChain.process(routedBuffer.data(), data, frames, CHANNELS);
+
+            if (m_echoCanceller && m_echoCanceller->isEnabled())
+            {
+                // A captured frame's echo left the chain this many frames earlier:
+                // queued capture + capture device, then playback device + queued
+                // playback, plus the block in hand
+                const snd_pcm_sframes_t measured =
+                    static_cast<snd_pcm_sframes_t>((firstBuffer->availableForRead() + secondBuffer->availableForRead()) / CHANNELS) +
+                    m_captureDelay.load(std::memory_order_relaxed) + m_playbackDelay.load(std::memory_order_relaxed) +
+                    static_cast<snd_pcm_sframes_t>(frames);
+                echoDelay = echoDelay < 0.0f ? measured : echoDelay + ECHO_DELAY_SMOOTHING * (measured - echoDelay);
+                m_echoCanceller->setReferenceDelay(static_cast<size_t>(std::max<snd_pcm_sframes_t>(
+                    0, static_cast<snd_pcm_sframes_t>(echoDelay) - ECHO_DELAY_MARGIN)));
+                m_echoCanceller->pushReference(data, frames, CHANNELS);
+            }
+
+            m_loudnessMeter.process(data, frames, CHANNELS);
 
-            if (!secondBuffer->write(data, PERIOD_SIZE * FRAME_SIZE, false))
+            if (!secondBuffer->write(data, samples, false))
             {
                 // Buffer overflow - skip this frame
                 std::cout << "Processing buffer overflow, dropping captured frame" << std::endl;
@@ -1545,22 +10355,50 @@ private:
     void
     playbackLoop()
     {
-        std::vector<int32_t> playbackBuffer(PERIOD_SIZE * CHANNELS);
-        const size_t bufferSizeBytes = playbackBuffer.size() * sizeof(int32_t);
+        std::vector<int32_t> playbackBuffer(PERIOD_SAMPLES);
+        size_t skipFrames = 0; // Output still owed to an xrun
 
-        std::cout << "Playback thread started " << std::endl;
+        // Recent primary xruns, for the standby's failover criterion
+        unsigned windowXruns = 0;
+        auto windowStart = std::chrono::steady_clock::now();
+        // Set by a capture xrun until the next period is written: a linked
+        // capture stops playback with it, and that xrun is not the playback
+        // device's fault
+        bool captureRestart = false;
 
-        // Pre-fill playback buffer with silence to avoid underruns
-        std::fill(playbackBuffer.begin(), playbackBuffer.end(), 0);
-        for (int i = 0; i < 2; ++i)
-        {
-            playbackDevice.write(playbackBuffer.data(), PERIOD_SIZE);
-        }
+        std::cout << "Playback thread started " << std::endl;
 
         while (running.load())
         {
+            if (m_deviceLost.exchange(false) && !m_detached.load())
+            {
+                // Only the playback card gone: the standby can carry on
+                const bool playbackOnly = cardPresent(captureDevice.getName()) && !cardPresent(playbackDevice.getName());
+                if (!(playbackOnly && failOverToStandby("device removed")))
+                {
+                    detachDevices();
+                }
+            }
+            if (m_deviceReturned.exchange(false) && m_detached.load())
+            {
+                reattachDevices();
+                skipFrames = 0;
+            }
+            if (m_captureXrun.load(std::memory_order_acquire))
+            {
+                captureRestart = true;
+                if (!recoverStreams(playbackBuffer, false, skipFrames))
+                {
+                    std::cerr << "Failed to restart audio streams" << std::endl;
+                    detachDevices();
+                }
+            }
+            if (skipFrames > 0)
+            {
+                skipFrames -= discardPlayback(skipFrames);
+            }
 
-            if (!secondBuffer->read(playbackBuffer.data(), bufferSizeBytes, false))
+            if (!secondBuffer->read(playbackBuffer.data(), playbackBuffer.size(), false))
             {
                 // Not enough data available - play silence
                 std::fill(playbackBuffer.begin(), playbackBuffer.end(), 0);
@@ -1569,6 +10407,11 @@ private:
 
             void *data = reinterpret_cast<void *>(playbackBuffer.data());
 
+            if (m_standbyActive.load(std::memory_order_relaxed) && !playbackDevice.waitReady(STANDBY_STALL_MS))
+            {
+                failOverToStandby("stalled");
+            }
+
             snd_pcm_sframes_t framesWritten = playbackDevice.write(data, PERIOD_SIZE);
 
             if (framesWritten < 0)
@@ -1580,15 +10423,45 @@ private:
 
                 std::cerr << "Playback error: " << snd_strerror(framesWritten) << std::endl;
 
-                if (!playbackDevice.recover(framesWritten))
+                // Hard errors and repeated xruns move to the standby, which
+                // takes the failed period next; lone xruns are restarted
+                const bool xrun = framesWritten == -EPIPE || framesWritten == -ESTRPIPE;
+                const bool fromCapture = captureRestart ||
+                                         (m_streamsLinked.load() && m_captureXrun.load(std::memory_order_acquire));
+                if (xrun && !fromCapture)
+                {
+                    const auto now = std::chrono::steady_clock::now();
+                    if (now - windowStart > STANDBY_XRUN_WINDOW)
+                    {
+                        windowStart = now;
+                        windowXruns = 0;
+                    }
+                    ++windowXruns;
+                }
+                if ((!xrun || (!fromCapture && windowXruns >= STANDBY_XRUN_LIMIT)) &&
+                    failOverToStandby(xrun ? "repeated xruns" : snd_strerror(framesWritten)))
+                {
+                    windowXruns = 0;
+                    playbackDevice.write(data, PERIOD_SIZE);
+                    continue;
+                }
+
+                if (!recoverStreams(playbackBuffer, true, skipFrames))
                 {
-                    std::cerr << "Failed to recover playback device" << std::endl;
-                    running.store(false);
-                    break;
+                    std::cerr << "Failed to restart audio streams" << std::endl;
+                    detachDevices();
                 }
                 continue;
             }
 
+            captureRestart = false;
+            playbackDevice.markTransfer();
+            m_playbackDelay.store(playbackDevice.getDelay(), std::memory_order_relaxed);
+            if (m_standbyActive.load(std::memory_order_relaxed))
+            {
+                feedStandby(playbackBuffer);
+            }
+
             if (framesWritten != PERIOD_SIZE)
             {
                 std::cout << "Playback: expected " << PERIOD_SIZE
@@ -1605,23 +10478,47 @@ int main(int argc, char *argv[])
     std::string captureDevice = "default";
     std::string playbackDevice = "default";
 
+    if (argc >= 2 && std::string(argv[1]) == "--bench")
+    {
+        runSaturationBenchmark();
+        runNoiseSuppressionBenchmark();
+        runEchoCancellerBenchmark();
+        runMultibandBenchmark();
+        runChannelMatrixBenchmark();
+        return 0;
+    }
+
+    if (argc >= 3 && std::string(argv[1]) == "--render")
+    {
+        // Offline: audio_processor --render input.raw [output.raw]
+        AudioProcessor processor;
+        return processor.renderFile(argv[2], argc >= 4 ? argv[3] : "") ? 0 : 1;
+    }
+
     // Parse command line arguments
     if (argc >= 2)
         captureDevice = argv[1];
     if (argc >= 3)
         playbackDevice = argv[2];
+    std::string standbyDevice = argc >= 4 ? argv[3] : "";
 
     std::cout << "ALSA Audio Processor" << std::endl;
     std::cout << "Capture device: " << captureDevice << std::endl;
     std::cout << "Playback device: " << playbackDevice << std::endl;
+    if (!standbyDevice.empty())
+        std::cout << "Standby playback device: " << standbyDevice << std::endl;
     std::cout << "Sample rate: " << AudioProcessor::SAMPLE_RATE << " Hz" << std::endl;
     std::cout << "Channels: " << AudioProcessor::CHANNELS << std::endl;
     std::cout << "Format: 16-bit signed little endian" << std::endl;
     std::cout << "===========================================" << std::endl;
 
     AudioProcessor processor;
+    if (const char *statePath = std::getenv("AUDIO_PROCESSOR_STATE"))
+    {
+        processor.setStateSnapshotPath(statePath);
+    }
 
-    if (!processor.initialize(captureDevice, playbackDevice))
+    if (!processor.initialize(captureDevice, playbackDevice, standbyDevice))
     {
         std::cerr << "Failed to initialize audio processor" << std::endl;
         return 1;
@@ -1641,6 +10538,18 @@ int main(int argc, char *argv[])
     std::cout << "  't' - Set delay time (ms)" << std::endl;
     std::cout << "  'f' - Set feedback (0.0-0.9)" << std::endl;
     std::cout << "  'm' - Set mix (0.0-1.0)" << std::endl;
+    std::cout << "  'e' - Toggle echo cancellation" << std::endl;
+    std::cout << "  'a' - Toggle automatic gain control" << std::endl;
+    std::cout << "  'l' - Set AGC target loudness (LUFS)" << std::endl;
+    std::cout << "  'n' - Toggle noise suppression" << std::endl;
+    std::cout << "  'h' - Toggle feedback (howl) suppression" << std::endl;
+    std::cout << "  'x' - Toggle saturation" << std::endl;
+    std::cout << "  'g' - Set saturation drive (dB)" << std::endl;
+    std::cout << "  'v' - Set reverb room (0-5)" << std::endl;
+    std::cout << "  'i' - Set input routing (0-3)" << std::endl;
+    std::cout << "  'w' - Set stereo width (0.0-2.0)" << std::endl;
+    std::cout << "  'c' - Toggle headphone crossfeed" << std::endl;
+    std::cout << "  'b' - Toggle standby output mirroring" << std::endl;
     std::cout << "  'r' - Reset effects" << std::endl;
     std::cout << "  'q' - Quit" << std::endl;
     std::cout << "Enter command: ";
@@ -1655,12 +10564,13 @@ int main(int argc, char *argv[])
             break;
 
         case 'd':
+        {
             // Toggle delay effect
-            static bool delayEnabled = true;
-            delayEnabled = !delayEnabled;
+            const bool delayEnabled = !processor.isEffectEnabled<DelayEffect>();
             processor.setDelayEnabled(delayEnabled);
             std::cout << "Delay effect " << (delayEnabled ? "enabled" : "disabled") << std::endl;
-            break;
+        }
+        break;
 
         case 't':
         {
@@ -1697,6 +10607,119 @@ int main(int argc, char *argv[])
         }
         break;
 
+        case 'e':
+        {
+            // Toggle echo cancellation
+            const bool echoCancellationEnabled = !processor.isEffectEnabled<EchoCancellerEffect>();
+            processor.setEchoCancellationEnabled(echoCancellationEnabled);
+            std::cout << "Echo cancellation " << (echoCancellationEnabled ? "enabled" : "disabled") << std::endl;
+        }
+        break;
+
+        case 'a':
+        {
+            // Toggle automatic gain control
+            const bool agcEnabled = !processor.isEffectEnabled<AgcEffect>();
+            processor.setAgcEnabled(agcEnabled);
+            std::cout << "Automatic gain control " << (agcEnabled ? "enabled" : "disabled") << std::endl;
+        }
+        break;
+
+        case 'l':
+        {
+            float lufs;
+            std::cout << "Enter AGC target (-40 to -6 LUFS): ";
+            std::cin >> lufs;
+            processor.setAgcTarget(lufs);
+            std::cout << "AGC target set to " << lufs << " LUFS" << std::endl;
+        }
+        break;
+
+        case 'n':
+        {
+            // Toggle noise suppression
+            const bool noiseSuppressionEnabled = !processor.isEffectEnabled<NoiseSuppressionEffect>();
+            processor.setNoiseSuppressionEnabled(noiseSuppressionEnabled);
+            std::cout << "Noise suppression " << (noiseSuppressionEnabled ? "enabled" : "disabled") << std::endl;
+        }
+        break;
+
+        case 'h':
+        {
+            // Toggle feedback suppression
+            const bool feedbackSuppressionEnabled = !processor.isEffectEnabled<FeedbackSuppressorEffect>();
+            processor.setFeedbackSuppressionEnabled(feedbackSuppressionEnabled);
+            std::cout << "Feedback suppression " << (feedbackSuppressionEnabled ? "enabled" : "disabled") << std::endl;
+        }
+        break;
+
+        case 'x':
+        {
+            // Toggle saturation effect
+            const bool saturationEnabled = !processor.isEffectEnabled<SaturationEffect>();
+            processor.setSaturationEnabled(saturationEnabled);
+            std::cout << "Saturation " << (saturationEnabled ? "enabled" : "disabled") << std::endl;
+        }
+        break;
+
+        case 'g':
+        {
+            float driveDb;
+            std::cout << "Enter saturation drive (0-36dB): ";
+            std::cin >> driveDb;
+            processor.setSaturationDrive(driveDb);
+            std::cout << "Saturation drive set to " << driveDb << "dB" << std::endl;
+        }
+        break;
+
+        case 'v':
+        {
+            int room;
+            std::cout << "Enter reverb room (0 = small, 1 = medium, 2 = hall, 3 = cathedral, 4 = plate, 5 = spring): ";
+            std::cin >> room;
+            processor.setReverbRoom(room);
+            std::cout << "Reverb room set to " << room << std::endl;
+        }
+        break;
+
+        case 'i':
+        {
+            int mode;
+            std::cout << "Enter input routing (0 = stereo, 1 = swapped, 2 = mono sum, 3 = left only): ";
+            std::cin >> mode;
+            processor.setInputRouting(mode);
+            std::cout << "Input routing set to " << mode << std::endl;
+        }
+        break;
+
+        case 'w':
+        {
+            float width;
+            std::cout << "Enter stereo width (0.0-2.0): ";
+            std::cin >> width;
+            processor.setStereoWidth(width);
+            std::cout << "Stereo width set to " << width << std::endl;
+        }
+        break;
+
+        case 'c':
+        {
+            // Toggle headphone crossfeed
+            const bool crossfeedEnabled = !processor.isEffectEnabled<CrossfeedEffect>();
+            processor.setCrossfeedEnabled(crossfeedEnabled);
+            std::cout << "Crossfeed " << (crossfeedEnabled ? "enabled" : "disabled") << std::endl;
+        }
+        break;
+
+        case 'b':
+        {
+            // Toggle whether the standby plays the programme or silence
+            const bool standbyMirrored = !processor.isStandbyMirrored();
+            processor.setStandbyMirrored(standbyMirrored);
+            std::cout << "Standby output " << (standbyMirrored ? "mirrored" : "silent") << std::endl;
+        }
+        break;
+
         case 'r':
             processor.resetEffects();
             std::cout << "Effects reset" << std::endl;